@@ -4,10 +4,17 @@ in vec3 v_pos;
 in vec3 v_color;
 in vec3 v_normal;
 in vec2 v_uv;
-uniform float unif_time;
-uniform vec3 unif_view_pos;
-uniform float unif_textured_color;
-uniform float unif_textured_normal;
+/* kgfw_frame is set once a frame, kgfw_draw once per draw */
+layout (std140) uniform kgfw_frame {
+	mat4 unif_vp;
+	vec3 unif_view_pos;
+	float unif_time;
+};
+layout (std140) uniform kgfw_draw {
+	mat4 unif_m;
+	float unif_textured_color;
+	float unif_textured_normal;
+};
 uniform sampler2D unif_texture_color;
 uniform sampler2D unif_texture_normal;
 out vec4 out_color;
@@ -4,8 +4,19 @@ layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec3 in_color;
 layout (location = 2) in vec3 in_normal;
 layout (location = 3) in vec2 in_uv;
-uniform mat4 unif_m;
-uniform mat4 unif_vp;
+/* identity unless the mesh is instanced */
+layout (location = 4) in mat4 in_instance_m;
+/* kgfw_frame is set once a frame, kgfw_draw once per draw */
+layout (std140) uniform kgfw_frame {
+	mat4 unif_vp;
+	vec3 unif_view_pos;
+	float unif_time;
+};
+layout (std140) uniform kgfw_draw {
+	mat4 unif_m;
+	float unif_textured_color;
+	float unif_textured_normal;
+};
 uniform mat4 unif_m_r;
 out vec3 v_pos;
 out vec3 v_color;
@@ -13,9 +24,10 @@ out vec3 v_normal;
 out vec2 v_uv;
 
 void main() {
-	gl_Position = unif_vp * unif_m * vec4(in_pos, 1.0);
-	v_pos = vec3(unif_m * vec4(in_pos, 1.0));
+	mat4 m = unif_m * in_instance_m;
+	gl_Position = unif_vp * m * vec4(in_pos, 1.0);
+	v_pos = vec3(m * vec4(in_pos, 1.0));
 	v_color = in_color;
-	v_normal = normalize(vec3(unif_m * vec4(in_normal, 0.0)));
+	v_normal = normalize(vec3(m * vec4(in_normal, 0.0)));
 	v_uv = in_uv;
 }
@@ -0,0 +1,22 @@
+#include "bench_alloc.h"
+
+#undef malloc
+#undef calloc
+#undef realloc
+
+unsigned long long int bench_alloc_count = 0;
+
+void * bench_malloc(size_t size) {
+	++bench_alloc_count;
+	return malloc(size);
+}
+
+void * bench_calloc(size_t count, size_t size) {
+	++bench_alloc_count;
+	return calloc(count, size);
+}
+
+void * bench_realloc(void * pointer, size_t size) {
+	++bench_alloc_count;
+	return realloc(pointer, size);
+}
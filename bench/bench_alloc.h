@@ -0,0 +1,22 @@
+#ifndef KRISVERS_BENCH_ALLOC_H
+#define KRISVERS_BENCH_ALLOC_H
+
+/*
+	force-included (-include bench/bench_alloc.h) into every benchmark translation unit
+	so allocations made anywhere in the engine code are counted. frees are not counted
+*/
+
+#include <stdlib.h>
+
+/* not synchronized, the benchmarks run without kgfw_jobs workers */
+extern unsigned long long int bench_alloc_count;
+
+void * bench_malloc(size_t size);
+void * bench_calloc(size_t count, size_t size);
+void * bench_realloc(void * pointer, size_t size);
+
+#define malloc(size) bench_malloc(size)
+#define calloc(count, size) bench_calloc(count, size)
+#define realloc(pointer, size) bench_realloc(pointer, size)
+
+#endif
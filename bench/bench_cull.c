@@ -0,0 +1,157 @@
+#include "../kgfw/kgfw_cull.h"
+#include "../kgfw/kgfw_bvh.h"
+#include "bench_alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef KGFW_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+	headless frustum culling microbenchmarks, run with make bench-cull.
+	boxes are scattered through a cube around a camera looking down -z, about a tenth of them are visible
+*/
+
+#define BENCH_OBJECTS 100000
+/* every kernel is repeated until about this many boxes were tested */
+#define BENCH_CULL_OPS 100000000
+#define BENCH_WORLD_SIZE 1000.0f
+
+static struct {
+	kgfw_cull_bounds_t bounds;
+	kgfw_bvh_t bvh;
+	kgfw_frustum_t frustum;
+	unsigned int * visible;
+	unsigned long long int reported;
+
+	/* of the benchmark being timed */
+	double start;
+	unsigned long long int allocs;
+} state;
+
+static double bench_now(void);
+static void bench_begin(void);
+static void bench_end(const char * name, unsigned long long int objects, unsigned long long int ops, unsigned long long int visible);
+static float bench_random(unsigned long long int * seed);
+static void bench_leaf(void * leaf_data, void * data);
+
+/* optional argument: the object count to run */
+int main(int argc, char ** argv) {
+	unsigned long long int count = BENCH_OBJECTS;
+	if (argc > 1) {
+		count = strtoull(argv[1], NULL, 10);
+	}
+
+	kgfw_cull_bounds_init(&state.bounds);
+	kgfw_bvh_init(&state.bvh);
+	if (kgfw_cull_bounds_reserve(&state.bounds, count) != 0) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	state.visible = malloc(sizeof(unsigned int) * state.bounds.capacity);
+	if (state.visible == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	unsigned long long int seed = 0x9E3779B97F4A7C15ull;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		kgfw_aabb_t aabb;
+		kgfw_sphere_t sphere;
+		float size = 0.5f + bench_random(&seed) * 4.0f;
+		for (unsigned int a = 0; a < 3; ++a) {
+			aabb.min[a] = (bench_random(&seed) - 0.5f) * BENCH_WORLD_SIZE;
+			aabb.max[a] = aabb.min[a] + size;
+			sphere.center[a] = aabb.min[a] + size * 0.5f;
+		}
+		/* half the box's diagonal */
+		sphere.radius = size * 0.8660254f;
+		kgfw_cull_bounds_push(&state.bounds, &aabb);
+		if (kgfw_bvh_insert(&state.bvh, &aabb, &sphere, NULL) == KGFW_BVH_LEAF_NONE) {
+			fprintf(stderr, "bvh insert failed\n");
+			return 1;
+		}
+	}
+
+	mat4x4 projection;
+	mat4x4 view;
+	mat4x4 vp;
+	vec3 eye = { 0, 0, 0 };
+	vec3 center = { 0, 0, -1 };
+	vec3 up = { 0, 1, 0 };
+	mat4x4_perspective(projection, 1.2f, 16.0f / 9.0f, 0.1f, BENCH_WORLD_SIZE * 0.5f);
+	mat4x4_look_at(view, eye, center, up);
+	mat4x4_mul(vp, projection, view);
+	kgfw_frustum_from_matrix(&state.frustum, vp);
+
+	unsigned long long int repeats = (BENCH_CULL_OPS + count - 1) / count;
+	unsigned long long int visible = 0;
+	printf("kernel: %s\n", kgfw_cull_kernel());
+	printf("%-28s %10s %12s %14s %10s %10s\n", "benchmark", "objects", "ns/object", "objects/s", "visible", "allocs");
+
+	bench_begin();
+	for (unsigned long long int r = 0; r < repeats; ++r) {
+		visible = kgfw_cull_frustum_scalar(&state.frustum, &state.bounds, state.visible);
+	}
+	bench_end("cull scalar", count, repeats * count, visible);
+
+	bench_begin();
+	for (unsigned long long int r = 0; r < repeats; ++r) {
+		visible = kgfw_cull_frustum(&state.frustum, &state.bounds, state.visible);
+	}
+	bench_end("cull", count, repeats * count, visible);
+
+	/* traversal and reporting through the callback included, divided over every object in the tree */
+	bench_begin();
+	for (unsigned long long int r = 0; r < repeats; ++r) {
+		state.reported = 0;
+		kgfw_bvh_cull(&state.bvh, &state.frustum, bench_leaf, NULL);
+	}
+	bench_end("bvh cull", count, repeats * count, state.reported);
+
+	free(state.visible);
+	kgfw_bvh_deinit(&state.bvh);
+	kgfw_cull_bounds_deinit(&state.bounds);
+	return 0;
+}
+
+static double bench_now(void) {
+#ifdef KGFW_WINDOWS
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+#endif
+}
+
+static void bench_begin(void) {
+	state.allocs = bench_alloc_count;
+	state.start = bench_now();
+}
+
+static void bench_end(const char * name, unsigned long long int objects, unsigned long long int ops, unsigned long long int visible) {
+	double elapsed = bench_now() - state.start;
+	unsigned long long int allocs = bench_alloc_count - state.allocs;
+	printf("%-28s %10llu %12.3f %14.0f %10llu %10llu\n", name, objects, elapsed * 1e9 / (double) ops, (double) ops / elapsed, visible, allocs);
+}
+
+/* xorshift with a fixed seed so every run culls the same scene, in [0, 1) */
+static float bench_random(unsigned long long int * seed) {
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return (float) (*seed >> 40) / (float) (1ull << 24);
+}
+
+static void bench_leaf(void * leaf_data, void * data) {
+	++state.reported;
+}
@@ -0,0 +1,250 @@
+#include "../kgfw/kgfw_ecs.h"
+#include "bench_alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef KGFW_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+	headless ECS microbenchmarks, run with make bench-ecs.
+	every benchmark is timed as a whole and reported per operation
+*/
+
+#define BENCH_SIZES_COUNT 4
+/* kgfw_ecs_update is repeated until about this many components were updated */
+#define BENCH_UPDATE_OPS 4000000
+
+typedef struct bench_position {
+	kgfw_component_t base;
+	float x;
+	float y;
+	float z;
+} bench_position_t;
+
+typedef struct bench_velocity {
+	kgfw_component_t base;
+	float x;
+	float y;
+	float z;
+} bench_velocity_t;
+
+static const unsigned long long int sizes[BENCH_SIZES_COUNT] = { 1000, 10000, 100000, 1000000 };
+
+static struct {
+	kgfw_uuid_t position;
+	kgfw_uuid_t velocity;
+
+	kgfw_entity_t ** entities;
+	kgfw_uuid_t * ids;
+	const char ** names;
+
+	/* of the benchmark being timed */
+	double start;
+	unsigned long long int allocs;
+} state = {
+	0, 0,
+	NULL, NULL, NULL,
+	0, 0
+};
+
+static double bench_now(void);
+static void bench_begin(void);
+static void bench_end(const char * name, unsigned long long int entities, unsigned long long int ops);
+static void bench_size(unsigned long long int count);
+static void bench_shuffle(unsigned long long int * order, unsigned long long int count);
+static void position_update(kgfw_component_t * self);
+static void component_start(kgfw_component_t * self);
+static void component_update(kgfw_component_t * self);
+static void component_destroy(kgfw_component_t * self);
+
+/* optional argument: the largest entity count to run */
+int main(int argc, char ** argv) {
+	unsigned long long int max = sizes[BENCH_SIZES_COUNT - 1];
+	if (argc > 1) {
+		max = strtoull(argv[1], NULL, 10);
+	}
+
+	if (kgfw_ecs_init() != 0) {
+		fprintf(stderr, "ecs init failed\n");
+		return 1;
+	}
+
+	bench_position_t position = {
+		{ component_update, component_start, component_destroy, 0, 0, NULL },
+		0, 0, 0,
+	};
+	position.base.update = position_update;
+	bench_velocity_t velocity = {
+		{ component_update, component_start, component_destroy, 0, 0, NULL },
+		1, 1, 1,
+	};
+	state.position = kgfw_component_construct("position", sizeof(bench_position_t), &position, 0);
+	state.velocity = kgfw_component_construct("velocity", sizeof(bench_velocity_t), &velocity, 0);
+	if (state.position == KGFW_ECS_INVALID_ID || state.velocity == KGFW_ECS_INVALID_ID) {
+		fprintf(stderr, "ecs component construction failed\n");
+		return 1;
+	}
+
+	state.entities = malloc(sizeof(kgfw_entity_t *) * max);
+	state.ids = malloc(sizeof(kgfw_uuid_t) * max);
+	state.names = malloc(sizeof(const char *) * max);
+	if (state.entities == NULL || state.ids == NULL || state.names == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	printf("%-28s %10s %12s %12s\n", "benchmark", "entities", "ns/op", "allocs/op");
+	for (unsigned long long int i = 0; i < BENCH_SIZES_COUNT && sizes[i] <= max; ++i) {
+		bench_size(sizes[i]);
+	}
+
+	free(state.entities);
+	free(state.ids);
+	free(state.names);
+	kgfw_ecs_deinit();
+	return 0;
+}
+
+static double bench_now(void) {
+#ifdef KGFW_WINDOWS
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+#endif
+}
+
+static void bench_begin(void) {
+	state.allocs = bench_alloc_count;
+	state.start = bench_now();
+}
+
+static void bench_end(const char * name, unsigned long long int entities, unsigned long long int ops) {
+	double elapsed = bench_now() - state.start;
+	unsigned long long int allocs = bench_alloc_count - state.allocs;
+	printf("%-28s %10llu %12.1f %12.4f\n", name, entities, elapsed * 1e9 / (double) ops, (double) allocs / (double) ops);
+}
+
+static void bench_size(unsigned long long int count) {
+	unsigned long long int * order = malloc(sizeof(unsigned long long int) * count);
+	if (order == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return;
+	}
+	for (unsigned long long int i = 0; i < count; ++i) {
+		order[i] = i;
+	}
+	bench_shuffle(order, count);
+
+	bench_begin();
+	for (unsigned long long int i = 0; i < count; ++i) {
+		state.entities[i] = kgfw_entity_new(NULL);
+	}
+	bench_end("entity new", count, count);
+
+	for (unsigned long long int i = 0; i < count; ++i) {
+		state.ids[i] = state.entities[i]->id;
+		state.names[i] = state.entities[i]->name;
+	}
+
+	bench_begin();
+	for (unsigned long long int i = 0; i < count; ++i) {
+		kgfw_entity_attach_component(state.entities[i], state.position);
+	}
+	bench_end("component attach", count, count);
+
+	/* moves every entity into a second archetype */
+	bench_begin();
+	for (unsigned long long int i = 0; i < count; ++i) {
+		kgfw_entity_attach_component(state.entities[i], state.velocity);
+	}
+	bench_end("component attach (move)", count, count);
+
+	bench_begin();
+	for (unsigned long long int i = 0; i < count; ++i) {
+		if (kgfw_entity_get(state.ids[order[i]]) == NULL) {
+			fprintf(stderr, "entity lookup failed\n");
+		}
+	}
+	bench_end("entity get", count, count);
+
+	bench_begin();
+	for (unsigned long long int i = 0; i < count; ++i) {
+		if (kgfw_entity_get_via_name(state.names[order[i]]) == NULL) {
+			fprintf(stderr, "entity lookup failed\n");
+		}
+	}
+	bench_end("entity get via name", count, count);
+
+	bench_begin();
+	for (unsigned long long int i = 0; i < count; ++i) {
+		if (kgfw_entity_get_component(state.entities[order[i]], state.velocity) == NULL) {
+			fprintf(stderr, "component lookup failed\n");
+		}
+	}
+	bench_end("entity get component", count, count);
+
+	/* the first update after structural changes relinks the component lists */
+	kgfw_ecs_update();
+	unsigned long long int updates = (BENCH_UPDATE_OPS + count - 1) / count;
+	bench_begin();
+	for (unsigned long long int i = 0; i < updates; ++i) {
+		kgfw_ecs_update();
+	}
+	/* both component types are updated */
+	bench_end("ecs update (per component)", count, updates * count * 2);
+
+	bench_begin();
+	for (unsigned long long int i = 0; i < count; ++i) {
+		kgfw_component_destroy(kgfw_entity_get_component(state.entities[i], state.velocity));
+	}
+	bench_end("component detach", count, count);
+
+	bench_begin();
+	for (unsigned long long int i = 0; i < count; ++i) {
+		kgfw_entity_destroy(state.entities[i]);
+	}
+	bench_end("entity destroy", count, count);
+
+	free(order);
+}
+
+/* fixed seed so every run looks things up in the same order */
+static void bench_shuffle(unsigned long long int * order, unsigned long long int count) {
+	unsigned long long int seed = 0x9E3779B97F4A7C15ull;
+	for (unsigned long long int i = count - 1; i > 0; --i) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		unsigned long long int j = seed % (i + 1);
+		unsigned long long int t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+}
+
+static void position_update(kgfw_component_t * self) {
+	bench_position_t * position = (bench_position_t *) self;
+	position->x += 1;
+	position->y += 1;
+	position->z += 1;
+}
+
+static void component_start(kgfw_component_t * self) {
+}
+
+static void component_update(kgfw_component_t * self) {
+}
+
+static void component_destroy(kgfw_component_t * self) {
+}
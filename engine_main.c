@@ -73,6 +73,8 @@ struct {
 
 #define STORAGE_MAX_TEXTURES 64
 #define STORAGE_MAX_MESHES 64
+/* simplified levels generated for every loaded mesh */
+#define MESH_LODS 4
 
 struct {
 	ktga_t textures[STORAGE_MAX_TEXTURES];
@@ -81,6 +83,8 @@ struct {
 	kgfw_graphics_mesh_t meshes[STORAGE_MAX_MESHES];
 	unsigned long long int meshes_count;
 	kgfw_hash_t mesh_hashes[STORAGE_MAX_MESHES];
+	/* one instanced node per mesh, created by the first "game instance" of it */
+	kgfw_graphics_mesh_node_t * instanced[STORAGE_MAX_MESHES];
 } static storage = {
 	{ 0 },
 	0,
@@ -88,6 +92,7 @@ struct {
 	{ 0 },
 	0,
 	{ 0 },
+	{ 0 },
 };
 
 static int kgfw_log_handler(kgfw_log_severity_enum severity, char * string);
@@ -219,7 +224,12 @@ int engine_main(int argc, char ** argv) {
 		return 5;
 	}
 
+	if (kgfw_jobs_init(KGFW_JOBS_WORKERS_DEFAULT) != 0) {
+		kgfw_logf(KGFW_LOG_SEVERITY_WARN, "failed to start job workers, running serially");
+	}
+
 	if (kgfw_ecs_init() != 0) {
+		kgfw_jobs_deinit();
 		kgfw_console_deinit();
 		textures_cleanup();
 		kgfw_graphics_deinit();
@@ -231,6 +241,7 @@ int engine_main(int argc, char ** argv) {
 
 	if (kgfw_sys_ui_init(&state.camera) == 0) {
 		kgfw_ecs_deinit();
+		kgfw_jobs_deinit();
 		kgfw_console_deinit();
 		textures_cleanup();
 		kgfw_graphics_deinit();
@@ -247,7 +258,7 @@ int engine_main(int argc, char ** argv) {
 		.destroy = &java_scripts_system_destroy,
 	};
 
-	state.java.system_id = kgfw_system_construct("java scripts", sizeof(java_system), &java_system);
+	state.java.system_id = kgfw_system_construct("java scripts", sizeof(java_system), &java_system, NULL);
 	if (state.java.system_id == KGFW_ECS_INVALID_ID) {
 		kgfw_log(KGFW_LOG_SEVERITY_ERROR, "Failed to setup java scripts ecs system");
 		return 7;
@@ -350,6 +361,9 @@ int engine_main(int argc, char ** argv) {
 			}
 		}
 
+		/* input queued by the callbacks above reaches its subscribers here */
+		kgfw_event_dispatch();
+
 		kgfw_time_end();
 		kgfw_ecs_update();
 		kgfw_input_update();
@@ -362,6 +376,7 @@ int engine_main(int argc, char ** argv) {
 	(*state.java.jvm)->DestroyJavaVM(state.java.jvm);
 
 	kgfw_ecs_deinit();
+	kgfw_jobs_deinit();
 	kgfw_console_deinit();
 	meshes_cleanup();
 	textures_cleanup();
@@ -975,6 +990,11 @@ static int meshes_load(void) {
 
 		free(buffer);
 
+		/* distant copies are drawn with these instead of every triangle */
+		if (kgfw_graphics_mesh_lods_generate(&storage.meshes[mi], MESH_LODS) != 0) {
+			kgfw_logf(KGFW_LOG_SEVERITY_WARN, "failed to generate lods for \"%s\"", files->data.array.elements.string[mi]);
+		}
+
 		if (names == NULL) {
 			storage.mesh_hashes[mi] = kgfw_hash(files->data.array.elements.string[mi]);
 		} else {
@@ -995,6 +1015,9 @@ static void meshes_cleanup(void) {
 		if (storage.meshes[i].indices != NULL) {
 			free(storage.meshes[i].indices);
 		}
+		kgfw_graphics_mesh_lods_free(&storage.meshes[i]);
+		/* destroyed with the rest of the meshes by kgfw_graphics_deinit */
+		storage.instanced[i] = NULL;
 	}
 	storage.meshes_count = 0;
 }
@@ -1011,13 +1034,14 @@ static kgfw_graphics_mesh_t * mesh_get(char * name) {
 }
 
 static int game_command(int argc, char ** argv) {
-	const char * subcommands = "mesh    fov    movement    arrow_speed    mouse_speed    jump_force    gravity    pos";
+	const char * subcommands = "mesh    static    instance    fov    movement    arrow_speed    mouse_speed    jump_force    gravity    pos";
 	if (argc < 2) {
 		kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "subcommands: %s", subcommands);
 		return 0;
 	}
 
-	if (strcmp(argv[1], "mesh") == 0) {
+	/* static meshes are batched with every other static mesh sharing their texture */
+	if (strcmp(argv[1], "mesh") == 0 || strcmp(argv[1], "static") == 0) {
 		if (argc < 3) {
 			const char * args = "[mesh name] (optional texture name)";
 			kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "arguments: %s", args);
@@ -1036,6 +1060,8 @@ static int game_command(int argc, char ** argv) {
 			node->transform.pos[2] = state.camera.pos[2];
 
 			node->transform.rot[1] = state.camera.rot[1];
+			kgfw_graphics_mesh_transform_changed(node);
+			kgfw_graphics_mesh_static(node, strcmp(argv[1], "static") == 0);
 		}
 		if (argc >= 4) {
 			ktga_t * tga = texture_get(argv[3]);
@@ -1044,6 +1070,67 @@ static int game_command(int argc, char ** argv) {
 				return 0;
 			}
 
+			kgfw_graphics_texture_t tex = {
+				.bitmap = tga->bitmap,
+				.width = tga->header.img_w,
+				.height = tga->header.img_h,
+				.fmt = KGFW_GRAPHICS_TEXTURE_FORMAT_BGRA,
+				.u_wrap = KGFW_GRAPHICS_TEXTURE_WRAP_CLAMP,
+				.v_wrap = KGFW_GRAPHICS_TEXTURE_WRAP_CLAMP,
+				.filtering = KGFW_GRAPHICS_TEXTURE_FILTERING_NEAREST,
+			};
+			kgfw_graphics_mesh_texture(node, &tex, KGFW_GRAPHICS_TEXTURE_USE_COLOR);
+		}
+	} else if (strcmp(argv[1], "instance") == 0) {
+		if (argc < 4) {
+			const char * args = "[mesh name] [count] (optional texture name)";
+			kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "arguments: %s", args);
+			return 0;
+		}
+		kgfw_graphics_mesh_t * mesh = mesh_get(argv[2]);
+		if (mesh == NULL) {
+			kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "mesh does not exist \"%s\"", argv[2]);
+			return 0;
+		}
+
+		unsigned long long int mi = mesh - storage.meshes;
+		kgfw_graphics_mesh_node_t * node = storage.instanced[mi];
+		if (node == NULL) {
+			node = kgfw_graphics_mesh_new_instanced(mesh, NULL);
+			if (node == NULL) {
+				kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "failed to create instanced mesh \"%s\"", argv[2]);
+				return 0;
+			}
+			/* the mesh's own transform is given to every instance instead */
+			kgfw_transform_identity((kgfw_transform_t *) &node->transform);
+			kgfw_graphics_mesh_transform_changed(node);
+			storage.instanced[mi] = node;
+		}
+
+		/* a square grid around the camera, all drawn by a single call */
+		unsigned long long int count = strtoull(argv[3], NULL, 10);
+		unsigned long long int side = (unsigned long long int) ceil(sqrt((double) count));
+		kgfw_transform_t transform;
+		memcpy(transform.rot, mesh->rot, sizeof(vec3));
+		memcpy(transform.scale, mesh->scale, sizeof(vec3));
+		transform.rot[1] = state.camera.rot[1];
+		for (unsigned long long int i = 0; i < count; ++i) {
+			transform.pos[0] = state.camera.pos[0] + ((float) (i % side) - side / 2.0f) * 4;
+			transform.pos[1] = state.camera.pos[1];
+			transform.pos[2] = state.camera.pos[2] + ((float) (i / side) - side / 2.0f) * 4;
+			if (kgfw_graphics_mesh_instance_add(node, &transform) == KGFW_GRAPHICS_INSTANCE_NONE) {
+				kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "failed to add instances after %llu", i);
+				break;
+			}
+		}
+
+		if (argc >= 5) {
+			ktga_t * tga = texture_get(argv[4]);
+			if (tga == NULL) {
+				kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "texture does not exist \"%s\"", argv[4]);
+				return 0;
+			}
+
 			kgfw_graphics_texture_t tex = {
 				.bitmap = tga->bitmap,
 				.width = tga->header.img_w,
@@ -1161,22 +1248,7 @@ JNIEXPORT void JNICALL Java_kgfw_KGFW_logc(JNIEnv* env, jobject obj, jint severi
 }
 
 /* kgfw_ecs */
-JNIEXPORT jobject JNICALL Java_kgfw_KGFW_newEntity(JNIEnv* env, jobject obj, jstring name) {
-	const char* e_name = NULL;
-	if (name == NULL) {
-		e_name = (*env)->GetStringUTFChars(env, name, 0);
-	}
-
-	kgfw_entity_t* kgfw_entity = kgfw_entity_new(e_name);
-	if (e_name != NULL) {
-		(*env)->ReleaseStringUTFChars(env, name, e_name);
-	}
-
-	if (kgfw_entity == NULL) {
-		throw_jni_exception(env, "java/lang/RuntimeException", "Failed to create new entity");
-		return NULL;
-	}
-
+static jobject jni_entity_new(JNIEnv* env, kgfw_entity_t* kgfw_entity) {
 	jclass entity_class = (*env)->FindClass(env, "kgfw/Entity");
 	if (entity_class == NULL) {
 		throw_jni_exception(env, "java/lang/ClassNotFoundException", "Failed to find kgfw.Entity class");
@@ -1195,37 +1267,181 @@ JNIEXPORT jobject JNICALL Java_kgfw_KGFW_newEntity(JNIEnv* env, jobject obj, jst
 		return NULL;
 	}
 
-	(*env)->SetLongField(env, entity, handle_field, (jlong) kgfw_entity);
+	(*env)->SetLongField(env, entity, handle_field, (jlong) kgfw_entity->handle);
 	return entity;
 }
 
-JNIEXPORT void JNICALL Java_kgfw_KGFW_destroyEntity(JNIEnv* env, jobject obj, jobject entity) {
+/* throws and returns KGFW_ECS_INVALID_HANDLE if entity is not a live kgfw.Entity */
+static kgfw_entity_handle_t jni_entity_handle(JNIEnv* env, jobject entity) {
 	if (entity == NULL) {
 		throw_jni_exception(env, "java/lang/IllegalArgumentException", "Entity argument is invalid");
-		return;
+		return KGFW_ECS_INVALID_HANDLE;
 	}
 
 	jclass entity_class = (*env)->GetObjectClass(env, entity);
 	jfieldID handle_field = (*env)->GetFieldID(env, entity_class, "handle", "J");
 	if (handle_field == NULL) {
 		throw_jni_exception(env, "java/lang/NoSuchFieldError", "kgfw.Entity handle field not found");
-		return;
+		return KGFW_ECS_INVALID_HANDLE;
 	}
 
 	jlong handle = (*env)->GetLongField(env, entity, handle_field);
-	kgfw_entity_destroy((kgfw_entity_t*) handle);
+	if (kgfw_entity_resolve((kgfw_entity_handle_t) handle) == NULL) {
+		throw_jni_exception(env, "java/lang/IllegalStateException", "Entity was already destroyed");
+		return KGFW_ECS_INVALID_HANDLE;
+	}
+
+	return (kgfw_entity_handle_t) handle;
+}
+
+/* scripts run inside of kgfw_ecs_update, so the attach is deferred and the component refers to it by entity and type */
+static jobject jni_component_attach(JNIEnv* env, jobject entity, kgfw_uuid_t type_id) {
+	kgfw_entity_handle_t handle = jni_entity_handle(env, entity);
+	if (handle == KGFW_ECS_INVALID_HANDLE) {
+		return NULL;
+	}
+
+	if (type_id == KGFW_ECS_INVALID_ID) {
+		throw_jni_exception(env, "java/lang/IllegalArgumentException", "Component type not found");
+		return NULL;
+	}
+
+	if (kgfw_ecs_defer_attach(handle, type_id, NULL) != 0) {
+		throw_jni_exception(env, "java/lang/RuntimeException", "Failed to attach component");
+		return NULL;
+	}
+
+	jclass component_class = (*env)->FindClass(env, "kgfw/Component");
+	if (component_class == NULL) {
+		throw_jni_exception(env, "java/lang/ClassNotFoundException", "Failed to find kgfw.Component class");
+		return NULL;
+	}
+
+	jobject component = (*env)->AllocObject(env, component_class);
+	if (component == NULL) {
+		throw_jni_exception(env, "java/lang/RuntimeException", "Failed to create new component");
+		return NULL;
+	}
+
+	jfieldID entity_field = (*env)->GetFieldID(env, component_class, "entity", "J");
+	jfieldID type_field = (*env)->GetFieldID(env, component_class, "type", "J");
+	if (entity_field == NULL || type_field == NULL) {
+		throw_jni_exception(env, "java/lang/NoSuchFieldError", "Failed to find kgfw.Component entity or type field");
+		return NULL;
+	}
+
+	(*env)->SetLongField(env, component, entity_field, (jlong) handle);
+	(*env)->SetLongField(env, component, type_field, (jlong) type_id);
+	return component;
+}
+
+JNIEXPORT jobject JNICALL Java_kgfw_KGFW_newEntity(JNIEnv* env, jobject obj, jstring name) {
+	const char* e_name = NULL;
+	if (name != NULL) {
+		e_name = (*env)->GetStringUTFChars(env, name, 0);
+	}
+
+	kgfw_entity_t* kgfw_entity = kgfw_entity_new(e_name);
+	if (e_name != NULL) {
+		(*env)->ReleaseStringUTFChars(env, name, e_name);
+	}
+
+	if (kgfw_entity == NULL) {
+		throw_jni_exception(env, "java/lang/RuntimeException", "Failed to create new entity");
+		return NULL;
+	}
+
+	return jni_entity_new(env, kgfw_entity);
+}
+
+JNIEXPORT void JNICALL Java_kgfw_KGFW_destroyEntity(JNIEnv* env, jobject obj, jobject entity) {
+	kgfw_entity_handle_t handle = jni_entity_handle(env, entity);
+	if (handle == KGFW_ECS_INVALID_HANDLE) {
+		return;
+	}
+
+	/* scripts run inside of kgfw_ecs_update, the entity is destroyed once the running systems are done */
+	if (kgfw_ecs_defer_destroy(handle) != 0) {
+		throw_jni_exception(env, "java/lang/RuntimeException", "Failed to destroy entity");
+	}
 }
 
 JNIEXPORT jobject JNICALL Java_kgfw_KGFW_copyEntity(JNIEnv* env, jobject obj, jstring string, jobject sourceEntity);
 
-JNIEXPORT jobject JNICALL Java_kgfw_KGFW_findEntity__Ljava_lang_String_2(JNIEnv* env, jobject obj, jstring entityName);
+JNIEXPORT jobject JNICALL Java_kgfw_KGFW_findEntity__Ljava_lang_String_2(JNIEnv* env, jobject obj, jstring entityName) {
+	if (entityName == NULL) {
+		throw_jni_exception(env, "java/lang/IllegalArgumentException", "Entity name argument is invalid");
+		return NULL;
+	}
+
+	const char* e_name = (*env)->GetStringUTFChars(env, entityName, 0);
+	kgfw_entity_t* kgfw_entity = kgfw_entity_get_via_name(e_name);
+	(*env)->ReleaseStringUTFChars(env, entityName, e_name);
 
-JNIEXPORT jobject JNICALL Java_kgfw_KGFW_findEntity__J(JNIEnv* env, jobject obj, jlong entityID);
+	if (kgfw_entity == NULL) {
+		return NULL;
+	}
+
+	return jni_entity_new(env, kgfw_entity);
+}
+
+JNIEXPORT jobject JNICALL Java_kgfw_KGFW_findEntity__J(JNIEnv* env, jobject obj, jlong entityID) {
+	kgfw_entity_t* kgfw_entity = kgfw_entity_get((kgfw_uuid_t) entityID);
+	if (kgfw_entity == NULL) {
+		return NULL;
+	}
+
+	return jni_entity_new(env, kgfw_entity);
+}
 
 JNIEXPORT jobject JNICALL Java_kgfw_KGFW_entityGetComponent(JNIEnv* env, jobject obj, jobject entity, jlong componentID);
 
 JNIEXPORT jobject JNICALL Java_kgfw_KGFW_entityAttachComponent__Lkgfw_Entity_2Ljava_lang_String_2(JNIEnv* env, jobject obj, jobject entity, jstring componentName) {
-	return NULL;
+	if (componentName == NULL) {
+		throw_jni_exception(env, "java/lang/IllegalArgumentException", "Component name argument is invalid");
+		return NULL;
+	}
+
+	const char* c_name = (*env)->GetStringUTFChars(env, componentName, 0);
+	kgfw_uuid_t type_id = kgfw_component_type_get_id(c_name);
+	if (type_id == KGFW_ECS_INVALID_ID) {
+		/* script components are registered as "Java " followed by their classpath */
+		char script_name[512];
+		if (snprintf(script_name, sizeof(script_name), "Java %s", c_name) < (int) sizeof(script_name)) {
+			type_id = kgfw_component_type_get_id(script_name);
+		}
+	}
+	(*env)->ReleaseStringUTFChars(env, componentName, c_name);
+
+	return jni_component_attach(env, entity, type_id);
+}
+
+JNIEXPORT jobject JNICALL Java_kgfw_KGFW_entityAttachComponent__Lkgfw_Entity_2J(JNIEnv* env, jobject obj, jobject entity, jlong componentID) {
+	return jni_component_attach(env, entity, (kgfw_uuid_t) componentID);
 }
 
-JNIEXPORT jobject JNICALL Java_kgfw_KGFW_entityAttachComponent__Lkgfw_Entity_2J(JNIEnv* env, jobject obj, jobject entity, jlong componentID);
+JNIEXPORT void JNICALL Java_kgfw_KGFW_destroyComponent(JNIEnv* env, jobject obj, jobject component) {
+	if (component == NULL) {
+		throw_jni_exception(env, "java/lang/IllegalArgumentException", "Component argument is invalid");
+		return;
+	}
+
+	jclass component_class = (*env)->GetObjectClass(env, component);
+	jfieldID entity_field = (*env)->GetFieldID(env, component_class, "entity", "J");
+	jfieldID type_field = (*env)->GetFieldID(env, component_class, "type", "J");
+	if (entity_field == NULL || type_field == NULL) {
+		throw_jni_exception(env, "java/lang/NoSuchFieldError", "kgfw.Component entity or type field not found");
+		return;
+	}
+
+	kgfw_entity_handle_t handle = (kgfw_entity_handle_t) (*env)->GetLongField(env, component, entity_field);
+	if (kgfw_entity_resolve(handle) == NULL) {
+		throw_jni_exception(env, "java/lang/IllegalStateException", "Entity of the component was already destroyed");
+		return;
+	}
+
+	/* scripts run inside of kgfw_ecs_update, the component is detached once the running systems are done */
+	if (kgfw_ecs_defer_detach(handle, (kgfw_uuid_t) (*env)->GetLongField(env, component, type_field)) != 0) {
+		throw_jni_exception(env, "java/lang/RuntimeException", "Failed to destroy component");
+	}
+}
@@ -1,4 +1,12 @@
 package kgfw;
 
 public class Component {
+    /* generational kgfw_entity_handle_t of the entity it is attached to, 0 is never a valid handle */
+    private long entity = 0;
+    /* component type id */
+    private long type = 0;
+
+    private Component() {
+        
+    }
 }
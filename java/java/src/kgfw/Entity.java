@@ -1,6 +1,7 @@
 package kgfw;
 
 public class Entity {
+    /* generational kgfw_entity_handle_t, 0 is never a valid handle */
     private long handle = 0;
 
     private Entity() {
@@ -19,10 +19,16 @@ int kgfw_init(void) {
 
 	srand(time(NULL));
 
+	if (kgfw_event_init() != 0) {
+		glfwTerminate();
+		return 2;
+	}
+
 	return 0;
 }
 
 void kgfw_deinit(void) {
+	kgfw_event_deinit();
 	glfwTerminate();
 }
 
@@ -6,11 +6,14 @@
 #include "kgfw_commands.h"
 #include "kgfw_console.h"
 #include "kgfw_ecs.h"
+#include "kgfw_event.h"
 #include "kgfw_graphics.h"
 #include "kgfw_hash.h"
 #include "kgfw_input.h"
+#include "kgfw_jobs.h"
 #include "kgfw_log.h"
 #include "kgfw_list.h"
+#include "kgfw_thread.h"
 #include "kgfw_time.h"
 #include "kgfw_transform.h"
 #include "kgfw_uuid.h"
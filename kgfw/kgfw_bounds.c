@@ -0,0 +1,159 @@
+#include "kgfw_bounds.h"
+#include <math.h>
+#include <string.h>
+
+void kgfw_bounds_from_points(const float * points, unsigned long long int count, unsigned long long int stride, kgfw_aabb_t * out_aabb, kgfw_sphere_t * out_sphere) {
+	kgfw_aabb_t aabb = { { 0, 0, 0 }, { 0, 0, 0 } };
+	for (unsigned long long int i = 0; i < count; ++i) {
+		const float * p = (const float *) ((const char *) points + i * stride);
+		for (unsigned int a = 0; a < 3; ++a) {
+			if (i == 0 || p[a] < aabb.min[a]) {
+				aabb.min[a] = p[a];
+			}
+			if (i == 0 || p[a] > aabb.max[a]) {
+				aabb.max[a] = p[a];
+			}
+		}
+	}
+
+	if (out_sphere != NULL) {
+		kgfw_sphere_t sphere;
+		float radius = 0;
+		for (unsigned int a = 0; a < 3; ++a) {
+			sphere.center[a] = (aabb.min[a] + aabb.max[a]) * 0.5f;
+		}
+		/* tighter than half the box's diagonal unless the points fill its corners */
+		for (unsigned long long int i = 0; i < count; ++i) {
+			const float * p = (const float *) ((const char *) points + i * stride);
+			float dx = p[0] - sphere.center[0];
+			float dy = p[1] - sphere.center[1];
+			float dz = p[2] - sphere.center[2];
+			float d = dx * dx + dy * dy + dz * dz;
+			if (d > radius) {
+				radius = d;
+			}
+		}
+		sphere.radius = sqrtf(radius);
+		*out_sphere = sphere;
+	}
+	if (out_aabb != NULL) {
+		*out_aabb = aabb;
+	}
+}
+
+void kgfw_aabb_transform(const kgfw_aabb_t * aabb, mat4x4 m, kgfw_aabb_t * out_aabb) {
+	/* each axis of the result is the translation plus the extremes of every column's contribution */
+	kgfw_aabb_t r;
+	for (unsigned int row = 0; row < 3; ++row) {
+		r.min[row] = m[3][row];
+		r.max[row] = m[3][row];
+		for (unsigned int col = 0; col < 3; ++col) {
+			float a = m[col][row] * aabb->min[col];
+			float b = m[col][row] * aabb->max[col];
+			if (a < b) {
+				r.min[row] += a;
+				r.max[row] += b;
+			} else {
+				r.min[row] += b;
+				r.max[row] += a;
+			}
+		}
+	}
+	*out_aabb = r;
+}
+
+void kgfw_aabb_union(const kgfw_aabb_t * a, const kgfw_aabb_t * b, kgfw_aabb_t * out_aabb) {
+	for (unsigned int i = 0; i < 3; ++i) {
+		out_aabb->min[i] = (a->min[i] < b->min[i]) ? a->min[i] : b->min[i];
+		out_aabb->max[i] = (a->max[i] > b->max[i]) ? a->max[i] : b->max[i];
+	}
+}
+
+unsigned char kgfw_aabb_contains(const kgfw_aabb_t * outer, const kgfw_aabb_t * inner) {
+	for (unsigned int i = 0; i < 3; ++i) {
+		if (inner->min[i] < outer->min[i] || inner->max[i] > outer->max[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+void kgfw_sphere_transform(const kgfw_sphere_t * sphere, mat4x4 m, kgfw_sphere_t * out_sphere) {
+	float scale = 0;
+	for (unsigned int col = 0; col < 3; ++col) {
+		float s = m[col][0] * m[col][0] + m[col][1] * m[col][1] + m[col][2] * m[col][2];
+		if (s > scale) {
+			scale = s;
+		}
+	}
+
+	kgfw_sphere_t r;
+	for (unsigned int row = 0; row < 3; ++row) {
+		r.center[row] = m[0][row] * sphere->center[0] + m[1][row] * sphere->center[1] + m[2][row] * sphere->center[2] + m[3][row];
+	}
+	r.radius = sphere->radius * sqrtf(scale);
+	*out_sphere = r;
+}
+
+void kgfw_frustum_from_matrix(kgfw_frustum_t * frustum, mat4x4 vp) {
+	/* rows of the matrix combined as w +- x, y and z (Gribb and Hartmann) */
+	for (unsigned int i = 0; i < 6; ++i) {
+		unsigned int row = i / 2;
+		float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+		for (unsigned int col = 0; col < 4; ++col) {
+			frustum->planes[i][col] = vp[col][3] + sign * vp[col][row];
+		}
+
+		float length = sqrtf(frustum->planes[i][0] * frustum->planes[i][0] + frustum->planes[i][1] * frustum->planes[i][1] + frustum->planes[i][2] * frustum->planes[i][2]);
+		if (length > 0) {
+			for (unsigned int col = 0; col < 4; ++col) {
+				frustum->planes[i][col] /= length;
+			}
+		}
+	}
+}
+
+kgfw_frustum_result_enum kgfw_frustum_test_aabb(const kgfw_frustum_t * frustum, const kgfw_aabb_t * aabb) {
+	kgfw_frustum_result_enum result = KGFW_FRUSTUM_INSIDE;
+	for (unsigned int i = 0; i < 6; ++i) {
+		const float * p = frustum->planes[i];
+		/* the corners furthest along and against the plane's normal */
+		float front = p[3];
+		float back = p[3];
+		for (unsigned int a = 0; a < 3; ++a) {
+			if (p[a] >= 0) {
+				front += p[a] * aabb->max[a];
+				back += p[a] * aabb->min[a];
+			} else {
+				front += p[a] * aabb->min[a];
+				back += p[a] * aabb->max[a];
+			}
+		}
+
+		if (front < 0) {
+			return KGFW_FRUSTUM_OUTSIDE;
+		}
+		if (back < 0) {
+			result = KGFW_FRUSTUM_INTERSECTS;
+		}
+	}
+
+	return result;
+}
+
+kgfw_frustum_result_enum kgfw_frustum_test_sphere(const kgfw_frustum_t * frustum, const kgfw_sphere_t * sphere) {
+	kgfw_frustum_result_enum result = KGFW_FRUSTUM_INSIDE;
+	for (unsigned int i = 0; i < 6; ++i) {
+		const float * p = frustum->planes[i];
+		float d = p[0] * sphere->center[0] + p[1] * sphere->center[1] + p[2] * sphere->center[2] + p[3];
+		if (d < -sphere->radius) {
+			return KGFW_FRUSTUM_OUTSIDE;
+		}
+		if (d < sphere->radius) {
+			result = KGFW_FRUSTUM_INTERSECTS;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,43 @@
+#ifndef KRISVERS_KGFW_BOUNDS_H
+#define KRISVERS_KGFW_BOUNDS_H
+
+#include "kgfw_defines.h"
+#include "../lib/include/linmath.h"
+
+typedef struct kgfw_aabb {
+	vec3 min;
+	vec3 max;
+} kgfw_aabb_t;
+
+typedef struct kgfw_sphere {
+	vec3 center;
+	float radius;
+} kgfw_sphere_t;
+
+/* planes face inwards, a point p is in front of a plane if dot(plane, p) + plane[3] >= 0 */
+typedef struct kgfw_frustum {
+	/* left, right, bottom, top, near, far */
+	vec4 planes[6];
+} kgfw_frustum_t;
+
+typedef enum kgfw_frustum_result {
+	KGFW_FRUSTUM_OUTSIDE = 0,
+	KGFW_FRUSTUM_INTERSECTS,
+	KGFW_FRUSTUM_INSIDE,
+} kgfw_frustum_result_enum;
+
+/* count points of 3 floats each, stride bytes apart. the sphere is centered on the box and just encloses the points */
+KGFW_PUBLIC void kgfw_bounds_from_points(const float * points, unsigned long long int count, unsigned long long int stride, kgfw_aabb_t * out_aabb, kgfw_sphere_t * out_sphere);
+/* box around the transformed box */
+KGFW_PUBLIC void kgfw_aabb_transform(const kgfw_aabb_t * aabb, mat4x4 m, kgfw_aabb_t * out_aabb);
+KGFW_PUBLIC void kgfw_aabb_union(const kgfw_aabb_t * a, const kgfw_aabb_t * b, kgfw_aabb_t * out_aabb);
+KGFW_PUBLIC unsigned char kgfw_aabb_contains(const kgfw_aabb_t * outer, const kgfw_aabb_t * inner);
+/* the radius is scaled by the largest axis scale of m */
+KGFW_PUBLIC void kgfw_sphere_transform(const kgfw_sphere_t * sphere, mat4x4 m, kgfw_sphere_t * out_sphere);
+
+/* planes of the clip volume of a view projection matrix, works for perspective and orthographic projections */
+KGFW_PUBLIC void kgfw_frustum_from_matrix(kgfw_frustum_t * frustum, mat4x4 vp);
+KGFW_PUBLIC kgfw_frustum_result_enum kgfw_frustum_test_aabb(const kgfw_frustum_t * frustum, const kgfw_aabb_t * aabb);
+KGFW_PUBLIC kgfw_frustum_result_enum kgfw_frustum_test_sphere(const kgfw_frustum_t * frustum, const kgfw_sphere_t * sphere);
+
+#endif
@@ -0,0 +1,390 @@
+#include "kgfw_bvh.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BVH_NONE 0xFFFFFFFFu
+#define BVH_MIN_CAPACITY 64
+/* set on traversal stack entries whose subtree is known to be inside the frustum */
+#define BVH_INSIDE 0x80000000u
+
+static unsigned int bvh_node_alloc(kgfw_bvh_t * bvh);
+static void bvh_node_free(kgfw_bvh_t * bvh, unsigned int node);
+static void bvh_insert_leaf(kgfw_bvh_t * bvh, unsigned int leaf);
+static void bvh_remove_leaf(kgfw_bvh_t * bvh, unsigned int leaf);
+static unsigned int bvh_balance(kgfw_bvh_t * bvh, unsigned int a);
+static void bvh_refit(kgfw_bvh_t * bvh, unsigned int node);
+static void bvh_fatten(kgfw_bvh_t * bvh, const kgfw_aabb_t * aabb, kgfw_aabb_t * out_aabb);
+static float bvh_perimeter(const kgfw_aabb_t * aabb);
+
+int kgfw_bvh_init(kgfw_bvh_t * bvh) {
+	memset(bvh, 0, sizeof(kgfw_bvh_t));
+	bvh->root = BVH_NONE;
+	bvh->free_node = BVH_NONE;
+	bvh->margin = 0.1f;
+	kgfw_cull_bounds_init(&bvh->batch);
+	return 0;
+}
+
+void kgfw_bvh_deinit(kgfw_bvh_t * bvh) {
+	free(bvh->nodes);
+	free(bvh->stack);
+	free(bvh->batch_leaves);
+	free(bvh->batch_visible);
+	kgfw_cull_bounds_deinit(&bvh->batch);
+	memset(bvh, 0, sizeof(kgfw_bvh_t));
+	bvh->root = BVH_NONE;
+	bvh->free_node = BVH_NONE;
+}
+
+kgfw_bvh_leaf_t kgfw_bvh_insert(kgfw_bvh_t * bvh, const kgfw_aabb_t * aabb, const kgfw_sphere_t * sphere, void * data) {
+	unsigned int leaf = bvh_node_alloc(bvh);
+	if (leaf == BVH_NONE) {
+		return KGFW_BVH_LEAF_NONE;
+	}
+	/* the leaf's sibling gets a new parent, which has to be allocated up front */
+	unsigned int spare = bvh_node_alloc(bvh);
+	if (spare == BVH_NONE) {
+		bvh_node_free(bvh, leaf);
+		return KGFW_BVH_LEAF_NONE;
+	}
+	bvh_node_free(bvh, spare);
+
+	kgfw_bvh_node_t * node = &bvh->nodes[leaf];
+	bvh_fatten(bvh, aabb, &node->aabb);
+	node->sphere = *sphere;
+	node->data = data;
+	node->left = BVH_NONE;
+	node->right = BVH_NONE;
+	node->height = 0;
+	bvh_insert_leaf(bvh, leaf);
+
+	return leaf;
+}
+
+void kgfw_bvh_remove(kgfw_bvh_t * bvh, kgfw_bvh_leaf_t leaf) {
+	if (leaf >= bvh->count || bvh->nodes[leaf].height != 0) {
+		return;
+	}
+
+	bvh_remove_leaf(bvh, leaf);
+	bvh_node_free(bvh, leaf);
+}
+
+int kgfw_bvh_move(kgfw_bvh_t * bvh, kgfw_bvh_leaf_t leaf, const kgfw_aabb_t * aabb, const kgfw_sphere_t * sphere) {
+	if (leaf >= bvh->count || bvh->nodes[leaf].height != 0) {
+		return 0;
+	}
+
+	bvh->nodes[leaf].sphere = *sphere;
+	if (kgfw_aabb_contains(&bvh->nodes[leaf].aabb, aabb)) {
+		return 0;
+	}
+
+	/* removing frees the old parent, so reinserting never needs to allocate */
+	bvh_remove_leaf(bvh, leaf);
+	bvh_fatten(bvh, aabb, &bvh->nodes[leaf].aabb);
+	bvh_insert_leaf(bvh, leaf);
+	return 1;
+}
+
+void * kgfw_bvh_data(kgfw_bvh_t * bvh, kgfw_bvh_leaf_t leaf) {
+	if (leaf >= bvh->count || bvh->nodes[leaf].height != 0) {
+		return NULL;
+	}
+
+	return bvh->nodes[leaf].data;
+}
+
+void kgfw_bvh_cull(kgfw_bvh_t * bvh, const kgfw_frustum_t * frustum, kgfw_bvh_leaf_f func, void * data) {
+	if (bvh->root == BVH_NONE) {
+		return;
+	}
+
+	kgfw_cull_bounds_clear(&bvh->batch);
+	unsigned long long int top = 0;
+	bvh->stack[top++] = bvh->root;
+	while (top > 0) {
+		unsigned int entry = bvh->stack[--top];
+		unsigned int inside = entry & BVH_INSIDE;
+		kgfw_bvh_node_t * node = &bvh->nodes[entry & ~BVH_INSIDE];
+
+		if (node->height == 0) {
+			if (inside) {
+				func(node->data, data);
+			} else {
+				/* the batch is as big as the tree, it never has to grow here */
+				bvh->batch_leaves[bvh->batch.count] = entry;
+				kgfw_cull_bounds_push(&bvh->batch, &node->aabb);
+			}
+			continue;
+		}
+
+		if (!inside) {
+			kgfw_frustum_result_enum result = kgfw_frustum_test_aabb(frustum, &node->aabb);
+			if (result == KGFW_FRUSTUM_OUTSIDE) {
+				continue;
+			}
+			if (result == KGFW_FRUSTUM_INSIDE) {
+				inside = BVH_INSIDE;
+			}
+		}
+		bvh->stack[top++] = node->left | inside;
+		bvh->stack[top++] = node->right | inside;
+	}
+
+	unsigned long long int visible = kgfw_cull_frustum(frustum, &bvh->batch, bvh->batch_visible);
+	for (unsigned long long int i = 0; i < visible; ++i) {
+		kgfw_bvh_node_t * node = &bvh->nodes[bvh->batch_leaves[bvh->batch_visible[i]]];
+		/* the box was grown by the margin, the sphere is exact */
+		if (kgfw_frustum_test_sphere(frustum, &node->sphere) != KGFW_FRUSTUM_OUTSIDE) {
+			func(node->data, data);
+		}
+	}
+}
+
+static unsigned int bvh_node_alloc(kgfw_bvh_t * bvh) {
+	if (bvh->free_node == BVH_NONE) {
+		unsigned long long int capacity = (bvh->capacity == 0) ? BVH_MIN_CAPACITY : bvh->capacity * 2;
+		/* the top bit of stack entries is taken */
+		if (capacity > BVH_INSIDE) {
+			return BVH_NONE;
+		}
+		kgfw_bvh_node_t * nodes = realloc(bvh->nodes, sizeof(kgfw_bvh_node_t) * capacity);
+		if (nodes == NULL) {
+			return BVH_NONE;
+		}
+		bvh->nodes = nodes;
+		unsigned int * stack = realloc(bvh->stack, sizeof(unsigned int) * capacity);
+		if (stack == NULL) {
+			return BVH_NONE;
+		}
+		bvh->stack = stack;
+		if (kgfw_cull_bounds_reserve(&bvh->batch, capacity) != 0) {
+			return BVH_NONE;
+		}
+		unsigned int * batch_leaves = realloc(bvh->batch_leaves, sizeof(unsigned int) * bvh->batch.capacity);
+		if (batch_leaves == NULL) {
+			return BVH_NONE;
+		}
+		bvh->batch_leaves = batch_leaves;
+		unsigned int * batch_visible = realloc(bvh->batch_visible, sizeof(unsigned int) * bvh->batch.capacity);
+		if (batch_visible == NULL) {
+			return BVH_NONE;
+		}
+		bvh->batch_visible = batch_visible;
+
+		/* the new nodes are chained in order, so the lowest is handed out first */
+		for (unsigned long long int i = capacity; i > bvh->capacity; --i) {
+			bvh->nodes[i - 1].parent = bvh->free_node;
+			bvh->nodes[i - 1].height = -1;
+			bvh->free_node = (unsigned int) (i - 1);
+		}
+		bvh->capacity = capacity;
+	}
+
+	unsigned int node = bvh->free_node;
+	bvh->free_node = bvh->nodes[node].parent;
+	bvh->nodes[node].parent = BVH_NONE;
+	bvh->nodes[node].left = BVH_NONE;
+	bvh->nodes[node].right = BVH_NONE;
+	bvh->nodes[node].data = NULL;
+	bvh->nodes[node].height = 0;
+	if (node >= bvh->count) {
+		bvh->count = node + 1;
+	}
+	return node;
+}
+
+static void bvh_node_free(kgfw_bvh_t * bvh, unsigned int node) {
+	bvh->nodes[node].parent = bvh->free_node;
+	bvh->nodes[node].height = -1;
+	bvh->free_node = node;
+}
+
+static void bvh_insert_leaf(kgfw_bvh_t * bvh, unsigned int leaf) {
+	if (bvh->root == BVH_NONE) {
+		bvh->root = leaf;
+		bvh->nodes[leaf].parent = BVH_NONE;
+		return;
+	}
+
+	/* walks down to the sibling that costs the least surface area */
+	kgfw_aabb_t leaf_aabb = bvh->nodes[leaf].aabb;
+	unsigned int index = bvh->root;
+	while (bvh->nodes[index].height != 0) {
+		kgfw_bvh_node_t * node = &bvh->nodes[index];
+		kgfw_aabb_t combined;
+		kgfw_aabb_union(&node->aabb, &leaf_aabb, &combined);
+		float area = bvh_perimeter(&node->aabb);
+		float combined_area = bvh_perimeter(&combined);
+
+		/* a new parent for this node and the leaf, or pushing the leaf further down which grows this node anyway */
+		float cost = 2.0f * combined_area;
+		float inheritance = 2.0f * (combined_area - area);
+
+		float child_cost[2];
+		unsigned int children[2] = { node->left, node->right };
+		for (unsigned int c = 0; c < 2; ++c) {
+			kgfw_bvh_node_t * child = &bvh->nodes[children[c]];
+			kgfw_aabb_union(&child->aabb, &leaf_aabb, &combined);
+			child_cost[c] = bvh_perimeter(&combined) + inheritance;
+			if (child->height != 0) {
+				child_cost[c] -= bvh_perimeter(&child->aabb);
+			}
+		}
+
+		if (cost < child_cost[0] && cost < child_cost[1]) {
+			break;
+		}
+		index = (child_cost[0] < child_cost[1]) ? children[0] : children[1];
+	}
+
+	unsigned int sibling = index;
+	unsigned int old_parent = bvh->nodes[sibling].parent;
+	unsigned int new_parent = bvh_node_alloc(bvh);
+	kgfw_bvh_node_t * parent = &bvh->nodes[new_parent];
+	parent->parent = old_parent;
+	parent->left = sibling;
+	parent->right = leaf;
+	parent->height = bvh->nodes[sibling].height + 1;
+	kgfw_aabb_union(&bvh->nodes[sibling].aabb, &leaf_aabb, &parent->aabb);
+	bvh->nodes[sibling].parent = new_parent;
+	bvh->nodes[leaf].parent = new_parent;
+
+	if (old_parent == BVH_NONE) {
+		bvh->root = new_parent;
+	}
+	else if (bvh->nodes[old_parent].left == sibling) {
+		bvh->nodes[old_parent].left = new_parent;
+	}
+	else {
+		bvh->nodes[old_parent].right = new_parent;
+	}
+
+	bvh_refit(bvh, bvh->nodes[leaf].parent);
+}
+
+static void bvh_remove_leaf(kgfw_bvh_t * bvh, unsigned int leaf) {
+	if (leaf == bvh->root) {
+		bvh->root = BVH_NONE;
+		return;
+	}
+
+	unsigned int parent = bvh->nodes[leaf].parent;
+	unsigned int grandparent = bvh->nodes[parent].parent;
+	unsigned int sibling = (bvh->nodes[parent].left == leaf) ? bvh->nodes[parent].right : bvh->nodes[parent].left;
+	bvh_node_free(bvh, parent);
+	bvh->nodes[leaf].parent = BVH_NONE;
+
+	bvh->nodes[sibling].parent = grandparent;
+	if (grandparent == BVH_NONE) {
+		bvh->root = sibling;
+		return;
+	}
+
+	if (bvh->nodes[grandparent].left == parent) {
+		bvh->nodes[grandparent].left = sibling;
+	}
+	else {
+		bvh->nodes[grandparent].right = sibling;
+	}
+	bvh_refit(bvh, grandparent);
+}
+
+/* rotates the taller grandchild up if a's children differ in height by more than one, returns the node now in a's place */
+static unsigned int bvh_balance(kgfw_bvh_t * bvh, unsigned int a) {
+	kgfw_bvh_node_t * na = &bvh->nodes[a];
+	if (na->height < 2) {
+		return a;
+	}
+
+	unsigned int b = na->left;
+	unsigned int c = na->right;
+	kgfw_bvh_node_t * nb = &bvh->nodes[b];
+	kgfw_bvh_node_t * nc = &bvh->nodes[c];
+	int balance = nc->height - nb->height;
+
+	if (balance > 1 || balance < -1) {
+		/* up is the taller child, it takes a's place and a takes one of its children */
+		unsigned int up = (balance > 1) ? c : b;
+		unsigned int other = (balance > 1) ? b : c;
+		kgfw_bvh_node_t * nup = &bvh->nodes[up];
+		unsigned int f = nup->left;
+		unsigned int g = nup->right;
+		kgfw_bvh_node_t * nf = &bvh->nodes[f];
+		kgfw_bvh_node_t * ng = &bvh->nodes[g];
+
+		nup->left = a;
+		nup->parent = na->parent;
+		na->parent = up;
+		if (nup->parent == BVH_NONE) {
+			bvh->root = up;
+		}
+		else if (bvh->nodes[nup->parent].left == a) {
+			bvh->nodes[nup->parent].left = up;
+		}
+		else {
+			bvh->nodes[nup->parent].right = up;
+		}
+
+		/* the taller grandchild stays with up */
+		unsigned int keep = (nf->height > ng->height) ? f : g;
+		unsigned int give = (nf->height > ng->height) ? g : f;
+		nup->right = keep;
+		if (balance > 1) {
+			na->right = give;
+		}
+		else {
+			na->left = give;
+		}
+		bvh->nodes[give].parent = a;
+
+		kgfw_bvh_node_t * nother = &bvh->nodes[other];
+		kgfw_bvh_node_t * ngive = &bvh->nodes[give];
+		kgfw_bvh_node_t * nkeep = &bvh->nodes[keep];
+		kgfw_aabb_union(&nother->aabb, &ngive->aabb, &na->aabb);
+		na->height = 1 + ((nother->height > ngive->height) ? nother->height : ngive->height);
+		kgfw_aabb_union(&na->aabb, &nkeep->aabb, &nup->aabb);
+		nup->height = 1 + ((na->height > nkeep->height) ? na->height : nkeep->height);
+		return up;
+	}
+
+	return a;
+}
+
+/* rebalances and recomputes the boxes and heights from node up to the root */
+static void bvh_refit(kgfw_bvh_t * bvh, unsigned int node) {
+	while (node != BVH_NONE) {
+		node = bvh_balance(bvh, node);
+		kgfw_bvh_node_t * n = &bvh->nodes[node];
+		kgfw_bvh_node_t * l = &bvh->nodes[n->left];
+		kgfw_bvh_node_t * r = &bvh->nodes[n->right];
+		n->height = 1 + ((l->height > r->height) ? l->height : r->height);
+		kgfw_aabb_union(&l->aabb, &r->aabb, &n->aabb);
+		node = n->parent;
+	}
+}
+
+static void bvh_fatten(kgfw_bvh_t * bvh, const kgfw_aabb_t * aabb, kgfw_aabb_t * out_aabb) {
+	float size = 0;
+	for (unsigned int i = 0; i < 3; ++i) {
+		float s = aabb->max[i] - aabb->min[i];
+		if (s > size) {
+			size = s;
+		}
+	}
+
+	float margin = size * bvh->margin;
+	for (unsigned int i = 0; i < 3; ++i) {
+		out_aabb->min[i] = aabb->min[i] - margin;
+		out_aabb->max[i] = aabb->max[i] + margin;
+	}
+}
+
+/* half the surface area is enough to compare costs */
+static float bvh_perimeter(const kgfw_aabb_t * aabb) {
+	float x = aabb->max[0] - aabb->min[0];
+	float y = aabb->max[1] - aabb->min[1];
+	float z = aabb->max[2] - aabb->min[2];
+	return x * y + y * z + z * x;
+}
@@ -0,0 +1,64 @@
+#ifndef KRISVERS_KGFW_BVH_H
+#define KRISVERS_KGFW_BVH_H
+
+#include "kgfw_defines.h"
+#include "kgfw_bounds.h"
+#include "kgfw_cull.h"
+
+/* refers to a leaf, stays the same while the leaf exists however the tree is rebalanced */
+typedef unsigned int kgfw_bvh_leaf_t;
+
+#define KGFW_BVH_LEAF_NONE 0xFFFFFFFFu
+
+typedef struct kgfw_bvh_node {
+	/* grown by the tree's margin for leaves, so small moves leave the tree alone */
+	kgfw_aabb_t aabb;
+	/* leaves only, tested after the box before a leaf is reported */
+	kgfw_sphere_t sphere;
+	void * data;
+	/* next free node while the node is free */
+	unsigned int parent;
+	unsigned int left;
+	unsigned int right;
+	/* 0 for leaves, -1 while free */
+	int height;
+} kgfw_bvh_node_t;
+
+/*
+	dynamic bounding volume hierarchy. leaves are inserted where they grow the tree's surface area
+	the least and the tree is kept balanced by rotations on the way back up
+*/
+typedef struct kgfw_bvh {
+	kgfw_bvh_node_t * nodes;
+	unsigned long long int count;
+	unsigned long long int capacity;
+	unsigned int root;
+	unsigned int free_node;
+	/* [capacity] traversal never holds more nodes than the tree has */
+	unsigned int * stack;
+	/* leaves culling reaches without knowing they are inside, tested together once traversal is done */
+	kgfw_cull_bounds_t batch;
+	/* [batch.capacity] the leaf of each batched box and the kernel's output */
+	unsigned int * batch_leaves;
+	unsigned int * batch_visible;
+	/* added to each side of a leaf's box, as a fraction of its largest side */
+	float margin;
+} kgfw_bvh_t;
+
+typedef void (*kgfw_bvh_leaf_f)(void * leaf_data, void * data);
+
+KGFW_PUBLIC int kgfw_bvh_init(kgfw_bvh_t * bvh);
+KGFW_PUBLIC void kgfw_bvh_deinit(kgfw_bvh_t * bvh);
+/* returns KGFW_BVH_LEAF_NONE if the tree could not grow */
+KGFW_PUBLIC kgfw_bvh_leaf_t kgfw_bvh_insert(kgfw_bvh_t * bvh, const kgfw_aabb_t * aabb, const kgfw_sphere_t * sphere, void * data);
+KGFW_PUBLIC void kgfw_bvh_remove(kgfw_bvh_t * bvh, kgfw_bvh_leaf_t leaf);
+/* returns 1 if the leaf left its grown box and was reinserted, 0 if only its bounds were updated */
+KGFW_PUBLIC int kgfw_bvh_move(kgfw_bvh_t * bvh, kgfw_bvh_leaf_t leaf, const kgfw_aabb_t * aabb, const kgfw_sphere_t * sphere);
+KGFW_PUBLIC void * kgfw_bvh_data(kgfw_bvh_t * bvh, kgfw_bvh_leaf_t leaf);
+/*
+	calls func for every leaf inside or intersecting the frustum, subtrees entirely inside are reported without further tests.
+	the remaining leaves' boxes are tested by kgfw_cull_frustum in one batch
+*/
+KGFW_PUBLIC void kgfw_bvh_cull(kgfw_bvh_t * bvh, const kgfw_frustum_t * frustum, kgfw_bvh_leaf_f func, void * data);
+
+#endif
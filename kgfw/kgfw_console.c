@@ -7,6 +7,7 @@
 #include <string.h>
 
 static void console_key_callback(kgfw_input_key_enum key, unsigned char action);
+static void console_key_events(const void * events, unsigned long long int count, void * data);
 static int help_command(int argc, char ** argv);
 
 #define COMMAND_NUM 512
@@ -22,8 +23,10 @@ static char * console_vars[VAR_NUM];
 static unsigned long long int console_vars_length = 0;
 
 int kgfw_console_init(void) {
-	if (kgfw_input_key_register_callback(console_key_callback) != 0) {
-		return 1;
+	if (kgfw_event_subscribe(kgfw_input_key_event_type(), console_key_events, NULL, 0) != 0) {
+		if (kgfw_input_key_register_callback(console_key_callback) != 0) {
+			return 1;
+		}
 	}
 	kgfw_console_register_command("help", help_command);
 
@@ -404,3 +407,10 @@ static int help_command(int argc, char ** argv) {
 
 	return 0;
 }
+
+static void console_key_events(const void * events, unsigned long long int count, void * data) {
+	const kgfw_input_key_event_t * key_events = events;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		console_key_callback(key_events[i].key, key_events[i].action);
+	}
+}
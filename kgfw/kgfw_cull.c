@@ -0,0 +1,196 @@
+#include "kgfw_cull.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_AVX
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULL_SSE
+#endif
+
+#define CULL_MIN_CAPACITY 64
+
+typedef struct cull_plane {
+	/* the component arrays of each box's corner furthest along the plane's normal */
+	const float * x;
+	const float * y;
+	const float * z;
+	float nx;
+	float ny;
+	float nz;
+	float d;
+} cull_plane_t;
+
+static void cull_planes(const kgfw_frustum_t * frustum, const kgfw_cull_bounds_t * bounds, cull_plane_t planes[6]);
+
+int kgfw_cull_bounds_init(kgfw_cull_bounds_t * bounds) {
+	memset(bounds, 0, sizeof(kgfw_cull_bounds_t));
+	return 0;
+}
+
+void kgfw_cull_bounds_deinit(kgfw_cull_bounds_t * bounds) {
+	/* every array lives in the one allocation */
+	free(bounds->min[0]);
+	memset(bounds, 0, sizeof(kgfw_cull_bounds_t));
+}
+
+int kgfw_cull_bounds_reserve(kgfw_cull_bounds_t * bounds, unsigned long long int capacity) {
+	if (capacity <= bounds->capacity) {
+		return 0;
+	}
+	if (capacity < CULL_MIN_CAPACITY) {
+		capacity = CULL_MIN_CAPACITY;
+	}
+	capacity = (capacity + KGFW_CULL_WIDTH - 1) / KGFW_CULL_WIDTH * KGFW_CULL_WIDTH;
+
+	float * block = calloc(capacity * 6, sizeof(float));
+	if (block == NULL) {
+		return 1;
+	}
+	for (unsigned int a = 0; a < 3; ++a) {
+		if (bounds->count > 0) {
+			memcpy(block + capacity * a, bounds->min[a], sizeof(float) * bounds->count);
+			memcpy(block + capacity * (a + 3), bounds->max[a], sizeof(float) * bounds->count);
+		}
+	}
+	free(bounds->min[0]);
+	for (unsigned int a = 0; a < 3; ++a) {
+		bounds->min[a] = block + capacity * a;
+		bounds->max[a] = block + capacity * (a + 3);
+	}
+	bounds->capacity = capacity;
+
+	return 0;
+}
+
+int kgfw_cull_bounds_push(kgfw_cull_bounds_t * bounds, const kgfw_aabb_t * aabb) {
+	if (bounds->count == bounds->capacity) {
+		if (kgfw_cull_bounds_reserve(bounds, (bounds->capacity == 0) ? CULL_MIN_CAPACITY : bounds->capacity * 2) != 0) {
+			return 1;
+		}
+	}
+
+	kgfw_cull_bounds_set(bounds, bounds->count++, aabb);
+	return 0;
+}
+
+void kgfw_cull_bounds_set(kgfw_cull_bounds_t * bounds, unsigned long long int index, const kgfw_aabb_t * aabb) {
+	for (unsigned int a = 0; a < 3; ++a) {
+		bounds->min[a][index] = aabb->min[a];
+		bounds->max[a][index] = aabb->max[a];
+	}
+}
+
+void kgfw_cull_bounds_clear(kgfw_cull_bounds_t * bounds) {
+	bounds->count = 0;
+}
+
+unsigned long long int kgfw_cull_frustum(const kgfw_frustum_t * frustum, const kgfw_cull_bounds_t * bounds, unsigned int * out_visible) {
+#if defined(CULL_AVX) || defined(CULL_SSE)
+	cull_plane_t planes[6];
+	cull_planes(frustum, bounds, planes);
+
+	unsigned long long int visible = 0;
+	for (unsigned long long int i = 0; i < bounds->count; i += KGFW_CULL_WIDTH) {
+		/* lanes past count read the zeroed padding and are masked off below */
+		unsigned int outside = 0;
+#if defined(CULL_AVX)
+		__m256 zero = _mm256_setzero_ps();
+		__m256 out = zero;
+		for (unsigned int p = 0; p < 6; ++p) {
+			__m256 d = _mm256_add_ps(
+				_mm256_add_ps(
+					_mm256_mul_ps(_mm256_loadu_ps(planes[p].x + i), _mm256_set1_ps(planes[p].nx)),
+					_mm256_mul_ps(_mm256_loadu_ps(planes[p].y + i), _mm256_set1_ps(planes[p].ny))
+				),
+				_mm256_add_ps(
+					_mm256_mul_ps(_mm256_loadu_ps(planes[p].z + i), _mm256_set1_ps(planes[p].nz)),
+					_mm256_set1_ps(planes[p].d)
+				)
+			);
+			out = _mm256_or_ps(out, _mm256_cmp_ps(d, zero, _CMP_LT_OQ));
+		}
+		outside = (unsigned int) _mm256_movemask_ps(out);
+#else
+		/* two halves of 4 keep the stride and padding the same as the 8 wide kernel */
+		for (unsigned int h = 0; h < KGFW_CULL_WIDTH; h += 4) {
+			__m128 zero = _mm_setzero_ps();
+			__m128 out = zero;
+			for (unsigned int p = 0; p < 6; ++p) {
+				__m128 d = _mm_add_ps(
+					_mm_add_ps(
+						_mm_mul_ps(_mm_loadu_ps(planes[p].x + i + h), _mm_set1_ps(planes[p].nx)),
+						_mm_mul_ps(_mm_loadu_ps(planes[p].y + i + h), _mm_set1_ps(planes[p].ny))
+					),
+					_mm_add_ps(
+						_mm_mul_ps(_mm_loadu_ps(planes[p].z + i + h), _mm_set1_ps(planes[p].nz)),
+						_mm_set1_ps(planes[p].d)
+					)
+				);
+				out = _mm_or_ps(out, _mm_cmplt_ps(d, zero));
+			}
+			outside |= (unsigned int) _mm_movemask_ps(out) << h;
+		}
+#endif
+
+		unsigned int mask = ~outside & 0xFFu;
+		if (bounds->count - i < KGFW_CULL_WIDTH) {
+			mask &= (1u << (bounds->count - i)) - 1;
+		}
+		/* every lane is written, only visible ones advance. stays within capacity */
+		for (unsigned int lane = 0; lane < KGFW_CULL_WIDTH; ++lane) {
+			out_visible[visible] = (unsigned int) (i + lane);
+			visible += (mask >> lane) & 1;
+		}
+	}
+
+	return visible;
+#else
+	return kgfw_cull_frustum_scalar(frustum, bounds, out_visible);
+#endif
+}
+
+unsigned long long int kgfw_cull_frustum_scalar(const kgfw_frustum_t * frustum, const kgfw_cull_bounds_t * bounds, unsigned int * out_visible) {
+	cull_plane_t planes[6];
+	cull_planes(frustum, bounds, planes);
+
+	unsigned long long int visible = 0;
+	for (unsigned long long int i = 0; i < bounds->count; ++i) {
+		unsigned int outside = 0;
+		for (unsigned int p = 0; p < 6; ++p) {
+			/* same order of operations as the vector kernels */
+			float d = (planes[p].x[i] * planes[p].nx + planes[p].y[i] * planes[p].ny) + (planes[p].z[i] * planes[p].nz + planes[p].d);
+			outside |= (d < 0);
+		}
+		out_visible[visible] = (unsigned int) i;
+		visible += !outside;
+	}
+
+	return visible;
+}
+
+const char * kgfw_cull_kernel(void) {
+#if defined(CULL_AVX)
+	return "avx";
+#elif defined(CULL_SSE)
+	return "sse";
+#else
+	return "scalar";
+#endif
+}
+
+static void cull_planes(const kgfw_frustum_t * frustum, const kgfw_cull_bounds_t * bounds, cull_plane_t planes[6]) {
+	for (unsigned int p = 0; p < 6; ++p) {
+		const float * plane = frustum->planes[p];
+		/* a box is outside if even its corner furthest along the normal is behind the plane */
+		planes[p].x = (plane[0] >= 0) ? bounds->max[0] : bounds->min[0];
+		planes[p].y = (plane[1] >= 0) ? bounds->max[1] : bounds->min[1];
+		planes[p].z = (plane[2] >= 0) ? bounds->max[2] : bounds->min[2];
+		planes[p].nx = plane[0];
+		planes[p].ny = plane[1];
+		planes[p].nz = plane[2];
+		planes[p].d = plane[3];
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef KRISVERS_KGFW_CULL_H
+#define KRISVERS_KGFW_CULL_H
+
+#include "kgfw_defines.h"
+#include "kgfw_bounds.h"
+
+/* boxes tested per step by the widest kernel, capacities are kept a multiple of it */
+#define KGFW_CULL_WIDTH 8
+
+/*
+	axis aligned boxes stored one array per component, so the culling kernels load the same
+	component of several boxes at once
+*/
+typedef struct kgfw_cull_bounds {
+	/* [capacity] each, entries past count are zeroed padding */
+	float * min[3];
+	float * max[3];
+	unsigned long long int count;
+	unsigned long long int capacity;
+} kgfw_cull_bounds_t;
+
+KGFW_PUBLIC int kgfw_cull_bounds_init(kgfw_cull_bounds_t * bounds);
+KGFW_PUBLIC void kgfw_cull_bounds_deinit(kgfw_cull_bounds_t * bounds);
+/* returns non-zero if the arrays could not grow, the bounds are left as they were */
+KGFW_PUBLIC int kgfw_cull_bounds_reserve(kgfw_cull_bounds_t * bounds, unsigned long long int capacity);
+/* returns non-zero if the arrays could not grow */
+KGFW_PUBLIC int kgfw_cull_bounds_push(kgfw_cull_bounds_t * bounds, const kgfw_aabb_t * aabb);
+KGFW_PUBLIC void kgfw_cull_bounds_set(kgfw_cull_bounds_t * bounds, unsigned long long int index, const kgfw_aabb_t * aabb);
+KGFW_PUBLIC void kgfw_cull_bounds_clear(kgfw_cull_bounds_t * bounds);
+
+/*
+	writes the index of every box not entirely outside the frustum to out_visible in ascending order and
+	returns how many there are. out_visible must have room for bounds->capacity indices.
+	tests KGFW_CULL_WIDTH boxes at a time with AVX or 4 with SSE when the compiler targets them
+*/
+KGFW_PUBLIC unsigned long long int kgfw_cull_frustum(const kgfw_frustum_t * frustum, const kgfw_cull_bounds_t * bounds, unsigned int * out_visible);
+/* same results one box at a time, for platforms without either */
+KGFW_PUBLIC unsigned long long int kgfw_cull_frustum_scalar(const kgfw_frustum_t * frustum, const kgfw_cull_bounds_t * bounds, unsigned int * out_visible);
+/* "avx", "sse" or "scalar", whichever kgfw_cull_frustum uses */
+KGFW_PUBLIC const char * kgfw_cull_kernel(void);
+
+#endif
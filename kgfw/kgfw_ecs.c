@@ -1,16 +1,65 @@
 #include "kgfw_ecs.h"
 #include "kgfw_hash.h"
 #include "kgfw_log.h"
+#include "kgfw_jobs.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-typedef struct entity_node {
+/*
+	entities live in a slot map made of fixed-size pages that never move, so entity pointers stay
+	valid while the entity is alive. destroying an entity bumps the generation of its slot and
+	pushes the slot onto a free list to be reused by the next kgfw_entity_new
+*/
+#define ENTITY_NAME_INLINE 32
+
+typedef struct entity_slot {
 	kgfw_entity_t entity;
 	kgfw_hash_t hash;
-	struct entity_node * next;
-} entity_node_t;
+	unsigned int generation;
+	unsigned int next_free;
+	unsigned char alive;
+	/* KGFW_TRANSFORM_NODE_NONE until the entity is first parented */
+	kgfw_transform_node_t transform_node;
+	/* short names (including the generated ones) live here instead of on the heap */
+	char name[ENTITY_NAME_INLINE];
+} entity_slot_t;
+
+#define ENTITY_PAGE_SIZE 1024
+#define ENTITY_SLOT_NONE 0xFFFFFFFFu
+
+/*
+	open addressing (linear probing) index from a 64-bit key to an entity.
+	keys are either the entity id or the hash of its name, lookups verify the full key
+*/
+typedef struct entity_index {
+	kgfw_hash_t * keys;
+	kgfw_entity_t ** entities;
+	/* power of two */
+	unsigned long long int capacity;
+	unsigned long long int count;
+} entity_index_t;
+
+#define ENTITY_INDEX_MIN_CAPACITY 64
+
+/*
+	open addressing index from a uuid or name hash to a dense type/system index.
+	entries are never removed, name lookups verify the full name.
+	only the first type registered under a name is indexed by it
+*/
+typedef struct registry_index {
+	kgfw_hash_t * keys;
+	/* REGISTRY_INDEX_EMPTY for unused slots */
+	unsigned long long int * values;
+	/* power of two */
+	unsigned long long int capacity;
+	unsigned long long int count;
+} registry_index_t;
+
+#define REGISTRY_INDEX_EMPTY 0xFFFFFFFFFFFFFFFFull
+#define REGISTRY_INDEX_MIN_CAPACITY 32
 
+/* dense registry, a type is referred to internally by its index into these arrays */
 typedef struct component_types {
 	kgfw_uuid_t * type_ids;
 	kgfw_uuid_t * system_ids;
@@ -19,13 +68,76 @@ typedef struct component_types {
 	const char ** names;
 	kgfw_hash_t * hashes;
 	unsigned long long int count;
+	registry_index_t by_id;
+	registry_index_t by_name;
 } component_types_t;
 
-typedef struct component_node {
-	kgfw_component_t * component;
-	struct component_node * next;
-	unsigned long long int type_index;
-} component_node_t;
+/*
+	archetype storage, every entity with the same set of component types shares an archetype.
+	an archetype owns fixed-size chunks laid out column-major:
+
+	[chunk_t][chunk tick per type][entity column][node column per type...][component column per type...][tick column per type...]
+
+	a row's tick is the ECS tick its component was last marked changed (or added) at,
+	a chunk tick is the newest row tick of that column so whole chunks can be skipped
+
+	rows are kept dense by moving the last row into the hole left by a removed row
+*/
+typedef struct chunk {
+	unsigned long long int count;
+	unsigned long long int size;
+} chunk_t;
+
+/* cached results of archetype_step for one component type */
+typedef struct archetype_edge {
+	struct archetype * add;
+	struct archetype * remove;
+} archetype_edge_t;
+
+typedef struct archetype {
+	/* sorted component type indices */
+	unsigned long long int * types;
+	/* byte offsets of the node, component and tick columns of each type inside of a chunk */
+	unsigned long long int * node_offsets;
+	unsigned long long int * offsets;
+	unsigned long long int * ticks_offsets;
+	unsigned long long int types_count;
+	unsigned long long int chunk_ticks_offset;
+	unsigned long long int entities_offset;
+	/* rows per chunk */
+	unsigned long long int capacity;
+	unsigned long long int chunk_size;
+
+	chunk_t ** chunks;
+	unsigned long long int chunks_count;
+	unsigned long long int chunks_capacity;
+	/* rows in use */
+	unsigned long long int count;
+	/* indexed by type index, grown on demand */
+	archetype_edge_t * edges;
+	unsigned long long int edges_count;
+	struct archetype * next;
+} archetype_t;
+
+#define ECS_CHUNK_SIZE (16 * 1024)
+#define ECS_ALIGN 16
+#define ECS_ALIGN_UP(x) (((x) + (ECS_ALIGN - 1)) & ~((unsigned long long int) ECS_ALIGN - 1))
+
+/* empty ECS_CHUNK_SIZE block in the chunk pool, the link is stored in the block itself */
+typedef struct chunk_block {
+	struct chunk_block * next;
+} chunk_block_t;
+
+/* spans of one kgfw_ecs_each_parallel call, kept on the stack unless there are many chunks */
+typedef struct span_batch {
+	kgfw_component_span_t * spans;
+	kgfw_component_span_f func;
+	void * data;
+} span_batch_t;
+
+#define ECS_SPANS_STACK 64
+/* handles of one kgfw_entity_instantiate call kept on the stack, covers kgfw_entity_copy */
+#define ECS_INSTANTIATE_STACK 16
 
 typedef struct systems {
 	kgfw_uuid_t * ids;
@@ -33,21 +145,156 @@ typedef struct systems {
 	unsigned long long int * sizes;
 	const char ** names;
 	kgfw_hash_t * hashes;
+	/* copies of the declared accesses, only valid where declared[i] is set */
+	kgfw_system_access_t * accesses;
+	unsigned char * declared;
+	/* type indices bound to each system, in registration order */
+	unsigned long long int ** bound;
+	unsigned long long int * bound_counts;
 	unsigned long long int count;
+	registry_index_t by_id;
 } systems_t;
 
+/*
+	deferred structural changes. every kgfw_jobs thread records into its own buffer so recording
+	needs no locks, the buffers are merged and sorted at playback
+*/
+typedef enum ecs_command_kind {
+	ECS_COMMAND_SPAWN = 0,
+	ECS_COMMAND_ATTACH,
+	ECS_COMMAND_DETACH,
+	ECS_COMMAND_DESTROY,
+} ecs_command_kind_enum;
+
+typedef struct ecs_command {
+	ecs_command_kind_enum kind;
+	unsigned int buffer;
+	/* position in the buffer, keeps playback stable */
+	unsigned long long int sequence;
+	kgfw_entity_handle_t entity;
+	unsigned long long int type_index;
+	/* offset of the name or component data in the buffer's bytes, ECS_COMMAND_NO_DATA if none */
+	unsigned long long int data;
+} ecs_command_t;
+
+#define ECS_COMMAND_NO_DATA 0xFFFFFFFFFFFFFFFFull
+/* commands recorded while playing back are played back too, up to this many rounds */
+#define ECS_COMMAND_ROUNDS 8
+
+typedef struct ecs_commands {
+	ecs_command_t * commands;
+	unsigned long long int count;
+	unsigned long long int capacity;
+	unsigned char * bytes;
+	unsigned long long int bytes_size;
+	unsigned long long int bytes_capacity;
+	/* handles of the entities made by this buffer's spawn commands, filled in at playback */
+	kgfw_entity_handle_t * spawned;
+	unsigned long long int spawned_count;
+	unsigned long long int spawned_capacity;
+} ecs_commands_t;
+
+/*
+	deferred spawn handles have a generation of 0, which no live entity has.
+	the low 32 bits are the buffer in the top 8 bits and the spawn number + 1 below
+*/
+#define ECS_DEFERRED_SPAWN_MAX 0xFFFFFF
+#define ECS_DEFERRED_BUFFERS_MAX 0xFF
+
+/*
+	snapshot layout, native byte order with every field padded to 8 bytes:
+
+	header: magic, version, types count, records count, entities count
+	per component type: size, name length, name
+	per record (the entities of one archetype): types count, entities count, snapshot type indices,
+		per entity id, transform, name length, name, then one column of raw component bytes per type
+*/
+#define ECS_SNAPSHOT_MAGIC 0x315343455746474Bull /* "KGFWECS1" */
+#define ECS_SNAPSHOT_VERSION 1
+#define ECS_SNAPSHOT_ALIGN_UP(x) (((x) + 7) & ~7ull)
+
+typedef enum system_access {
+	SYSTEM_ACCESS_NONE = 0,
+	SYSTEM_ACCESS_READ,
+	SYSTEM_ACCESS_WRITE,
+} system_access_enum;
+
 struct {
-	entity_node_t * entities;
+	struct {
+		entity_slot_t ** pages;
+		unsigned long long int pages_count;
+		/* slots handed out so far */
+		unsigned int count;
+		unsigned int free;
+	} entities;
+	entity_index_t entities_by_id;
+	entity_index_t entities_by_name;
 	/*
 		array of linked-lists with [component_types.count] elements
-		one element = one linked-list of instances of the same type of component
+		one element = one linked-list of instances of the same type of component.
+		the nodes live inside of the archetype chunks and are relinked lazily when dirty
+	*/
+	kgfw_component_node_t ** components;
+	unsigned char * components_dirty;
+	archetype_t * archetypes;
+	/*
+		chunks that emptied out are kept for reuse by any archetype, so spawning and destroying
+		entities at a steady rate does not touch malloc. oversized chunks are never pooled
 	*/
-	component_node_t ** components;
+	struct {
+		chunk_block_t * free;
+		unsigned long long int count;
+	} chunk_pool;
 	component_types_t component_types;
 	systems_t systems;
+
+	/*
+		systems grouped into levels, a system only conflicts with systems of other levels
+		so every level can be updated in parallel. rebuilt when systems or types are added
+	*/
+	struct {
+		/* system indices sorted by level */
+		unsigned long long int * order;
+		/* [levels_count + 1] offsets into order */
+		unsigned long long int * levels;
+		unsigned long long int levels_count;
+		/* [systems count], one job per system in order */
+		kgfw_job_t * jobs;
+		unsigned char dirty;
+	} schedule;
+
+	struct {
+		/* [count], indexed by kgfw_jobs_thread_index */
+		ecs_commands_t * recording;
+		/* [count], swapped with recording for playback so playback can record more commands */
+		ecs_commands_t * playing;
+		unsigned long long int count;
+		ecs_command_t ** sorted;
+		unsigned long long int sorted_capacity;
+		unsigned char flushing;
+	} commands;
+
+	/*
+		advanced after every schedule level before deferred commands are played back,
+		a change is visible to a system if it happened at or after the system's last_tick
+	*/
+	unsigned long long int tick;
+	/*
+		set while systems are updating, structural changes are deferred meanwhile since the
+		systems are walking component lists whose nodes live in the rows being moved
+	*/
+	unsigned char updating;
+
+	/* world matrices of parented entities, updated at the end of kgfw_ecs_update */
+	kgfw_transform_hierarchy_t transforms;
 } static state = {
+	{ NULL, 0, 0, ENTITY_SLOT_NONE },
+	{ NULL, NULL, 0, 0 },
+	{ NULL, NULL, 0, 0 },
 	NULL,
 	NULL,
+	NULL,
+	{ NULL, 0 },
 	{
 		NULL,
 		NULL,
@@ -69,6 +316,69 @@ struct {
 /* default system */
 static int default_system_construct(const char * name, unsigned long long int system_size, void * system_data);
 
+static kgfw_entity_t * entity_spawn(const char * name, kgfw_uuid_t id);
+static void entities_start(archetype_t * archetype, const kgfw_entity_handle_t * handles, unsigned long long int count);
+static kgfw_transform_node_t entity_transform_node(kgfw_entity_t * entity);
+static entity_slot_t * entity_slot(unsigned int index);
+static long long int entity_slot_alloc(void);
+static void entity_slot_release(unsigned int index);
+static unsigned long long int hash_mix(kgfw_hash_t key);
+static void entity_name_free(entity_slot_t * slot);
+static int entity_index_reserve(entity_index_t * index, unsigned long long int count);
+static int entity_index_insert(entity_index_t * index, kgfw_hash_t key, kgfw_entity_t * entity);
+static void entity_index_remove(entity_index_t * index, kgfw_hash_t key, kgfw_entity_t * entity);
+static kgfw_entity_t * entity_index_find(entity_index_t * index, kgfw_hash_t key, const char * name);
+static void entity_index_free(entity_index_t * index);
+static long long int component_type_index(kgfw_uuid_t type_id);
+static int registry_index_insert(registry_index_t * index, kgfw_hash_t key, unsigned long long int value);
+static long long int registry_index_find(registry_index_t * index, kgfw_hash_t key, const char ** names, const char * name);
+static void registry_index_free(registry_index_t * index);
+static int system_register(kgfw_uuid_t id);
+static int system_bind(unsigned long long int type_index);
+static int system_access_set(unsigned long long int system, const kgfw_system_access_t * access);
+static void system_update(unsigned long long int system);
+static int schedule_build(void);
+static void system_job(void * data);
+static kgfw_component_t * entity_attach(kgfw_entity_t * entity, unsigned long long int index, const void * data);
+static int commands_init(void);
+static void commands_free(void);
+static ecs_commands_t * commands_local(void);
+static ecs_command_t * commands_push(ecs_commands_t * buffer, ecs_command_kind_enum kind, kgfw_entity_handle_t entity, unsigned long long int type_index, const void * data, unsigned long long int size);
+static kgfw_entity_t * commands_resolve(kgfw_entity_handle_t handle);
+static unsigned int commands_rank(ecs_command_kind_enum kind);
+static int commands_compare(const void * a, const void * b);
+static void commands_play(ecs_command_t * command);
+static void snapshot_write_bytes(char * buffer, unsigned long long int * offset, const void * data, unsigned long long int size);
+static void snapshot_write_pad(char * buffer, unsigned long long int * offset);
+static void snapshot_write_ull(char * buffer, unsigned long long int * offset, unsigned long long int value);
+static void snapshot_write_name(char * buffer, unsigned long long int * offset, const char * name);
+static void snapshot_write_entity(char * buffer, unsigned long long int * offset, kgfw_entity_t * entity);
+static unsigned long long int snapshot_write(char * buffer);
+static const char * snapshot_read_bytes(const char * buffer, unsigned long long int size, unsigned long long int * offset, unsigned long long int bytes);
+static int snapshot_read(const char * buffer, unsigned long long int size, unsigned long long int * offset, unsigned long long int * value);
+static int snapshot_read_name(const char * buffer, unsigned long long int size, unsigned long long int * offset, const char ** name);
+static int snapshot_record(const char * buffer, unsigned long long int size, unsigned long long int * offset, const unsigned long long int * types, unsigned long long int types_count, unsigned long long int * sorted);
+static unsigned long long int snapshot_record_type(const char * record_types, unsigned long long int i);
+static long long int component_column(kgfw_component_t * component);
+static unsigned long long int component_spans(unsigned long long int type_index, unsigned long long int since, kgfw_component_span_t * spans, unsigned long long int capacity);
+static unsigned char span_fill(kgfw_component_span_t * span, archetype_t * archetype, unsigned long long int column, unsigned long long int chunk, unsigned long long int since);
+static void span_batch_range(unsigned long long int begin, unsigned long long int end, void * data);
+static void components_link(unsigned long long int type_index);
+static int archetype_step(archetype_t * source, unsigned long long int type_index, unsigned char add, archetype_t ** out_archetype);
+static long long int archetype_column(archetype_t * archetype, unsigned long long int type_index);
+static kgfw_component_t * archetype_component(archetype_t * archetype, unsigned long long int column, unsigned long long int row);
+static kgfw_entity_t ** archetype_entity(archetype_t * archetype, unsigned long long int row);
+static unsigned long long int * archetype_tick(archetype_t * archetype, unsigned long long int column, unsigned long long int row);
+static unsigned long long int * archetype_chunk_tick(archetype_t * archetype, unsigned long long int column, unsigned long long int row);
+static void archetype_touch(archetype_t * archetype, unsigned long long int column, unsigned long long int row, unsigned long long int tick);
+static int archetype_reserve(archetype_t * archetype, unsigned long long int rows);
+static void archetype_trim(archetype_t * archetype);
+static void archetype_remove(archetype_t * archetype, unsigned long long int row);
+static void archetypes_free(void);
+static void chunk_release(chunk_t * chunk);
+static void chunk_pool_free(void);
+static int entity_move(kgfw_entity_t * entity, archetype_t * archetype);
+
 static void default_system_update(struct kgfw_system * self, kgfw_component_node_t * components) {
 	for (kgfw_component_node_t * n = components; n != NULL; n = n->next) {
 		n->component->update(n->component);
@@ -96,29 +406,57 @@ int kgfw_ecs_init(void) {
 	default_system->start = &default_system_start;
 	default_system->destroy = &default_system_destroy;
 
-	if (default_system_construct("default", sizeof(kgfw_system_t), default_system) != 0) {
-		free(default_system);
+	/* the ECS system keeps its own copy */
+	int result = default_system_construct("default", sizeof(kgfw_system_t), default_system);
+	free(default_system);
+	if (result != 0) {
 		return 2;
 	}
 
+	if (commands_init() != 0) {
+		return 3;
+	}
+
+	if (kgfw_transform_hierarchy_init(&state.transforms) != 0) {
+		return 4;
+	}
+
+	state.tick = 1;
+
 	return 0;
 }
 
 void kgfw_ecs_deinit(void) {
-	for (unsigned long long int i = 0; i < state.component_types.count; ++i) {
-		component_node_t * prev = state.components[i];
-		while (state.components[i] != NULL) {
-			kgfw_component_destroy(state.components[i]->component);
-			if (state.components[i] == prev) {
-				kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs component deinitialization failed, skipping");
-				break;
-			}
-			prev = state.components[i];
+	for (unsigned int i = 0; i < state.entities.count; ++i) {
+		entity_slot_t * slot = entity_slot(i);
+		if (slot->alive) {
+			kgfw_entity_destroy(&slot->entity);
 		}
 	}
+	for (unsigned long long int i = 0; i < state.entities.pages_count; ++i) {
+		free(state.entities.pages[i]);
+	}
+	if (state.entities.pages != NULL) {
+		free(state.entities.pages);
+	}
+	state.entities.pages = NULL;
+	state.entities.pages_count = 0;
+	state.entities.count = 0;
+	state.entities.free = ENTITY_SLOT_NONE;
 
-	while (state.entities != NULL) {
-		kgfw_entity_destroy((kgfw_entity_t *) state.entities);
+	entity_index_free(&state.entities_by_id);
+	entity_index_free(&state.entities_by_name);
+	kgfw_transform_hierarchy_deinit(&state.transforms);
+	commands_free();
+	archetypes_free();
+	chunk_pool_free();
+	if (state.components != NULL) {
+		free(state.components);
+		state.components = NULL;
+	}
+	if (state.components_dirty != NULL) {
+		free(state.components_dirty);
+		state.components_dirty = NULL;
 	}
 
 	if (state.component_types.type_ids != NULL) {
@@ -142,7 +480,12 @@ void kgfw_ecs_deinit(void) {
 		}
 		free(state.component_types.names);
 	}
-	state.component_types.count = 0;
+	if (state.component_types.hashes != NULL) {
+		free(state.component_types.hashes);
+	}
+	registry_index_free(&state.component_types.by_id);
+	registry_index_free(&state.component_types.by_name);
+	memset(&state.component_types, 0, sizeof(component_types_t));
 
 	for (unsigned long long int i = 0; i < state.systems.count; ++i) {
 		state.systems.datas[i]->destroy(state.systems.datas[i]);
@@ -166,98 +509,186 @@ void kgfw_ecs_deinit(void) {
 		}
 		free(state.systems.names);
 	}
-	state.systems.count = 0;
+	if (state.systems.accesses != NULL) {
+		for (unsigned long long int i = 0; i < state.systems.count; ++i) {
+			if (state.systems.declared[i]) {
+				free((void *) state.systems.accesses[i].reads);
+			}
+		}
+		free(state.systems.accesses);
+		state.systems.accesses = NULL;
+	}
+	if (state.systems.declared != NULL) {
+		free(state.systems.declared);
+		state.systems.declared = NULL;
+	}
+	if (state.systems.hashes != NULL) {
+		free(state.systems.hashes);
+	}
+	if (state.systems.bound != NULL) {
+		for (unsigned long long int i = 0; i < state.systems.count; ++i) {
+			if (state.systems.bound[i] != NULL) {
+				free(state.systems.bound[i]);
+			}
+		}
+		free(state.systems.bound);
+	}
+	if (state.systems.bound_counts != NULL) {
+		free(state.systems.bound_counts);
+	}
+	registry_index_free(&state.systems.by_id);
+	memset(&state.systems, 0, sizeof(systems_t));
+
+	if (state.schedule.order != NULL) {
+		free(state.schedule.order);
+		state.schedule.order = NULL;
+	}
+	if (state.schedule.levels != NULL) {
+		free(state.schedule.levels);
+		state.schedule.levels = NULL;
+	}
+	if (state.schedule.jobs != NULL) {
+		free(state.schedule.jobs);
+		state.schedule.jobs = NULL;
+	}
+	state.schedule.levels_count = 0;
 }
 
 void kgfw_ecs_update(void) {
-	for (unsigned long long int i = 0; i < state.systems.count; ++i) {
-		unsigned long long int comp_index = 0;
+	if (state.schedule.dirty) {
+		if (schedule_build() != 0) {
+			kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs system schedule build failed, updating systems serially");
+			for (unsigned long long int i = 0; i < state.systems.count; ++i) {
+				for (unsigned long long int j = 0; j < state.component_types.count; ++j) {
+					if (state.components_dirty[j]) {
+						components_link(j);
+					}
+				}
+				state.updating = 1;
+				system_update(i);
+				state.updating = 0;
+				++state.tick;
+				kgfw_ecs_commands_flush();
+			}
+			kgfw_transform_hierarchy_update(&state.transforms);
+			return;
+		}
+	}
+
+	for (unsigned long long int l = 0; l < state.schedule.levels_count; ++l) {
+		/* lists are relinked here so parallel systems only ever read them */
 		for (unsigned long long int j = 0; j < state.component_types.count; ++j) {
-			if (state.component_types.system_ids[j] == state.systems.ids[i]) {
-				state.systems.datas[i]->update(state.systems.datas[i], (kgfw_component_node_t *) state.components[j]);
-				break;
+			if (state.components_dirty[j]) {
+				components_link(j);
+			}
+		}
+
+		unsigned long long int begin = state.schedule.levels[l];
+		unsigned long long int count = state.schedule.levels[l + 1] - begin;
+		state.updating = 1;
+		if (count == 1 || kgfw_jobs_worker_count() == 0) {
+			for (unsigned long long int i = 0; i < count; ++i) {
+				system_update(state.schedule.order[begin + i]);
 			}
+		} else {
+			kgfw_job_counter_t counter = { 0 };
+			kgfw_jobs_run(&state.schedule.jobs[begin], count, &counter);
+			kgfw_jobs_wait(&counter);
 		}
+		state.updating = 0;
+
+		/* every level is a sync point */
+		++state.tick;
+		kgfw_ecs_commands_flush();
 	}
+
+	kgfw_transform_hierarchy_update(&state.transforms);
+}
+
+unsigned long long int kgfw_ecs_tick(void) {
+	return state.tick;
 }
 
 kgfw_entity_t * kgfw_entity_new(const char * name) {
+	return entity_spawn(name, KGFW_ECS_INVALID_ID);
+}
+
+kgfw_entity_t * kgfw_entity_copy(const char * name, kgfw_entity_t * source) {
 	kgfw_entity_t * e = NULL;
-	entity_node_t * node = malloc(sizeof(entity_node_t));
-	if (node == NULL) {
+	if (kgfw_entity_instantiate(source, name, 1, &e) != 1) {
 		return NULL;
 	}
 
-	memset(node, 0, sizeof(entity_node_t));
+	return e;
+}
 
-	if (state.entities == NULL) {
-		state.entities = node;
-	} else {
-		node->next = state.entities;
-		state.entities = node;
+unsigned long long int kgfw_entity_instantiate(kgfw_entity_t * prefab, const char * name, unsigned long long int count, kgfw_entity_t ** entities) {
+	if (prefab == NULL || count == 0) {
+		return 0;
 	}
 
-	e = &node->entity;
-	if (e == NULL) {
-		free(node);
-		return NULL;
+	kgfw_entity_handle_t stack_handles[ECS_INSTANTIATE_STACK];
+	kgfw_entity_handle_t * handles = stack_handles;
+	if (count > ECS_INSTANTIATE_STACK) {
+		handles = malloc(sizeof(kgfw_entity_handle_t) * count);
+		if (handles == NULL) {
+			return 0;
+		}
 	}
 
-	memset(e, 0, sizeof(kgfw_entity_t));
-
-	e->id = kgfw_uuid_gen();
-
-	if (name == NULL) {
-		unsigned long long int len = snprintf(NULL, 0, "Entity 0x%llx", e->id);
-		if (len < 0) {
-			free(node);
-			return NULL;
+	/* the whole batch is allocated up front so its rows end up back to back */
+	archetype_t * archetype = prefab->components.archetype;
+	if (entity_index_reserve(&state.entities_by_id, state.entities_by_id.count + count) != 0 || entity_index_reserve(&state.entities_by_name, state.entities_by_name.count + count) != 0 || (archetype != NULL && archetype_reserve(archetype, count) != 0)) {
+		if (handles != stack_handles) {
+			free(handles);
 		}
+		return 0;
+	}
 
-		e->name = malloc(sizeof(char) * (len + 1));
-		if (e->name == NULL) {
-			free(node);
-			return NULL;
+	unsigned long long int spawned = 0;
+	unsigned long long int begin = (archetype == NULL) ? 0 : archetype->count;
+	for (; spawned < count; ++spawned) {
+		kgfw_entity_t * e = kgfw_entity_new(name);
+		if (e == NULL) {
+			break;
 		}
-		sprintf((char *) e->name, "Entity 0x%llx", e->id);
-		((char *) e->name)[len] = '\0';
-	} else {
-		unsigned long long int len = strlen(name);
-		e->name = malloc(sizeof(char) * (len + 1));
-		if (e->name == NULL) {
-			free(node);
-			return NULL;
+
+		memcpy(&e->transform, &prefab->transform, sizeof(kgfw_transform_t));
+		if (archetype != NULL && entity_move(e, archetype) != 0) {
+			kgfw_entity_destroy(e);
+			break;
 		}
-		strncpy((char *) e->name, name, len);
-		((char *) e->name)[len] = '\0';
+		handles[spawned] = e->handle;
 	}
 
-	node->hash = kgfw_hash(e->name);
+	if (archetype != NULL) {
+		archetype_trim(archetype);
 
-	kgfw_transform_identity(&e->transform);
-	return e;
-}
+		/* clones get their own copy of every component, filled one column at a time */
+		for (unsigned long long int i = 0; i < archetype->types_count; ++i) {
+			unsigned long long int size = state.component_types.sizes[archetype->types[i]];
+			kgfw_component_t * source = archetype_component(archetype, i, prefab->components.row);
+			for (unsigned long long int row = begin; row < begin + spawned; ++row) {
+				kgfw_component_t * c = archetype_component(archetype, i, row);
+				memcpy(c, source, size);
+				c->instance_id = kgfw_uuid_gen();
+				c->entity = *archetype_entity(archetype, row);
+			}
+		}
 
-kgfw_entity_t * kgfw_entity_copy(const char * name, kgfw_entity_t * source) {
-	kgfw_entity_t * e = kgfw_entity_new(name);
-	if (e == NULL) {
-		 return NULL;
+		entities_start(archetype, handles, spawned);
 	}
 
-	memcpy(&e->transform, &source->transform, sizeof(kgfw_transform_t));
-
-	e->components.count = source->components.count;
-	if (e->components.count != 0) {
-		e->components.handles = malloc(sizeof(kgfw_component_t *) * e->components.count);
-		if (e->components.handles == NULL) {
-			free((void *) e->name);
-			free(e);
-			return NULL;
+	if (entities != NULL) {
+		for (unsigned long long int j = 0; j < spawned; ++j) {
+			entities[j] = kgfw_entity_resolve(handles[j]);
 		}
+	}
 
-		memcpy(e->components.handles, source->components.handles, sizeof(kgfw_component_t *) * e->components.count);
+	if (handles != stack_handles) {
+		free(handles);
 	}
-	return e;
+	return spawned;
 }
 
 void kgfw_entity_destroy(kgfw_entity_t * entity) {
@@ -265,68 +696,158 @@ void kgfw_entity_destroy(kgfw_entity_t * entity) {
 		return;
 	}
 
-	entity_node_t * node = (entity_node_t *) entity;
-	if (node->next == NULL) {
-		if (state.entities == node) {
-			state.entities = NULL;
+	/* ignore entities that were already destroyed */
+	if (kgfw_entity_resolve(entity->handle) != entity) {
+		return;
+	}
+
+	if (state.updating) {
+		if (kgfw_ecs_defer_destroy(entity->handle) != 0) {
+			kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs entity destruction during update could not be deferred for entity \"%s\"", entity->name);
 		}
-	} else {
-		if (state.entities == node) {
-			state.entities = node->next;
+		return;
+	}
+
+	archetype_t * archetype = entity->components.archetype;
+	if (archetype != NULL) {
+		for (unsigned long long int i = 0; i < archetype->types_count; ++i) {
+			kgfw_component_t * c = archetype_component(archetype, i, entity->components.row);
+			c->destroy(c);
 		}
+		archetype_remove(archetype, entity->components.row);
 	}
 
-	if (node->entity.components.handles != NULL) {
-		free(node->entity.components.handles);
+	entity_slot_t * slot = entity_slot((unsigned int) (entity->handle & 0xFFFFFFFF));
+	if (slot->transform_node != KGFW_TRANSFORM_NODE_NONE) {
+		kgfw_transform_hierarchy_remove(&state.transforms, slot->transform_node);
+		slot->transform_node = KGFW_TRANSFORM_NODE_NONE;
 	}
-	free(node);
+	entity_index_remove(&state.entities_by_id, entity->id, entity);
+	entity_index_remove(&state.entities_by_name, slot->hash, entity);
+
+	entity_name_free(slot);
+	entity_slot_release((unsigned int) (entity->handle & 0xFFFFFFFF));
 }
 
 kgfw_entity_t * kgfw_entity_get(kgfw_uuid_t id) {
-	if (state.entities == NULL) {
+	return entity_index_find(&state.entities_by_id, id, NULL);
+}
+
+kgfw_entity_t * kgfw_entity_get_via_name(const char * name) {
+	if (name == NULL) {
 		return NULL;
 	}
 
-	for (entity_node_t * n = state.entities; n->next != NULL; n = n->next) {
-		if (n->entity.id == id) {
-			return &n->entity;
-		}
+	return entity_index_find(&state.entities_by_name, kgfw_hash(name), name);
+}
+
+kgfw_entity_t * kgfw_entity_resolve(kgfw_entity_handle_t handle) {
+	unsigned int index = (unsigned int) (handle & 0xFFFFFFFF);
+	if (index >= state.entities.count) {
+		return NULL;
 	}
 
-	return NULL;
+	entity_slot_t * slot = entity_slot(index);
+	if (!slot->alive || slot->generation != (unsigned int) (handle >> 32)) {
+		return NULL;
+	}
+
+	return &slot->entity;
 }
 
-kgfw_entity_t * kgfw_entity_get_via_name(const char * name) {
-	if (state.entities == NULL) {
+kgfw_component_t * kgfw_entity_get_component(kgfw_entity_t * entity, kgfw_uuid_t type_id) {
+	if (entity == NULL) {
 		return NULL;
 	}
 
-	kgfw_hash_t hash = kgfw_hash(name);
-	for (entity_node_t * n = state.entities;; n = n->next) {
-		if (n == NULL) {
-			return NULL;
-		}
+	archetype_t * archetype = entity->components.archetype;
+	long long int index = component_type_index(type_id);
+	if (archetype == NULL || index < 0) {
+		return NULL;
+	}
+
+	long long int column = archetype_column(archetype, index);
+	if (column < 0) {
+		return NULL;
+	}
+
+	return archetype_component(archetype, column, entity->components.row);
+}
+
+void kgfw_entity_mark_transform_changed(kgfw_entity_t * entity) {
+	if (entity == NULL) {
+		return;
+	}
+
+	entity->transform_tick = state.tick;
+
+	entity_slot_t * slot = entity_slot((unsigned int) (entity->handle & 0xFFFFFFFF));
+	if (slot->transform_node != KGFW_TRANSFORM_NODE_NONE) {
+		kgfw_transform_hierarchy_mark_dirty(&state.transforms, slot->transform_node);
+	}
+}
+
+int kgfw_entity_set_parent(kgfw_entity_t * entity, kgfw_entity_t * parent) {
+	if (entity == NULL || entity == parent) {
+		return 1;
+	}
 
-		if (n->hash == hash) {
-			return &n->entity;
+	entity_slot_t * slot = entity_slot((unsigned int) (entity->handle & 0xFFFFFFFF));
+	if (parent == NULL && slot->transform_node == KGFW_TRANSFORM_NODE_NONE) {
+		return 0;
+	}
+
+	kgfw_transform_node_t parent_node = KGFW_TRANSFORM_NODE_NONE;
+	if (parent != NULL) {
+		parent_node = entity_transform_node(parent);
+		if (parent_node == KGFW_TRANSFORM_NODE_NONE) {
+			return 2;
 		}
 	}
+	kgfw_transform_node_t node = entity_transform_node(entity);
+	if (node == KGFW_TRANSFORM_NODE_NONE) {
+		return 2;
+	}
 
-	return NULL;
+	if (kgfw_transform_hierarchy_set_parent(&state.transforms, node, parent_node) != 0) {
+		return 3;
+	}
+
+	return 0;
 }
 
-kgfw_component_t * kgfw_entity_get_component(kgfw_entity_t * entity, kgfw_uuid_t type_id) {
+kgfw_entity_t * kgfw_entity_get_parent(kgfw_entity_t * entity) {
 	if (entity == NULL) {
 		return NULL;
 	}
 
-	for (kgfw_component_node_t * n = entity->components.handles; n != NULL; n = n->next) {
-		if (n->component->type_id == type_id) {
-			return n->component;
-		}
+	entity_slot_t * slot = entity_slot((unsigned int) (entity->handle & 0xFFFFFFFF));
+	if (slot->transform_node == KGFW_TRANSFORM_NODE_NONE) {
+		return NULL;
 	}
 
-	return NULL;
+	kgfw_transform_node_t parent = kgfw_transform_hierarchy_parent(&state.transforms, slot->transform_node);
+	return kgfw_transform_hierarchy_data(&state.transforms, parent);
+}
+
+void kgfw_entity_world_matrix(kgfw_entity_t * entity, mat4x4 out_m) {
+	if (entity == NULL) {
+		mat4x4_identity(out_m);
+		return;
+	}
+
+	entity_slot_t * slot = entity_slot((unsigned int) (entity->handle & 0xFFFFFFFF));
+	vec4 * world = (slot->transform_node == KGFW_TRANSFORM_NODE_NONE) ? NULL : kgfw_transform_hierarchy_world(&state.transforms, slot->transform_node);
+	if (world == NULL) {
+		kgfw_transform_matrix(&entity->transform, out_m);
+		return;
+	}
+
+	mat4x4_dup(out_m, world);
+}
+
+kgfw_transform_hierarchy_t * kgfw_ecs_transforms(void) {
+	return &state.transforms;
 }
 
 kgfw_uuid_t kgfw_component_construct(const char * name, unsigned long long int component_size, void * component_data, kgfw_uuid_t system_id) {
@@ -411,13 +932,34 @@ kgfw_uuid_t kgfw_component_construct(const char * name, unsigned long long int c
 	state.component_types.hashes = hashes;
 	state.component_types.hashes[state.component_types.count] = kgfw_hash(n);
 
-	component_node_t ** nodes = realloc(state.components, sizeof(component_node_t *) * (state.component_types.count + 1));
-	if (sizes == NULL) {
+	kgfw_component_node_t ** nodes = realloc(state.components, sizeof(kgfw_component_node_t *) * (state.component_types.count + 1));
+	if (nodes == NULL) {
 		return 0;
 	}
 	state.components = nodes;
 	state.components[state.component_types.count] = NULL;
 
+	unsigned char * dirty = realloc(state.components_dirty, sizeof(unsigned char) * (state.component_types.count + 1));
+	if (dirty == NULL) {
+		return 0;
+	}
+	state.components_dirty = dirty;
+	state.components_dirty[state.component_types.count] = 0;
+
+	if (registry_index_insert(&state.component_types.by_id, id, state.component_types.count) != 0) {
+		return 0;
+	}
+	kgfw_hash_t hash = state.component_types.hashes[state.component_types.count];
+	if (registry_index_find(&state.component_types.by_name, hash, state.component_types.names, n) < 0) {
+		if (registry_index_insert(&state.component_types.by_name, hash, state.component_types.count) != 0) {
+			return 0;
+		}
+	}
+	if (system_bind(state.component_types.count) != 0) {
+		return 0;
+	}
+	state.schedule.dirty = 1;
+
 	++state.component_types.count;
 
 	return id;
@@ -428,49 +970,19 @@ kgfw_component_t * kgfw_entity_attach_component(kgfw_entity_t * entity, kgfw_uui
 		return NULL;
 	}
 
-	for (unsigned long long int i = 0; i < state.component_types.count; ++i) {
-		if (state.component_types.type_ids[i] == type_id) {
-			component_node_t * node = malloc(sizeof(component_node_t));
-			if (node == NULL) {
-				return NULL;
-			}
-
-			memset(node, 0, sizeof(component_node_t));
-			node->component = malloc(state.component_types.sizes[i]);
-			if (node->component == NULL) {
-				free(node);
-				return NULL;
-			}
-			memcpy(node->component, state.component_types.datas[i], state.component_types.sizes[i]);
-
-			if (state.components[i] == NULL) {
-				state.components[i] = node;
-			}
-			else {
-				node->next = state.components[i];
-				state.components[i] = node;
-			}
-
-			node->component->type_id = type_id;
-			node->component->instance_id = kgfw_uuid_gen();
-			node->component->entity = entity;
-			node->type_index = i;
-
-			kgfw_component_node_t * cnode = malloc(sizeof(kgfw_component_node_t));
-			if (cnode == NULL) {
-				return NULL;
-			}
-			cnode->next = entity->components.handles;
-			cnode->component = node->component;
-			entity->components.handles = cnode;
-			++entity->components.count;
+	long long int index = component_type_index(type_id);
+	if (index < 0) {
+		return NULL;
+	}
 
-			node->component->start(node->component);
-			return node->component;
+	if (state.updating) {
+		if (kgfw_ecs_defer_attach(entity->handle, type_id, NULL) != 0) {
+			kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs component attach during update could not be deferred for entity \"%s\"", entity->name);
 		}
+		return NULL;
 	}
 
-	return NULL;
+	return entity_attach(entity, index, NULL);
 }
 
 void kgfw_component_destroy(kgfw_component_t * component) {
@@ -478,86 +990,413 @@ void kgfw_component_destroy(kgfw_component_t * component) {
 		return;
 	}
 
-	for (unsigned long long int i = 0; i < state.component_types.count; ++i) {
-		if (state.component_types.type_ids[i] == component->type_id) {
-			component_node_t * prev = state.components[i];
-			for (component_node_t * n = state.components[i]; n != NULL; n = n->next) {
-				if (n->component == component) {
-					kgfw_component_node_t * eprev = component->entity->components.handles;
-					for (kgfw_component_node_t * en = component->entity->components.handles; en != NULL; en = en->next) {
-						if (en->component == component) {
-							component->destroy(component);
-
-							if (n == state.components[i]) {
-								state.components[i] = n->next;
-							} else {
-								prev->next = n->next;
-							}
-
-							if (en == component->entity->components.handles) {
-								component->entity->components.handles = en->next;
-							} else {
-								eprev->next = en->next;
-							}
-
-							free(n->component);
-							free(n);
-							free(en);
-							return;
-						}
-						eprev = en;
-					}
-				}
-				prev = n;
-			}
-		}
+	kgfw_entity_t * entity = component->entity;
+	long long int index = component_type_index(component->type_id);
+	if (entity == NULL || index < 0 || entity->components.archetype == NULL) {
+		return;
 	}
-}
 
-const char * kgfw_component_type_get_name(kgfw_uuid_t type_id) {
-	for (unsigned long long int i = 0; i < state.component_types.count; ++i) {
-		if (state.component_types.type_ids[i] == type_id) {
-			return state.component_types.names[i];
+	if (archetype_column(entity->components.archetype, index) < 0) {
+		return;
+	}
+
+	if (state.updating) {
+		if (kgfw_ecs_defer_detach(entity->handle, component->type_id) != 0) {
+			kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs component destruction during update could not be deferred for entity \"%s\"", entity->name);
 		}
+		return;
 	}
 
-	return NULL;
+	component->destroy(component);
+
+	archetype_t * archetype = NULL;
+	if (archetype_step(entity->components.archetype, index, 0, &archetype) != 0) {
+		kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs component destruction failed for entity \"%s\"", entity->name);
+		return;
+	}
+
+	entity_move(entity, archetype);
 }
 
-kgfw_uuid_t kgfw_component_type_get_id(const char * type_name) {
-	kgfw_hash_t hash = kgfw_hash(type_name);
-	for (unsigned long long int i = 0; i < state.component_types.count; ++i) {
-		if (state.component_types.hashes[i] == hash) {
-			return state.component_types.type_ids[i];
-		}
+void kgfw_component_mark_changed(kgfw_component_t * component) {
+	long long int column = component_column(component);
+	if (column < 0) {
+		return;
 	}
 
-	return 0;
+	archetype_touch(component->entity->components.archetype, column, component->entity->components.row, state.tick);
 }
 
-kgfw_uuid_t kgfw_system_construct(const char * name, unsigned long long int system_size, void * system_data) {
-	if (system_size == 0 || system_data == NULL) {
+unsigned char kgfw_component_changed_since(kgfw_component_t * component, unsigned long long int since) {
+	long long int column = component_column(component);
+	if (column < 0) {
 		return 0;
 	}
 
-	kgfw_uuid_t id = 0;
-	while (id == KGFW_ECS_INVALID_ID) {
-		id = kgfw_uuid_gen();
+	return *archetype_tick(component->entity->components.archetype, column, component->entity->components.row) >= since;
+}
+
+void kgfw_component_span_mark_changed(kgfw_component_span_t * span, unsigned long long int index) {
+	if (span == NULL || index >= span->count) {
+		return;
 	}
 
-	kgfw_system_t * data = malloc(system_size);
-	if (data == NULL) {
-		return 0;
+	span->ticks[index] = state.tick;
+	if (*span->chunk_tick < state.tick) {
+		*span->chunk_tick = state.tick;
 	}
-	memcpy(data, system_data, system_size);
-	kgfw_system_t ** datas = realloc(state.systems.datas, sizeof(kgfw_system_t *) * (state.systems.count + 1));
-	if (datas == NULL) {
+}
+
+unsigned long long int kgfw_ecs_each(kgfw_uuid_t type_id, kgfw_component_span_f func, void * data) {
+	return kgfw_ecs_each_changed(type_id, 0, func, data);
+}
+
+unsigned long long int kgfw_ecs_each_parallel(kgfw_uuid_t type_id, kgfw_component_span_f func, void * data) {
+	return kgfw_ecs_each_changed_parallel(type_id, 0, func, data);
+}
+
+unsigned long long int kgfw_ecs_each_changed(kgfw_uuid_t type_id, unsigned long long int since, kgfw_component_span_f func, void * data) {
+	long long int type_index = component_type_index(type_id);
+	if (type_index < 0) {
 		return 0;
 	}
-	state.systems.datas = datas;
-	state.systems.datas[state.systems.count] = data;
 
-	kgfw_uuid_t * ids = realloc(state.systems.ids, sizeof(kgfw_uuid_t) * (state.systems.count + 1));
+	unsigned long long int visited = 0;
+	for (archetype_t * archetype = state.archetypes; archetype != NULL; archetype = archetype->next) {
+		long long int column = archetype_column(archetype, type_index);
+		if (column < 0) {
+			continue;
+		}
+
+		for (unsigned long long int c = 0; c < archetype->chunks_count; ++c) {
+			kgfw_component_span_t span;
+			if (!span_fill(&span, archetype, column, c, since)) {
+				continue;
+			}
+			func(&span, data);
+			visited += span.count;
+		}
+	}
+
+	return visited;
+}
+
+unsigned long long int kgfw_ecs_each_changed_parallel(kgfw_uuid_t type_id, unsigned long long int since, kgfw_component_span_f func, void * data) {
+	long long int type_index = component_type_index(type_id);
+	if (type_index < 0) {
+		return 0;
+	}
+
+	kgfw_component_span_t stack_spans[ECS_SPANS_STACK];
+	kgfw_component_span_t * spans = stack_spans;
+	unsigned long long int count = component_spans(type_index, since, spans, ECS_SPANS_STACK);
+	if (count > ECS_SPANS_STACK) {
+		spans = malloc(sizeof(kgfw_component_span_t) * count);
+		if (spans == NULL) {
+			return kgfw_ecs_each_changed(type_id, since, func, data);
+		}
+		component_spans(type_index, since, spans, count);
+	}
+
+	span_batch_t batch = { spans, func, data };
+	kgfw_jobs_parallel_for(count, 1, span_batch_range, &batch);
+
+	unsigned long long int visited = 0;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		visited += spans[i].count;
+	}
+
+	if (spans != stack_spans) {
+		free(spans);
+	}
+	return visited;
+}
+
+kgfw_entity_handle_t kgfw_ecs_defer_spawn(const char * name) {
+	ecs_commands_t * buffer = commands_local();
+	if (buffer == NULL || buffer->spawned_count >= ECS_DEFERRED_SPAWN_MAX) {
+		return KGFW_ECS_INVALID_HANDLE;
+	}
+
+	kgfw_entity_handle_t handle = ((kgfw_entity_handle_t) (buffer - state.commands.recording) << 24) | (buffer->spawned_count + 1);
+	if (commands_push(buffer, ECS_COMMAND_SPAWN, handle, 0, name, (name == NULL) ? 0 : strlen(name) + 1) == NULL) {
+		return KGFW_ECS_INVALID_HANDLE;
+	}
+
+	++buffer->spawned_count;
+	return handle;
+}
+
+int kgfw_ecs_defer_destroy(kgfw_entity_handle_t entity) {
+	ecs_commands_t * buffer = commands_local();
+	if (buffer == NULL) {
+		return 1;
+	}
+
+	if (commands_push(buffer, ECS_COMMAND_DESTROY, entity, 0, NULL, 0) == NULL) {
+		return 3;
+	}
+
+	return 0;
+}
+
+int kgfw_ecs_defer_attach(kgfw_entity_handle_t entity, kgfw_uuid_t type_id, const void * component_data) {
+	ecs_commands_t * buffer = commands_local();
+	if (buffer == NULL) {
+		return 1;
+	}
+
+	long long int index = component_type_index(type_id);
+	if (index < 0) {
+		return 2;
+	}
+
+	if (commands_push(buffer, ECS_COMMAND_ATTACH, entity, index, component_data, state.component_types.sizes[index]) == NULL) {
+		return 3;
+	}
+
+	return 0;
+}
+
+int kgfw_ecs_defer_detach(kgfw_entity_handle_t entity, kgfw_uuid_t type_id) {
+	ecs_commands_t * buffer = commands_local();
+	if (buffer == NULL) {
+		return 1;
+	}
+
+	long long int index = component_type_index(type_id);
+	if (index < 0) {
+		return 2;
+	}
+
+	if (commands_push(buffer, ECS_COMMAND_DETACH, entity, index, NULL, 0) == NULL) {
+		return 3;
+	}
+
+	return 0;
+}
+
+void kgfw_ecs_commands_flush(void) {
+	/* commands played back by this flush may record more, a nested flush would pull the buffers out from under it */
+	if (state.commands.flushing) {
+		return;
+	}
+	state.commands.flushing = 1;
+
+	for (unsigned int round = 0; round < ECS_COMMAND_ROUNDS; ++round) {
+		unsigned long long int total = 0;
+		for (unsigned long long int i = 0; i < state.commands.count; ++i) {
+			total += state.commands.recording[i].count;
+		}
+		if (total == 0) {
+			state.commands.flushing = 0;
+			return;
+		}
+
+		for (unsigned long long int i = 0; i < state.commands.count; ++i) {
+			ecs_commands_t swap = state.commands.playing[i];
+			state.commands.playing[i] = state.commands.recording[i];
+			state.commands.recording[i] = swap;
+
+			ecs_commands_t * buffer = &state.commands.playing[i];
+			if (buffer->spawned_count > buffer->spawned_capacity) {
+				kgfw_entity_handle_t * spawned = realloc(buffer->spawned, sizeof(kgfw_entity_handle_t) * buffer->spawned_count);
+				if (spawned == NULL) {
+					kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs deferred spawns dropped, out of memory");
+					buffer->spawned_count = buffer->spawned_capacity;
+				} else {
+					buffer->spawned = spawned;
+					buffer->spawned_capacity = buffer->spawned_count;
+				}
+			}
+			for (unsigned long long int j = 0; j < buffer->spawned_count; ++j) {
+				buffer->spawned[j] = KGFW_ECS_INVALID_HANDLE;
+			}
+		}
+
+		if (total > state.commands.sorted_capacity) {
+			ecs_command_t ** sorted = realloc(state.commands.sorted, sizeof(ecs_command_t *) * total);
+			if (sorted != NULL) {
+				state.commands.sorted = sorted;
+				state.commands.sorted_capacity = total;
+			}
+		}
+
+		if (total <= state.commands.sorted_capacity) {
+			/* spawns first, then attaches and detaches grouped by type so entities move archetypes in runs, then destroys */
+			unsigned long long int count = 0;
+			for (unsigned long long int i = 0; i < state.commands.count; ++i) {
+				for (unsigned long long int j = 0; j < state.commands.playing[i].count; ++j) {
+					state.commands.sorted[count++] = &state.commands.playing[i].commands[j];
+				}
+			}
+			qsort(state.commands.sorted, count, sizeof(ecs_command_t *), commands_compare);
+			for (unsigned long long int i = 0; i < count; ++i) {
+				commands_play(state.commands.sorted[i]);
+			}
+		} else {
+			/* same order without grouping by type */
+			for (unsigned int rank = 0; rank <= commands_rank(ECS_COMMAND_DESTROY); ++rank) {
+				for (unsigned long long int i = 0; i < state.commands.count; ++i) {
+					for (unsigned long long int j = 0; j < state.commands.playing[i].count; ++j) {
+						if (commands_rank(state.commands.playing[i].commands[j].kind) == rank) {
+							commands_play(&state.commands.playing[i].commands[j]);
+						}
+					}
+				}
+			}
+		}
+
+		for (unsigned long long int i = 0; i < state.commands.count; ++i) {
+			state.commands.playing[i].count = 0;
+			state.commands.playing[i].bytes_size = 0;
+			state.commands.playing[i].spawned_count = 0;
+		}
+	}
+
+	kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs commands kept recording more commands, the rest are played back next flush");
+	state.commands.flushing = 0;
+}
+
+unsigned long long int kgfw_ecs_snapshot(void * buffer, unsigned long long int size) {
+	unsigned long long int needed = snapshot_write(NULL);
+	if (buffer != NULL && size >= needed) {
+		snapshot_write(buffer);
+	}
+
+	return needed;
+}
+
+int kgfw_ecs_restore(const void * buffer, unsigned long long int size, unsigned char replace) {
+	if (buffer == NULL) {
+		return 1;
+	}
+
+	const char * bytes = buffer;
+	unsigned long long int offset = 0;
+	unsigned long long int header[5];
+	for (unsigned long long int i = 0; i < 5; ++i) {
+		if (snapshot_read(bytes, size, &offset, &header[i]) != 0) {
+			return 1;
+		}
+	}
+	if (header[0] != ECS_SNAPSHOT_MAGIC || header[1] != ECS_SNAPSHOT_VERSION) {
+		kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs snapshot restore failed, not a version %u snapshot", ECS_SNAPSHOT_VERSION);
+		return 1;
+	}
+
+	unsigned long long int types_count = header[2];
+	unsigned long long int records_count = header[3];
+	unsigned long long int entities_count = header[4];
+	/* a type takes at least 24 bytes and an entity 64, so corrupt counts can not cause huge allocations */
+	if (types_count > size / 24 || entities_count > size / 64) {
+		return 1;
+	}
+
+	/* snapshot type -> registered type, [types_count] more for sorting the types of one record */
+	unsigned long long int * types = malloc(sizeof(unsigned long long int) * (types_count * 2 + 1));
+	if (types == NULL) {
+		return 3;
+	}
+
+	for (unsigned long long int i = 0; i < types_count; ++i) {
+		unsigned long long int type_size = 0;
+		const char * name = NULL;
+		if (snapshot_read(bytes, size, &offset, &type_size) != 0 || snapshot_read_name(bytes, size, &offset, &name) != 0) {
+			free(types);
+			return 1;
+		}
+
+		long long int index = registry_index_find(&state.component_types.by_name, kgfw_hash(name), state.component_types.names, name);
+		if (index < 0 || state.component_types.sizes[index] != type_size) {
+			kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs snapshot restore failed, component type \"%s\" is %s", name, (index < 0) ? "not registered" : "a different size");
+			free(types);
+			return 2;
+		}
+		types[i] = (unsigned long long int) index;
+	}
+
+	/* the whole buffer is checked before the world is touched */
+	unsigned long long int records = offset;
+	for (unsigned long long int r = 0; r < records_count; ++r) {
+		if (snapshot_record(bytes, size, &offset, types, types_count, NULL) != 0) {
+			free(types);
+			return 1;
+		}
+	}
+
+	if (replace) {
+		for (unsigned int i = 0; i < state.entities.count; ++i) {
+			entity_slot_t * slot = entity_slot(i);
+			if (slot->alive) {
+				kgfw_entity_destroy(&slot->entity);
+			}
+		}
+	}
+
+	if (entity_index_reserve(&state.entities_by_id, state.entities_by_id.count + entities_count) != 0 || entity_index_reserve(&state.entities_by_name, state.entities_by_name.count + entities_count) != 0) {
+		free(types);
+		return 3;
+	}
+
+	offset = records;
+	int result = 0;
+	for (unsigned long long int r = 0; r < records_count && result == 0; ++r) {
+		result = snapshot_record(bytes, size, &offset, types, types_count, types + types_count);
+	}
+
+	free(types);
+	if (result != 0) {
+		kgfw_logf(KGFW_LOG_SEVERITY_WARN, "ecs snapshot restore ran out of memory, the world is partially restored");
+	}
+	return result;
+}
+
+const char * kgfw_component_type_get_name(kgfw_uuid_t type_id) {
+	long long int index = component_type_index(type_id);
+	if (index < 0) {
+		return NULL;
+	}
+
+	return state.component_types.names[index];
+}
+
+kgfw_uuid_t kgfw_component_type_get_id(const char * type_name) {
+	if (type_name == NULL) {
+		return 0;
+	}
+
+	long long int index = registry_index_find(&state.component_types.by_name, kgfw_hash(type_name), state.component_types.names, type_name);
+	if (index < 0) {
+		return 0;
+	}
+
+	return state.component_types.type_ids[index];
+}
+
+kgfw_uuid_t kgfw_system_construct(const char * name, unsigned long long int system_size, void * system_data, const kgfw_system_access_t * access) {
+	if (system_size == 0 || system_data == NULL) {
+		return 0;
+	}
+
+	kgfw_uuid_t id = 0;
+	while (id == KGFW_ECS_INVALID_ID) {
+		id = kgfw_uuid_gen();
+	}
+
+	kgfw_system_t * data = malloc(system_size);
+	if (data == NULL) {
+		return 0;
+	}
+	memcpy(data, system_data, system_size);
+	kgfw_system_t ** datas = realloc(state.systems.datas, sizeof(kgfw_system_t *) * (state.systems.count + 1));
+	if (datas == NULL) {
+		return 0;
+	}
+	state.systems.datas = datas;
+	state.systems.datas[state.systems.count] = data;
+
+	kgfw_uuid_t * ids = realloc(state.systems.ids, sizeof(kgfw_uuid_t) * (state.systems.count + 1));
 	if (ids == NULL) {
 		return 0;
 	}
@@ -609,12 +1448,20 @@ kgfw_uuid_t kgfw_system_construct(const char * name, unsigned long long int syst
 	state.systems.hashes = hashes;
 	state.systems.hashes[state.systems.count] = kgfw_hash(n);
 
-	unsigned long long int comp_index = 0;
-	for (unsigned long long int j = 0; j < state.component_types.count; ++j) {
-		if (state.component_types.system_ids[j] == state.systems.ids[state.systems.count]) {
-			data->start(data, (kgfw_component_node_t *) state.components[comp_index]);
-			break;
+	if (system_access_set(state.systems.count, access) != 0) {
+		return 0;
+	}
+
+	if (system_register(id) != 0) {
+		return 0;
+	}
+
+	for (unsigned long long int i = 0; i < state.systems.bound_counts[state.systems.count]; ++i) {
+		unsigned long long int j = state.systems.bound[state.systems.count][i];
+		if (state.components_dirty[j]) {
+			components_link(j);
 		}
+		data->start(data, state.components[j]);
 	}
 
 	++state.systems.count;
@@ -693,14 +1540,1549 @@ static int default_system_construct(const char * name, unsigned long long int sy
 	state.systems.hashes = hashes;
 	state.systems.hashes[state.systems.count] = kgfw_hash(n);
 
-	unsigned long long int comp_index = 0;
-	for (unsigned long long int j = 0; j < state.component_types.count; ++j) {
-		if (state.component_types.system_ids[j] == state.systems.ids[state.systems.count]) {
-			data->start(data, (kgfw_component_node_t *) state.components[comp_index]);
-			break;
+	if (system_access_set(state.systems.count, NULL) != 0) {
+		return 11;
+	}
+
+	if (system_register(id) != 0) {
+		return 12;
+	}
+
+	for (unsigned long long int i = 0; i < state.systems.bound_counts[state.systems.count]; ++i) {
+		unsigned long long int j = state.systems.bound[state.systems.count][i];
+		if (state.components_dirty[j]) {
+			components_link(j);
 		}
+		data->start(data, state.components[j]);
 	}
 
 	++state.systems.count;
 	return 0;
 }
+
+/* id is regenerated if it is KGFW_ECS_INVALID_ID or already in use */
+static kgfw_entity_t * entity_spawn(const char * name, kgfw_uuid_t id) {
+	long long int index = entity_slot_alloc();
+	if (index < 0) {
+		return NULL;
+	}
+
+	entity_slot_t * slot = entity_slot((unsigned int) index);
+	kgfw_entity_t * e = &slot->entity;
+	memset(e, 0, sizeof(kgfw_entity_t));
+	e->handle = (((kgfw_entity_handle_t) slot->generation) << 32) | (kgfw_entity_handle_t) index;
+
+	e->id = id;
+	while (e->id == KGFW_ECS_INVALID_ID || kgfw_entity_get(e->id) != NULL) {
+		e->id = kgfw_uuid_gen();
+	}
+
+	if (name == NULL) {
+		snprintf(slot->name, ENTITY_NAME_INLINE, "Entity 0x%llx", e->id);
+		e->name = slot->name;
+	} else {
+		unsigned long long int len = strlen(name);
+		e->name = (len < ENTITY_NAME_INLINE) ? slot->name : malloc(sizeof(char) * (len + 1));
+		if (e->name == NULL) {
+			entity_slot_release((unsigned int) index);
+			return NULL;
+		}
+		strncpy((char *) e->name, name, len);
+		((char *) e->name)[len] = '\0';
+	}
+
+	slot->hash = kgfw_hash(e->name);
+
+	if (entity_index_insert(&state.entities_by_id, e->id, e) != 0) {
+		entity_name_free(slot);
+		entity_slot_release((unsigned int) index);
+		return NULL;
+	}
+	if (entity_index_insert(&state.entities_by_name, slot->hash, e) != 0) {
+		entity_index_remove(&state.entities_by_id, e->id, e);
+		entity_name_free(slot);
+		entity_slot_release((unsigned int) index);
+		return NULL;
+	}
+
+	slot->alive = 1;
+	slot->transform_node = KGFW_TRANSFORM_NODE_NONE;
+	kgfw_transform_identity(&e->transform);
+	e->transform_tick = state.tick;
+	return e;
+}
+
+/*
+	starts every component of a batch of entities made in archetype, one type at a time.
+	start callbacks may create/destroy entities, so the batch is tracked by handle
+*/
+static void entities_start(archetype_t * archetype, const kgfw_entity_handle_t * handles, unsigned long long int count) {
+	for (unsigned long long int i = 0; i < archetype->types_count; ++i) {
+		kgfw_uuid_t type_id = state.component_types.type_ids[archetype->types[i]];
+		for (unsigned long long int j = 0; j < count; ++j) {
+			kgfw_entity_t * e = kgfw_entity_resolve(handles[j]);
+			if (e == NULL) {
+				continue;
+			}
+
+			kgfw_component_t * c = (e->components.archetype == archetype) ? archetype_component(archetype, i, e->components.row) : kgfw_entity_get_component(e, type_id);
+			if (c != NULL) {
+				c->start(c);
+			}
+		}
+	}
+}
+
+/* adds the entity to the transform hierarchy as a root the first time it is needed */
+static kgfw_transform_node_t entity_transform_node(kgfw_entity_t * entity) {
+	entity_slot_t * slot = entity_slot((unsigned int) (entity->handle & 0xFFFFFFFF));
+	if (slot->transform_node == KGFW_TRANSFORM_NODE_NONE) {
+		slot->transform_node = kgfw_transform_hierarchy_add(&state.transforms, &entity->transform, entity, KGFW_TRANSFORM_NODE_NONE);
+	}
+
+	return slot->transform_node;
+}
+
+static entity_slot_t * entity_slot(unsigned int index) {
+	return &state.entities.pages[index / ENTITY_PAGE_SIZE][index % ENTITY_PAGE_SIZE];
+}
+
+/* returns the index of a free slot or -1 on error */
+static long long int entity_slot_alloc(void) {
+	if (state.entities.free != ENTITY_SLOT_NONE) {
+		unsigned int index = state.entities.free;
+		state.entities.free = entity_slot(index)->next_free;
+		return index;
+	}
+
+	if (state.entities.count == ENTITY_SLOT_NONE) {
+		return -1;
+	}
+
+	if (state.entities.count == state.entities.pages_count * ENTITY_PAGE_SIZE) {
+		entity_slot_t ** pages = realloc(state.entities.pages, sizeof(entity_slot_t *) * (state.entities.pages_count + 1));
+		if (pages == NULL) {
+			return -1;
+		}
+		state.entities.pages = pages;
+
+		entity_slot_t * page = malloc(sizeof(entity_slot_t) * ENTITY_PAGE_SIZE);
+		if (page == NULL) {
+			return -1;
+		}
+		for (unsigned int i = 0; i < ENTITY_PAGE_SIZE; ++i) {
+			page[i].generation = 1;
+			page[i].next_free = ENTITY_SLOT_NONE;
+			page[i].alive = 0;
+		}
+		state.entities.pages[state.entities.pages_count] = page;
+		++state.entities.pages_count;
+	}
+
+	return state.entities.count++;
+}
+
+static void entity_slot_release(unsigned int index) {
+	entity_slot_t * slot = entity_slot(index);
+	slot->alive = 0;
+	/* generation 0 is never handed out so a handle of 0 is always invalid */
+	++slot->generation;
+	if (slot->generation == 0) {
+		slot->generation = 1;
+	}
+	slot->next_free = state.entities.free;
+	state.entities.free = index;
+}
+
+static void entity_name_free(entity_slot_t * slot) {
+	if (slot->entity.name != slot->name) {
+		free((void *) slot->entity.name);
+	}
+	slot->entity.name = NULL;
+}
+
+/* finalizer of murmur3, spreads djb2 hashes and rand() ids over the low bits */
+static unsigned long long int hash_mix(kgfw_hash_t key) {
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+static unsigned long long int entity_index_slot(entity_index_t * index, kgfw_hash_t key) {
+	return hash_mix(key) & (index->capacity - 1);
+}
+
+/* makes room for count entries while keeping the load factor under 70% */
+static int entity_index_reserve(entity_index_t * index, unsigned long long int count) {
+	if (count * 10 <= index->capacity * 7) {
+		return 0;
+	}
+
+	entity_index_t grown = {
+		NULL, NULL,
+		(index->capacity == 0) ? ENTITY_INDEX_MIN_CAPACITY : index->capacity * 2,
+		index->count,
+	};
+	while (count * 10 > grown.capacity * 7) {
+		grown.capacity *= 2;
+	}
+
+	grown.keys = malloc(sizeof(kgfw_hash_t) * grown.capacity);
+	grown.entities = malloc(sizeof(kgfw_entity_t *) * grown.capacity);
+	if (grown.keys == NULL || grown.entities == NULL) {
+		if (grown.keys != NULL) {
+			free(grown.keys);
+		}
+		if (grown.entities != NULL) {
+			free(grown.entities);
+		}
+		return 1;
+	}
+	memset(grown.entities, 0, sizeof(kgfw_entity_t *) * grown.capacity);
+
+	for (unsigned long long int i = 0; i < index->capacity; ++i) {
+		if (index->entities[i] == NULL) {
+			continue;
+		}
+
+		unsigned long long int slot = entity_index_slot(&grown, index->keys[i]);
+		while (grown.entities[slot] != NULL) {
+			slot = (slot + 1) & (grown.capacity - 1);
+		}
+		grown.keys[slot] = index->keys[i];
+		grown.entities[slot] = index->entities[i];
+	}
+
+	entity_index_free(index);
+	*index = grown;
+	return 0;
+}
+
+static int entity_index_insert(entity_index_t * index, kgfw_hash_t key, kgfw_entity_t * entity) {
+	if (entity_index_reserve(index, index->count + 1) != 0) {
+		return 1;
+	}
+
+	unsigned long long int slot = entity_index_slot(index, key);
+	while (index->entities[slot] != NULL) {
+		slot = (slot + 1) & (index->capacity - 1);
+	}
+	index->keys[slot] = key;
+	index->entities[slot] = entity;
+	++index->count;
+	return 0;
+}
+
+static void entity_index_remove(entity_index_t * index, kgfw_hash_t key, kgfw_entity_t * entity) {
+	if (index->count == 0) {
+		return;
+	}
+
+	unsigned long long int mask = index->capacity - 1;
+	unsigned long long int slot = entity_index_slot(index, key);
+	while (index->entities[slot] != entity) {
+		if (index->entities[slot] == NULL) {
+			return;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	/* backward shift deletion, pull later entries of the probe sequence into the hole */
+	for (unsigned long long int next = (slot + 1) & mask; index->entities[next] != NULL; next = (next + 1) & mask) {
+		unsigned long long int home = entity_index_slot(index, index->keys[next]);
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			index->keys[slot] = index->keys[next];
+			index->entities[slot] = index->entities[next];
+			slot = next;
+		}
+	}
+
+	index->entities[slot] = NULL;
+	--index->count;
+}
+
+/* if name is NULL the key is an entity id */
+static kgfw_entity_t * entity_index_find(entity_index_t * index, kgfw_hash_t key, const char * name) {
+	if (index->count == 0) {
+		return NULL;
+	}
+
+	for (unsigned long long int slot = entity_index_slot(index, key); index->entities[slot] != NULL; slot = (slot + 1) & (index->capacity - 1)) {
+		if (index->keys[slot] != key) {
+			continue;
+		}
+
+		kgfw_entity_t * e = index->entities[slot];
+		if (name == NULL ? (e->id == key) : (strcmp(e->name, name) == 0)) {
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static void entity_index_free(entity_index_t * index) {
+	if (index->keys != NULL) {
+		free(index->keys);
+	}
+	if (index->entities != NULL) {
+		free(index->entities);
+	}
+	index->keys = NULL;
+	index->entities = NULL;
+	index->capacity = 0;
+	index->count = 0;
+}
+
+static long long int component_type_index(kgfw_uuid_t type_id) {
+	return registry_index_find(&state.component_types.by_id, type_id, NULL, NULL);
+}
+
+static int registry_index_insert(registry_index_t * index, kgfw_hash_t key, unsigned long long int value) {
+	if ((index->count + 1) * 10 > index->capacity * 7) {
+		registry_index_t grown = {
+			NULL, NULL,
+			(index->capacity == 0) ? REGISTRY_INDEX_MIN_CAPACITY : index->capacity * 2,
+			index->count,
+		};
+
+		grown.keys = malloc(sizeof(kgfw_hash_t) * grown.capacity);
+		grown.values = malloc(sizeof(unsigned long long int) * grown.capacity);
+		if (grown.keys == NULL || grown.values == NULL) {
+			registry_index_free(&grown);
+			return 1;
+		}
+		memset(grown.values, 0xFF, sizeof(unsigned long long int) * grown.capacity);
+
+		for (unsigned long long int i = 0; i < index->capacity; ++i) {
+			if (index->values[i] == REGISTRY_INDEX_EMPTY) {
+				continue;
+			}
+
+			unsigned long long int slot = hash_mix(index->keys[i]) & (grown.capacity - 1);
+			while (grown.values[slot] != REGISTRY_INDEX_EMPTY) {
+				slot = (slot + 1) & (grown.capacity - 1);
+			}
+			grown.keys[slot] = index->keys[i];
+			grown.values[slot] = index->values[i];
+		}
+
+		registry_index_free(index);
+		*index = grown;
+	}
+
+	unsigned long long int slot = hash_mix(key) & (index->capacity - 1);
+	while (index->values[slot] != REGISTRY_INDEX_EMPTY) {
+		slot = (slot + 1) & (index->capacity - 1);
+	}
+	index->keys[slot] = key;
+	index->values[slot] = value;
+	++index->count;
+	return 0;
+}
+
+/* if names is NULL the key is an id, otherwise names[value] has to match name */
+static long long int registry_index_find(registry_index_t * index, kgfw_hash_t key, const char ** names, const char * name) {
+	if (index->count == 0) {
+		return -1;
+	}
+
+	for (unsigned long long int slot = hash_mix(key) & (index->capacity - 1); index->values[slot] != REGISTRY_INDEX_EMPTY; slot = (slot + 1) & (index->capacity - 1)) {
+		if (index->keys[slot] == key && (names == NULL || strcmp(names[index->values[slot]], name) == 0)) {
+			return (long long int) index->values[slot];
+		}
+	}
+
+	return -1;
+}
+
+static void registry_index_free(registry_index_t * index) {
+	if (index->keys != NULL) {
+		free(index->keys);
+	}
+	if (index->values != NULL) {
+		free(index->values);
+	}
+	index->keys = NULL;
+	index->values = NULL;
+	index->capacity = 0;
+	index->count = 0;
+}
+
+/* called for the system at state.systems.count before it is counted */
+static int system_register(kgfw_uuid_t id) {
+	unsigned long long int count = state.systems.count;
+	unsigned long long int ** bound = realloc(state.systems.bound, sizeof(unsigned long long int *) * (count + 1));
+	if (bound == NULL) {
+		return 1;
+	}
+	state.systems.bound = bound;
+	state.systems.bound[count] = NULL;
+
+	unsigned long long int * bound_counts = realloc(state.systems.bound_counts, sizeof(unsigned long long int) * (count + 1));
+	if (bound_counts == NULL) {
+		return 2;
+	}
+	state.systems.bound_counts = bound_counts;
+	state.systems.bound_counts[count] = 0;
+
+	if (registry_index_insert(&state.systems.by_id, id, count) != 0) {
+		return 3;
+	}
+
+	return 0;
+}
+
+/* a type bound to a system id that was never constructed is never updated */
+static int system_bind(unsigned long long int type_index) {
+	long long int system = registry_index_find(&state.systems.by_id, state.component_types.system_ids[type_index], NULL, NULL);
+	if (system < 0) {
+		return 0;
+	}
+
+	unsigned long long int * bound = realloc(state.systems.bound[system], sizeof(unsigned long long int) * (state.systems.bound_counts[system] + 1));
+	if (bound == NULL) {
+		return 1;
+	}
+	state.systems.bound[system] = bound;
+	state.systems.bound[system][state.systems.bound_counts[system]++] = type_index;
+	return 0;
+}
+
+static int system_access_set(unsigned long long int system, const kgfw_system_access_t * access) {
+	kgfw_system_access_t * accesses = realloc(state.systems.accesses, sizeof(kgfw_system_access_t) * (system + 1));
+	if (accesses == NULL) {
+		return 1;
+	}
+	state.systems.accesses = accesses;
+
+	unsigned char * declared = realloc(state.systems.declared, sizeof(unsigned char) * (system + 1));
+	if (declared == NULL) {
+		return 2;
+	}
+	state.systems.declared = declared;
+
+	memset(&state.systems.accesses[system], 0, sizeof(kgfw_system_access_t));
+	state.systems.declared[system] = 0;
+	state.schedule.dirty = 1;
+	if (access == NULL) {
+		return 0;
+	}
+
+	/* reads and writes share one allocation owned by reads */
+	unsigned long long int count = access->reads_count + access->writes_count;
+	kgfw_uuid_t * ids = malloc(sizeof(kgfw_uuid_t) * ((count == 0) ? 1 : count));
+	if (ids == NULL) {
+		return 3;
+	}
+	if (access->reads_count != 0) {
+		memcpy(ids, access->reads, sizeof(kgfw_uuid_t) * access->reads_count);
+	}
+	if (access->writes_count != 0) {
+		memcpy(ids + access->reads_count, access->writes, sizeof(kgfw_uuid_t) * access->writes_count);
+	}
+
+	state.systems.accesses[system].reads = ids;
+	state.systems.accesses[system].reads_count = access->reads_count;
+	state.systems.accesses[system].writes = ids + access->reads_count;
+	state.systems.accesses[system].writes_count = access->writes_count;
+	state.systems.declared[system] = 1;
+	return 0;
+}
+
+static system_access_enum system_access(unsigned long long int system, unsigned long long int type_index) {
+	if (state.component_types.system_ids[type_index] == state.systems.ids[system]) {
+		return SYSTEM_ACCESS_WRITE;
+	}
+
+	kgfw_system_access_t * access = &state.systems.accesses[system];
+	for (unsigned long long int i = 0; i < access->writes_count; ++i) {
+		if (access->writes[i] == state.component_types.type_ids[type_index]) {
+			return SYSTEM_ACCESS_WRITE;
+		}
+	}
+	for (unsigned long long int i = 0; i < access->reads_count; ++i) {
+		if (access->reads[i] == state.component_types.type_ids[type_index]) {
+			return SYSTEM_ACCESS_READ;
+		}
+	}
+
+	return SYSTEM_ACCESS_NONE;
+}
+
+static unsigned char systems_conflict(unsigned long long int a, unsigned long long int b) {
+	if (!state.systems.declared[a] || !state.systems.declared[b]) {
+		return 1;
+	}
+
+	for (unsigned long long int i = 0; i < state.component_types.count; ++i) {
+		system_access_enum access_a = system_access(a, i);
+		system_access_enum access_b = system_access(b, i);
+		if (access_a != SYSTEM_ACCESS_NONE && access_b != SYSTEM_ACCESS_NONE && (access_a == SYSTEM_ACCESS_WRITE || access_b == SYSTEM_ACCESS_WRITE)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void system_update(unsigned long long int system) {
+	for (unsigned long long int i = 0; i < state.systems.bound_counts[system]; ++i) {
+		unsigned long long int j = state.systems.bound[system][i];
+		state.systems.datas[system]->update(state.systems.datas[system], state.components[j]);
+	}
+	/* the tick is advanced once the system's level finished, its own changes are not seen next update */
+	state.systems.datas[system]->last_tick = state.tick + 1;
+}
+
+/* a system's level is one past the highest level of the earlier systems it conflicts with */
+static int schedule_build(void) {
+	unsigned long long int count = state.systems.count;
+	unsigned long long int * levels = malloc(sizeof(unsigned long long int) * (count + 1));
+	unsigned long long int * order = malloc(sizeof(unsigned long long int) * (count + 1));
+	unsigned long long int * system_levels = malloc(sizeof(unsigned long long int) * (count + 1));
+	kgfw_job_t * jobs = malloc(sizeof(kgfw_job_t) * (count + 1));
+	if (levels == NULL || order == NULL || system_levels == NULL || jobs == NULL) {
+		if (levels != NULL) {
+			free(levels);
+		}
+		if (order != NULL) {
+			free(order);
+		}
+		if (system_levels != NULL) {
+			free(system_levels);
+		}
+		if (jobs != NULL) {
+			free(jobs);
+		}
+		return 1;
+	}
+
+	unsigned long long int levels_count = 0;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		system_levels[i] = 0;
+		for (unsigned long long int j = 0; j < i; ++j) {
+			if (system_levels[j] >= system_levels[i] && systems_conflict(j, i)) {
+				system_levels[i] = system_levels[j] + 1;
+			}
+		}
+		if (system_levels[i] + 1 > levels_count) {
+			levels_count = system_levels[i] + 1;
+		}
+	}
+
+	/* counting sort keeps registration order within a level */
+	unsigned long long int index = 0;
+	for (unsigned long long int l = 0; l < levels_count; ++l) {
+		levels[l] = index;
+		for (unsigned long long int i = 0; i < count; ++i) {
+			if (system_levels[i] == l) {
+				order[index++] = i;
+			}
+		}
+	}
+	levels[levels_count] = index;
+	free(system_levels);
+
+	for (unsigned long long int i = 0; i < count; ++i) {
+		jobs[i].func = system_job;
+		jobs[i].data = &order[i];
+		jobs[i].counter = NULL;
+	}
+
+	if (state.schedule.order != NULL) {
+		free(state.schedule.order);
+	}
+	if (state.schedule.levels != NULL) {
+		free(state.schedule.levels);
+	}
+	if (state.schedule.jobs != NULL) {
+		free(state.schedule.jobs);
+	}
+	state.schedule.order = order;
+	state.schedule.levels = levels;
+	state.schedule.jobs = jobs;
+	state.schedule.levels_count = levels_count;
+	state.schedule.dirty = 0;
+	return 0;
+}
+
+/* data == NULL copies the type's template */
+static kgfw_component_t * entity_attach(kgfw_entity_t * entity, unsigned long long int index, const void * data) {
+	archetype_t * archetype = NULL;
+	if (entity->components.archetype != NULL && archetype_column(entity->components.archetype, index) >= 0) {
+		kgfw_logf(KGFW_LOG_SEVERITY_WARN, "entity \"%s\" already has a \"%s\" component", entity->name, state.component_types.names[index]);
+		return NULL;
+	}
+
+	if (archetype_step(entity->components.archetype, index, 1, &archetype) != 0) {
+		return NULL;
+	}
+
+	if (entity_move(entity, archetype) != 0) {
+		return NULL;
+	}
+
+	kgfw_component_t * component = archetype_component(archetype, archetype_column(archetype, index), entity->components.row);
+	memcpy(component, (data == NULL) ? state.component_types.datas[index] : data, state.component_types.sizes[index]);
+	component->type_id = state.component_types.type_ids[index];
+	component->instance_id = kgfw_uuid_gen();
+	component->entity = entity;
+
+	component->start(component);
+	/* start may have changed the entity's archetype */
+	return kgfw_entity_get_component(entity, state.component_types.type_ids[index]);
+}
+
+static int commands_init(void) {
+	unsigned long long int count = (unsigned long long int) kgfw_jobs_worker_count() + 1;
+	if (count > ECS_DEFERRED_BUFFERS_MAX + 1) {
+		count = ECS_DEFERRED_BUFFERS_MAX + 1;
+	}
+
+	state.commands.recording = malloc(sizeof(ecs_commands_t) * count);
+	state.commands.playing = malloc(sizeof(ecs_commands_t) * count);
+	if (state.commands.recording == NULL || state.commands.playing == NULL) {
+		commands_free();
+		return 1;
+	}
+
+	memset(state.commands.recording, 0, sizeof(ecs_commands_t) * count);
+	memset(state.commands.playing, 0, sizeof(ecs_commands_t) * count);
+	state.commands.count = count;
+	return 0;
+}
+
+static void commands_free(void) {
+	for (unsigned long long int i = 0; i < state.commands.count; ++i) {
+		ecs_commands_t * sets[2] = { &state.commands.recording[i], &state.commands.playing[i] };
+		for (unsigned int j = 0; j < 2; ++j) {
+			if (sets[j]->commands != NULL) {
+				free(sets[j]->commands);
+			}
+			if (sets[j]->bytes != NULL) {
+				free(sets[j]->bytes);
+			}
+			if (sets[j]->spawned != NULL) {
+				free(sets[j]->spawned);
+			}
+		}
+	}
+
+	if (state.commands.recording != NULL) {
+		free(state.commands.recording);
+		state.commands.recording = NULL;
+	}
+	if (state.commands.playing != NULL) {
+		free(state.commands.playing);
+		state.commands.playing = NULL;
+	}
+	if (state.commands.sorted != NULL) {
+		free(state.commands.sorted);
+		state.commands.sorted = NULL;
+	}
+	state.commands.count = 0;
+	state.commands.sorted_capacity = 0;
+}
+
+/* NULL for threads outside of the kgfw_jobs pool while the pool is running */
+static ecs_commands_t * commands_local(void) {
+	int thread = kgfw_jobs_thread_index();
+	if (thread < 0) {
+		if (kgfw_jobs_worker_count() != 0) {
+			return NULL;
+		}
+		thread = 0;
+	}
+
+	if ((unsigned long long int) thread >= state.commands.count) {
+		return NULL;
+	}
+
+	return &state.commands.recording[thread];
+}
+
+static ecs_command_t * commands_push(ecs_commands_t * buffer, ecs_command_kind_enum kind, kgfw_entity_handle_t entity, unsigned long long int type_index, const void * data, unsigned long long int size) {
+	if (buffer->count == buffer->capacity) {
+		unsigned long long int capacity = (buffer->capacity == 0) ? 64 : buffer->capacity * 2;
+		ecs_command_t * commands = realloc(buffer->commands, sizeof(ecs_command_t) * capacity);
+		if (commands == NULL) {
+			return NULL;
+		}
+		buffer->commands = commands;
+		buffer->capacity = capacity;
+	}
+
+	unsigned long long int offset = ECS_COMMAND_NO_DATA;
+	if (data != NULL) {
+		offset = ECS_ALIGN_UP(buffer->bytes_size);
+		if (offset + size > buffer->bytes_capacity) {
+			unsigned long long int capacity = (buffer->bytes_capacity == 0) ? 1024 : buffer->bytes_capacity * 2;
+			while (capacity < offset + size) {
+				capacity *= 2;
+			}
+			unsigned char * bytes = realloc(buffer->bytes, capacity);
+			if (bytes == NULL) {
+				return NULL;
+			}
+			buffer->bytes = bytes;
+			buffer->bytes_capacity = capacity;
+		}
+		memcpy(buffer->bytes + offset, data, size);
+		buffer->bytes_size = offset + size;
+	}
+
+	ecs_command_t * command = &buffer->commands[buffer->count];
+	command->kind = kind;
+	command->buffer = (unsigned int) (buffer - state.commands.recording);
+	command->sequence = buffer->count;
+	command->entity = entity;
+	command->type_index = type_index;
+	command->data = offset;
+	++buffer->count;
+	return command;
+}
+
+/* resolves real handles and the deferred spawn handles of the commands being played back */
+static kgfw_entity_t * commands_resolve(kgfw_entity_handle_t handle) {
+	if ((handle >> 32) != 0) {
+		return kgfw_entity_resolve(handle);
+	}
+
+	unsigned long long int buffer = (handle >> 24) & ECS_DEFERRED_BUFFERS_MAX;
+	unsigned long long int spawn = handle & ECS_DEFERRED_SPAWN_MAX;
+	if (spawn == 0 || buffer >= state.commands.count || spawn > state.commands.playing[buffer].spawned_count) {
+		return NULL;
+	}
+
+	return kgfw_entity_resolve(state.commands.playing[buffer].spawned[spawn - 1]);
+}
+
+/* attaches and detaches share a rank so a detach then attach of the same type replaces the component */
+static unsigned int commands_rank(ecs_command_kind_enum kind) {
+	switch (kind) {
+		case ECS_COMMAND_SPAWN:
+			return 0;
+		case ECS_COMMAND_ATTACH:
+		case ECS_COMMAND_DETACH:
+			return 1;
+		default:
+			return 2;
+	}
+}
+
+static int commands_compare(const void * a, const void * b) {
+	const ecs_command_t * x = *(const ecs_command_t * const *) a;
+	const ecs_command_t * y = *(const ecs_command_t * const *) b;
+	unsigned int x_rank = commands_rank(x->kind);
+	unsigned int y_rank = commands_rank(y->kind);
+	if (x_rank != y_rank) {
+		return (x_rank < y_rank) ? -1 : 1;
+	}
+	if (x->type_index != y->type_index) {
+		return (x->type_index < y->type_index) ? -1 : 1;
+	}
+	if (x->buffer != y->buffer) {
+		return (x->buffer < y->buffer) ? -1 : 1;
+	}
+	if (x->sequence != y->sequence) {
+		return (x->sequence < y->sequence) ? -1 : 1;
+	}
+	return 0;
+}
+
+static void commands_play(ecs_command_t * command) {
+	ecs_commands_t * buffer = &state.commands.playing[command->buffer];
+	const void * data = (command->data == ECS_COMMAND_NO_DATA) ? NULL : buffer->bytes + command->data;
+
+	switch (command->kind) {
+		case ECS_COMMAND_SPAWN: {
+			unsigned long long int spawn = (command->entity & ECS_DEFERRED_SPAWN_MAX) - 1;
+			if (spawn >= buffer->spawned_count) {
+				break;
+			}
+			kgfw_entity_t * entity = kgfw_entity_new((const char *) data);
+			buffer->spawned[spawn] = (entity == NULL) ? KGFW_ECS_INVALID_HANDLE : entity->handle;
+			break;
+		}
+		case ECS_COMMAND_ATTACH: {
+			kgfw_entity_t * entity = commands_resolve(command->entity);
+			if (entity != NULL) {
+				entity_attach(entity, command->type_index, data);
+			}
+			break;
+		}
+		case ECS_COMMAND_DETACH: {
+			kgfw_entity_t * entity = commands_resolve(command->entity);
+			kgfw_component_destroy(kgfw_entity_get_component(entity, state.component_types.type_ids[command->type_index]));
+			break;
+		}
+		case ECS_COMMAND_DESTROY: {
+			kgfw_entity_destroy(commands_resolve(command->entity));
+			break;
+		}
+	}
+}
+
+static void system_job(void * data) {
+	system_update(*(unsigned long long int *) data);
+}
+
+/* column of the component inside of its entity's archetype, -1 if it is not stored there */
+static long long int component_column(kgfw_component_t * component) {
+	if (component == NULL || component->entity == NULL || component->entity->components.archetype == NULL) {
+		return -1;
+	}
+
+	archetype_t * archetype = component->entity->components.archetype;
+	long long int index = component_type_index(component->type_id);
+	if (index < 0) {
+		return -1;
+	}
+
+	long long int column = archetype_column(archetype, index);
+	if (column < 0 || archetype_component(archetype, column, component->entity->components.row) != component) {
+		return -1;
+	}
+
+	return column;
+}
+
+/* returns the number of spans, only the first [capacity] are written */
+static unsigned long long int component_spans(unsigned long long int type_index, unsigned long long int since, kgfw_component_span_t * spans, unsigned long long int capacity) {
+	unsigned long long int count = 0;
+	for (archetype_t * archetype = state.archetypes; archetype != NULL; archetype = archetype->next) {
+		long long int column = archetype_column(archetype, type_index);
+		if (column < 0) {
+			continue;
+		}
+
+		for (unsigned long long int c = 0; c < archetype->chunks_count; ++c) {
+			kgfw_component_span_t span;
+			if (!span_fill(&span, archetype, column, c, since)) {
+				continue;
+			}
+			if (count < capacity) {
+				spans[count] = span;
+			}
+			++count;
+		}
+	}
+
+	return count;
+}
+
+/* returns 0 if nothing in the chunk changed since the tick */
+static unsigned char span_fill(kgfw_component_span_t * span, archetype_t * archetype, unsigned long long int column, unsigned long long int chunk, unsigned long long int since) {
+	unsigned long long int row = chunk * archetype->capacity;
+	span->chunk_tick = archetype_chunk_tick(archetype, column, row);
+	if (*span->chunk_tick < since) {
+		return 0;
+	}
+
+	span->components = archetype_component(archetype, column, row);
+	span->entities = archetype_entity(archetype, row);
+	span->count = archetype->chunks[chunk]->count;
+	span->stride = state.component_types.sizes[archetype->types[column]];
+	span->ticks = archetype_tick(archetype, column, row);
+	return 1;
+}
+
+static void span_batch_range(unsigned long long int begin, unsigned long long int end, void * data) {
+	span_batch_t * batch = data;
+	for (unsigned long long int i = begin; i < end; ++i) {
+		batch->func(&batch->spans[i], batch->data);
+	}
+}
+
+static void components_link(unsigned long long int type_index) {
+	kgfw_component_node_t * head = NULL;
+	kgfw_component_node_t * tail = NULL;
+
+	for (archetype_t * a = state.archetypes; a != NULL; a = a->next) {
+		long long int column = archetype_column(a, type_index);
+		if (column < 0) {
+			continue;
+		}
+
+		for (unsigned long long int c = 0; c < a->chunks_count; ++c) {
+			kgfw_component_node_t * nodes = (kgfw_component_node_t *) (((char *) a->chunks[c]) + a->node_offsets[column]);
+			unsigned long long int count = a->chunks[c]->count;
+			for (unsigned long long int i = 0; i + 1 < count; ++i) {
+				nodes[i].next = &nodes[i + 1];
+			}
+			nodes[count - 1].next = NULL;
+
+			if (tail == NULL) {
+				head = nodes;
+			} else {
+				tail->next = nodes;
+			}
+			tail = &nodes[count - 1];
+		}
+	}
+
+	state.components[type_index] = head;
+	state.components_dirty[type_index] = 0;
+}
+
+static void components_dirty(archetype_t * archetype) {
+	for (unsigned long long int i = 0; i < archetype->types_count; ++i) {
+		state.components_dirty[archetype->types[i]] = 1;
+	}
+}
+
+static archetype_t * archetype_get(unsigned long long int * types, unsigned long long int types_count) {
+	for (archetype_t * a = state.archetypes; a != NULL; a = a->next) {
+		if (a->types_count == types_count && memcmp(a->types, types, sizeof(unsigned long long int) * types_count) == 0) {
+			return a;
+		}
+	}
+
+	archetype_t * a = malloc(sizeof(archetype_t));
+	if (a == NULL) {
+		return NULL;
+	}
+
+	memset(a, 0, sizeof(archetype_t));
+	a->types = malloc(sizeof(unsigned long long int) * types_count * 4);
+	if (a->types == NULL) {
+		free(a);
+		return NULL;
+	}
+	a->node_offsets = a->types + types_count;
+	a->offsets = a->node_offsets + types_count;
+	a->ticks_offsets = a->offsets + types_count;
+	a->types_count = types_count;
+	memcpy(a->types, types, sizeof(unsigned long long int) * types_count);
+
+	/* fit as many rows as possible into one chunk, reserving room for column alignment */
+	unsigned long long int row_size = sizeof(kgfw_entity_t *);
+	for (unsigned long long int i = 0; i < types_count; ++i) {
+		row_size += sizeof(kgfw_component_node_t) + state.component_types.sizes[types[i]] + sizeof(unsigned long long int);
+	}
+	unsigned long long int overhead = ECS_ALIGN_UP(sizeof(chunk_t)) + ECS_ALIGN_UP(sizeof(unsigned long long int) * types_count) + ECS_ALIGN * (1 + 3 * types_count);
+	a->capacity = (ECS_CHUNK_SIZE > overhead + row_size) ? (ECS_CHUNK_SIZE - overhead) / row_size : 1;
+
+	unsigned long long int offset = ECS_ALIGN_UP(sizeof(chunk_t));
+	a->chunk_ticks_offset = offset;
+	offset += ECS_ALIGN_UP(sizeof(unsigned long long int) * types_count);
+	a->entities_offset = offset;
+	offset += ECS_ALIGN_UP(sizeof(kgfw_entity_t *) * a->capacity);
+	for (unsigned long long int i = 0; i < types_count; ++i) {
+		a->node_offsets[i] = offset;
+		offset += ECS_ALIGN_UP(sizeof(kgfw_component_node_t) * a->capacity);
+	}
+	for (unsigned long long int i = 0; i < types_count; ++i) {
+		a->offsets[i] = offset;
+		offset += ECS_ALIGN_UP(state.component_types.sizes[types[i]] * a->capacity);
+	}
+	for (unsigned long long int i = 0; i < types_count; ++i) {
+		a->ticks_offsets[i] = offset;
+		offset += ECS_ALIGN_UP(sizeof(unsigned long long int) * a->capacity);
+	}
+	a->chunk_size = offset;
+
+	a->next = state.archetypes;
+	state.archetypes = a;
+	return a;
+}
+
+/* find the archetype of [source] with [type_index] added or removed, NULL archetype means no components */
+static int archetype_step(archetype_t * source, unsigned long long int type_index, unsigned char add, archetype_t ** out_archetype) {
+	if (source != NULL && type_index < source->edges_count) {
+		archetype_t * cached = add ? source->edges[type_index].add : source->edges[type_index].remove;
+		if (cached != NULL) {
+			*out_archetype = cached;
+			return 0;
+		}
+	}
+
+	unsigned long long int stack_types[32];
+	unsigned long long int * types = stack_types;
+	unsigned long long int source_count = (source == NULL) ? 0 : source->types_count;
+	unsigned long long int count = 0;
+
+	if (source_count + 1 > sizeof(stack_types) / sizeof(stack_types[0])) {
+		types = malloc(sizeof(unsigned long long int) * (source_count + 1));
+		if (types == NULL) {
+			return 1;
+		}
+	}
+
+	unsigned char inserted = !add;
+	for (unsigned long long int i = 0; i < source_count; ++i) {
+		if (!inserted && source->types[i] > type_index) {
+			types[count++] = type_index;
+			inserted = 1;
+		}
+		if (source->types[i] != type_index) {
+			types[count++] = source->types[i];
+		}
+	}
+	if (!inserted) {
+		types[count++] = type_index;
+	}
+
+	int r = 0;
+	*out_archetype = NULL;
+	if (count != 0) {
+		*out_archetype = archetype_get(types, count);
+		if (*out_archetype == NULL) {
+			r = 2;
+		}
+	}
+
+	if (types != stack_types) {
+		free(types);
+	}
+
+	/* a failed cache only costs the lookup next time */
+	if (r == 0 && source != NULL && *out_archetype != NULL) {
+		if (type_index >= source->edges_count) {
+			archetype_edge_t * edges = realloc(source->edges, sizeof(archetype_edge_t) * state.component_types.count);
+			if (edges != NULL) {
+				memset(edges + source->edges_count, 0, sizeof(archetype_edge_t) * (state.component_types.count - source->edges_count));
+				source->edges = edges;
+				source->edges_count = state.component_types.count;
+			}
+		}
+		if (type_index < source->edges_count) {
+			if (add) {
+				source->edges[type_index].add = *out_archetype;
+			} else {
+				source->edges[type_index].remove = *out_archetype;
+			}
+		}
+	}
+	return r;
+}
+
+static long long int archetype_column(archetype_t * archetype, unsigned long long int type_index) {
+	long long int low = 0;
+	long long int high = (long long int) archetype->types_count - 1;
+	while (low <= high) {
+		long long int mid = (low + high) / 2;
+		if (archetype->types[mid] == type_index) {
+			return mid;
+		} else if (archetype->types[mid] < type_index) {
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	return -1;
+}
+
+static kgfw_component_t * archetype_component(archetype_t * archetype, unsigned long long int column, unsigned long long int row) {
+	char * chunk = (char *) archetype->chunks[row / archetype->capacity];
+	return (kgfw_component_t *) (chunk + archetype->offsets[column] + (row % archetype->capacity) * state.component_types.sizes[archetype->types[column]]);
+}
+
+static kgfw_entity_t ** archetype_entity(archetype_t * archetype, unsigned long long int row) {
+	char * chunk = (char *) archetype->chunks[row / archetype->capacity];
+	return ((kgfw_entity_t **) (chunk + archetype->entities_offset)) + (row % archetype->capacity);
+}
+
+static unsigned long long int * archetype_tick(archetype_t * archetype, unsigned long long int column, unsigned long long int row) {
+	char * chunk = (char *) archetype->chunks[row / archetype->capacity];
+	return ((unsigned long long int *) (chunk + archetype->ticks_offsets[column])) + (row % archetype->capacity);
+}
+
+static unsigned long long int * archetype_chunk_tick(archetype_t * archetype, unsigned long long int column, unsigned long long int row) {
+	char * chunk = (char *) archetype->chunks[row / archetype->capacity];
+	return ((unsigned long long int *) (chunk + archetype->chunk_ticks_offset)) + column;
+}
+
+static void archetype_touch(archetype_t * archetype, unsigned long long int column, unsigned long long int row, unsigned long long int tick) {
+	*archetype_tick(archetype, column, row) = tick;
+	unsigned long long int * chunk_tick = archetype_chunk_tick(archetype, column, row);
+	if (*chunk_tick < tick) {
+		*chunk_tick = tick;
+	}
+}
+
+static chunk_t * chunk_new(archetype_t * archetype) {
+	chunk_t * chunk = NULL;
+	if (archetype->chunk_size <= ECS_CHUNK_SIZE && state.chunk_pool.free != NULL) {
+		chunk = (chunk_t *) state.chunk_pool.free;
+		state.chunk_pool.free = state.chunk_pool.free->next;
+		--state.chunk_pool.count;
+	} else {
+		chunk = malloc((archetype->chunk_size <= ECS_CHUNK_SIZE) ? ECS_CHUNK_SIZE : archetype->chunk_size);
+	}
+	if (chunk == NULL) {
+		return NULL;
+	}
+
+	chunk->count = 0;
+	chunk->size = archetype->chunk_size;
+	memset(((char *) chunk) + archetype->chunk_ticks_offset, 0, sizeof(unsigned long long int) * archetype->types_count);
+
+	/* node to component mapping never changes for a chunk, only the links do */
+	for (unsigned long long int i = 0; i < archetype->types_count; ++i) {
+		kgfw_component_node_t * nodes = (kgfw_component_node_t *) (((char *) chunk) + archetype->node_offsets[i]);
+		unsigned long long int size = state.component_types.sizes[archetype->types[i]];
+		for (unsigned long long int j = 0; j < archetype->capacity; ++j) {
+			nodes[j].component = (kgfw_component_t *) (((char *) chunk) + archetype->offsets[i] + j * size);
+			nodes[j].next = NULL;
+		}
+	}
+
+	return chunk;
+}
+
+/* returns the new row or -1 on error, components of the row are left uninitialized */
+/* allocates the chunks needed to push [rows] more rows without allocating, trim once done pushing */
+static int archetype_reserve(archetype_t * archetype, unsigned long long int rows) {
+	unsigned long long int needed = (archetype->count + rows + archetype->capacity - 1) / archetype->capacity;
+	if (needed > archetype->chunks_capacity) {
+		unsigned long long int capacity = (archetype->chunks_capacity == 0) ? 4 : archetype->chunks_capacity;
+		while (capacity < needed) {
+			capacity *= 2;
+		}
+		chunk_t ** chunks = realloc(archetype->chunks, sizeof(chunk_t *) * capacity);
+		if (chunks == NULL) {
+			return 1;
+		}
+		archetype->chunks = chunks;
+		archetype->chunks_capacity = capacity;
+	}
+
+	while (archetype->chunks_count < needed) {
+		chunk_t * chunk = chunk_new(archetype);
+		if (chunk == NULL) {
+			archetype_trim(archetype);
+			return 1;
+		}
+		archetype->chunks[archetype->chunks_count] = chunk;
+		++archetype->chunks_count;
+	}
+
+	return 0;
+}
+
+/* releases reserved chunks that stayed empty, archetype_remove expects only the last chunk to be partly filled */
+static void archetype_trim(archetype_t * archetype) {
+	while (archetype->chunks_count > 0 && archetype->chunks[archetype->chunks_count - 1]->count == 0) {
+		chunk_release(archetype->chunks[archetype->chunks_count - 1]);
+		--archetype->chunks_count;
+	}
+}
+
+static long long int archetype_push(archetype_t * archetype, kgfw_entity_t * entity) {
+	unsigned long long int row = archetype->count;
+	if (row / archetype->capacity == archetype->chunks_count) {
+		if (archetype->chunks_count == archetype->chunks_capacity) {
+			unsigned long long int capacity = (archetype->chunks_capacity == 0) ? 4 : archetype->chunks_capacity * 2;
+			chunk_t ** chunks = realloc(archetype->chunks, sizeof(chunk_t *) * capacity);
+			if (chunks == NULL) {
+				return -1;
+			}
+			archetype->chunks = chunks;
+			archetype->chunks_capacity = capacity;
+		}
+
+		chunk_t * chunk = chunk_new(archetype);
+		if (chunk == NULL) {
+			return -1;
+		}
+		archetype->chunks[archetype->chunks_count] = chunk;
+		++archetype->chunks_count;
+	}
+
+	++archetype->chunks[row / archetype->capacity]->count;
+	++archetype->count;
+	*archetype_entity(archetype, row) = entity;
+	/* new rows count as changed */
+	for (unsigned long long int i = 0; i < archetype->types_count; ++i) {
+		archetype_touch(archetype, i, row, state.tick);
+	}
+	components_dirty(archetype);
+
+	return (long long int) row;
+}
+
+/* moves the last row into [row], does not call destroy on the removed components */
+static void archetype_remove(archetype_t * archetype, unsigned long long int row) {
+	unsigned long long int last = archetype->count - 1;
+	if (row != last) {
+		kgfw_entity_t * moved = *archetype_entity(archetype, last);
+		for (unsigned long long int i = 0; i < archetype->types_count; ++i) {
+			memcpy(archetype_component(archetype, i, row), archetype_component(archetype, i, last), state.component_types.sizes[archetype->types[i]]);
+			archetype_touch(archetype, i, row, *archetype_tick(archetype, i, last));
+		}
+		*archetype_entity(archetype, row) = moved;
+		moved->components.row = row;
+	}
+
+	chunk_t * chunk = archetype->chunks[last / archetype->capacity];
+	--chunk->count;
+	--archetype->count;
+	if (chunk->count == 0) {
+		chunk_release(chunk);
+		--archetype->chunks_count;
+	}
+	components_dirty(archetype);
+}
+
+static void archetypes_free(void) {
+	while (state.archetypes != NULL) {
+		archetype_t * a = state.archetypes;
+		state.archetypes = a->next;
+
+		for (unsigned long long int i = 0; i < a->chunks_count; ++i) {
+			free(a->chunks[i]);
+		}
+		if (a->chunks != NULL) {
+			free(a->chunks);
+		}
+		if (a->edges != NULL) {
+			free(a->edges);
+		}
+		free(a->types);
+		free(a);
+	}
+}
+
+static void chunk_release(chunk_t * chunk) {
+	if (chunk->size > ECS_CHUNK_SIZE) {
+		free(chunk);
+		return;
+	}
+
+	chunk_block_t * block = (chunk_block_t *) chunk;
+	block->next = state.chunk_pool.free;
+	state.chunk_pool.free = block;
+	++state.chunk_pool.count;
+}
+
+static void chunk_pool_free(void) {
+	while (state.chunk_pool.free != NULL) {
+		chunk_block_t * next = state.chunk_pool.free->next;
+		free(state.chunk_pool.free);
+		state.chunk_pool.free = next;
+	}
+	state.chunk_pool.count = 0;
+}
+
+/* moves the entity's components into [archetype], keeping the components both archetypes share */
+static int entity_move(kgfw_entity_t * entity, archetype_t * archetype) {
+	archetype_t * source = entity->components.archetype;
+	unsigned long long int source_row = entity->components.row;
+	long long int row = 0;
+
+	if (archetype != NULL) {
+		row = archetype_push(archetype, entity);
+		if (row < 0) {
+			return 1;
+		}
+
+		if (source != NULL) {
+			for (unsigned long long int i = 0, j = 0; i < source->types_count && j < archetype->types_count;) {
+				if (source->types[i] == archetype->types[j]) {
+					memcpy(archetype_component(archetype, j, row), archetype_component(source, i, source_row), state.component_types.sizes[source->types[i]]);
+					archetype_touch(archetype, j, row, *archetype_tick(source, i, source_row));
+					++i;
+					++j;
+				} else if (source->types[i] < archetype->types[j]) {
+					++i;
+				} else {
+					++j;
+				}
+			}
+		}
+	}
+
+	if (source != NULL) {
+		archetype_remove(source, source_row);
+	}
+
+	entity->components.archetype = archetype;
+	entity->components.row = (unsigned long long int) row;
+	entity->components.count = (archetype == NULL) ? 0 : archetype->types_count;
+	return 0;
+}
+
+static void snapshot_write_bytes(char * buffer, unsigned long long int * offset, const void * data, unsigned long long int size) {
+	if (buffer != NULL) {
+		memcpy(buffer + *offset, data, size);
+	}
+	*offset += size;
+}
+
+/* pads to the next 8 byte boundary with zeroes */
+static void snapshot_write_pad(char * buffer, unsigned long long int * offset) {
+	unsigned long long int padded = ECS_SNAPSHOT_ALIGN_UP(*offset);
+	if (buffer != NULL) {
+		memset(buffer + *offset, 0, padded - *offset);
+	}
+	*offset = padded;
+}
+
+static void snapshot_write_ull(char * buffer, unsigned long long int * offset, unsigned long long int value) {
+	snapshot_write_bytes(buffer, offset, &value, sizeof(unsigned long long int));
+}
+
+static void snapshot_write_name(char * buffer, unsigned long long int * offset, const char * name) {
+	unsigned long long int length = strlen(name);
+	snapshot_write_ull(buffer, offset, length);
+	snapshot_write_bytes(buffer, offset, name, length + 1);
+	snapshot_write_pad(buffer, offset);
+}
+
+static void snapshot_write_entity(char * buffer, unsigned long long int * offset, kgfw_entity_t * entity) {
+	snapshot_write_ull(buffer, offset, entity->id);
+	snapshot_write_bytes(buffer, offset, &entity->transform, sizeof(kgfw_transform_t));
+	snapshot_write_pad(buffer, offset);
+	snapshot_write_name(buffer, offset, entity->name);
+}
+
+/* returns the snapshot size, only measures if buffer is NULL */
+static unsigned long long int snapshot_write(char * buffer) {
+	unsigned long long int loose = 0;
+	unsigned long long int entities = 0;
+	for (unsigned int i = 0; i < state.entities.count; ++i) {
+		entity_slot_t * slot = entity_slot(i);
+		if (slot->alive) {
+			++entities;
+			if (slot->entity.components.archetype == NULL) {
+				++loose;
+			}
+		}
+	}
+
+	unsigned long long int records = (loose > 0) ? 1 : 0;
+	for (archetype_t * a = state.archetypes; a != NULL; a = a->next) {
+		if (a->count > 0) {
+			++records;
+		}
+	}
+
+	unsigned long long int offset = 0;
+	snapshot_write_ull(buffer, &offset, ECS_SNAPSHOT_MAGIC);
+	snapshot_write_ull(buffer, &offset, ECS_SNAPSHOT_VERSION);
+	snapshot_write_ull(buffer, &offset, state.component_types.count);
+	snapshot_write_ull(buffer, &offset, records);
+	snapshot_write_ull(buffer, &offset, entities);
+
+	for (unsigned long long int i = 0; i < state.component_types.count; ++i) {
+		snapshot_write_ull(buffer, &offset, state.component_types.sizes[i]);
+		snapshot_write_name(buffer, &offset, state.component_types.names[i]);
+	}
+
+	/* entities without components */
+	if (loose > 0) {
+		snapshot_write_ull(buffer, &offset, 0);
+		snapshot_write_ull(buffer, &offset, loose);
+		for (unsigned int i = 0; i < state.entities.count; ++i) {
+			entity_slot_t * slot = entity_slot(i);
+			if (slot->alive && slot->entity.components.archetype == NULL) {
+				snapshot_write_entity(buffer, &offset, &slot->entity);
+			}
+		}
+	}
+
+	for (archetype_t * a = state.archetypes; a != NULL; a = a->next) {
+		if (a->count == 0) {
+			continue;
+		}
+
+		snapshot_write_ull(buffer, &offset, a->types_count);
+		snapshot_write_ull(buffer, &offset, a->count);
+		snapshot_write_bytes(buffer, &offset, a->types, sizeof(unsigned long long int) * a->types_count);
+		for (unsigned long long int row = 0; row < a->count; ++row) {
+			snapshot_write_entity(buffer, &offset, *archetype_entity(a, row));
+		}
+
+		/* columns are stored whole, one chunk at a time */
+		for (unsigned long long int i = 0; i < a->types_count; ++i) {
+			for (unsigned long long int c = 0; c < a->chunks_count; ++c) {
+				snapshot_write_bytes(buffer, &offset, archetype_component(a, i, c * a->capacity), state.component_types.sizes[a->types[i]] * a->chunks[c]->count);
+			}
+			snapshot_write_pad(buffer, &offset);
+		}
+	}
+
+	return offset;
+}
+
+/* returns a pointer to the next [size] bytes and skips past them (padded), NULL if the buffer is too short */
+static const char * snapshot_read_bytes(const char * buffer, unsigned long long int size, unsigned long long int * offset, unsigned long long int bytes) {
+	if (*offset > size || bytes > size - *offset) {
+		return NULL;
+	}
+
+	const char * data = buffer + *offset;
+	*offset = ECS_SNAPSHOT_ALIGN_UP(*offset + bytes);
+	return data;
+}
+
+static int snapshot_read(const char * buffer, unsigned long long int size, unsigned long long int * offset, unsigned long long int * value) {
+	const char * data = snapshot_read_bytes(buffer, size, offset, sizeof(unsigned long long int));
+	if (data == NULL) {
+		return 1;
+	}
+
+	memcpy(value, data, sizeof(unsigned long long int));
+	return 0;
+}
+
+static int snapshot_read_name(const char * buffer, unsigned long long int size, unsigned long long int * offset, const char ** name) {
+	unsigned long long int length = 0;
+	if (snapshot_read(buffer, size, offset, &length) != 0 || length >= size) {
+		return 1;
+	}
+
+	*name = snapshot_read_bytes(buffer, size, offset, length + 1);
+	if (*name == NULL || (*name)[length] != '\0') {
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+	reads one record (the entities of one archetype). if sorted is NULL the record is only checked,
+	otherwise its entities are spawned and sorted is used as scratch space.
+	returns 1 if the record is malformed and 3 if out of memory
+*/
+static int snapshot_record(const char * buffer, unsigned long long int size, unsigned long long int * offset, const unsigned long long int * types, unsigned long long int types_count, unsigned long long int * sorted) {
+	unsigned char check = (sorted == NULL);
+	unsigned long long int count = 0;
+	unsigned long long int record_types_count = 0;
+	if (snapshot_read(buffer, size, offset, &record_types_count) != 0 || snapshot_read(buffer, size, offset, &count) != 0 || record_types_count > types_count) {
+		return 1;
+	}
+
+	const char * record_types = snapshot_read_bytes(buffer, size, offset, sizeof(unsigned long long int) * record_types_count);
+	if (record_types == NULL) {
+		return 1;
+	}
+
+	for (unsigned long long int i = 0; check && i < record_types_count; ++i) {
+		unsigned long long int type = snapshot_record_type(record_types, i);
+		if (type >= types_count) {
+			return 1;
+		}
+		/* duplicate types would not fit into any archetype */
+		for (unsigned long long int j = 0; j < i; ++j) {
+			if (types[snapshot_record_type(record_types, j)] == types[type]) {
+				return 1;
+			}
+		}
+	}
+
+	archetype_t * archetype = NULL;
+	if (!check && record_types_count > 0) {
+		/* registry indices may be ordered differently than when the snapshot was taken */
+		for (unsigned long long int i = 0; i < record_types_count; ++i) {
+			unsigned long long int index = types[snapshot_record_type(record_types, i)];
+			unsigned long long int j = i;
+			for (; j > 0 && sorted[j - 1] > index; --j) {
+				sorted[j] = sorted[j - 1];
+			}
+			sorted[j] = index;
+		}
+
+		archetype = archetype_get(sorted, record_types_count);
+		if (archetype == NULL || archetype_reserve(archetype, count) != 0) {
+			return 3;
+		}
+	}
+
+	unsigned long long int begin = (archetype == NULL) ? 0 : archetype->count;
+	unsigned long long int spawned = 0;
+	unsigned char failed = 0;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		unsigned long long int id = 0;
+		const char * transform = NULL;
+		const char * name = NULL;
+		if (snapshot_read(buffer, size, offset, &id) != 0 || (transform = snapshot_read_bytes(buffer, size, offset, sizeof(kgfw_transform_t))) == NULL || snapshot_read_name(buffer, size, offset, &name) != 0) {
+			return 1;
+		}
+		if (check || failed) {
+			continue;
+		}
+
+		kgfw_entity_t * e = entity_spawn(name, id);
+		if (e == NULL) {
+			failed = 1;
+			continue;
+		}
+		memcpy(&e->transform, transform, sizeof(kgfw_transform_t));
+		if (archetype != NULL && entity_move(e, archetype) != 0) {
+			kgfw_entity_destroy(e);
+			failed = 1;
+			continue;
+		}
+		++spawned;
+	}
+
+	if (archetype != NULL && failed) {
+		archetype_trim(archetype);
+	}
+
+	for (unsigned long long int i = 0; i < record_types_count; ++i) {
+		unsigned long long int index = types[snapshot_record_type(record_types, i)];
+		unsigned long long int column_size = state.component_types.sizes[index];
+		if (column_size != 0 && count > size / column_size) {
+			return 1;
+		}
+		const char * data = snapshot_read_bytes(buffer, size, offset, column_size * count);
+		if (data == NULL) {
+			return 1;
+		}
+		if (archetype == NULL) {
+			continue;
+		}
+
+		/* columns are copied a chunk at a time, then the fields that only make sense in this process are fixed up */
+		unsigned long long int column = (unsigned long long int) archetype_column(archetype, index);
+		for (unsigned long long int row = begin; row < begin + spawned;) {
+			unsigned long long int run = archetype->capacity - (row % archetype->capacity);
+			if (run > begin + spawned - row) {
+				run = begin + spawned - row;
+			}
+			memcpy(archetype_component(archetype, column, row), data + (row - begin) * column_size, run * column_size);
+			row += run;
+		}
+
+		kgfw_component_t * type_data = state.component_types.datas[index];
+		for (unsigned long long int row = begin; row < begin + spawned; ++row) {
+			kgfw_component_t * c = archetype_component(archetype, column, row);
+			c->update = type_data->update;
+			c->start = type_data->start;
+			c->destroy = type_data->destroy;
+			/* the same snapshot may be restored more than once, every restored component is a new instance */
+			c->instance_id = kgfw_uuid_gen();
+			c->type_id = state.component_types.type_ids[index];
+			c->entity = *archetype_entity(archetype, row);
+		}
+	}
+
+	if (archetype != NULL && spawned > 0) {
+		/* the batch's handles are gathered before any start can move rows around */
+		kgfw_entity_handle_t * handles = malloc(sizeof(kgfw_entity_handle_t) * spawned);
+		if (handles == NULL) {
+			return 3;
+		}
+		for (unsigned long long int j = 0; j < spawned; ++j) {
+			handles[j] = (*archetype_entity(archetype, begin + j))->handle;
+		}
+		entities_start(archetype, handles, spawned);
+		free(handles);
+	}
+
+	return failed ? 3 : 0;
+}
+
+static unsigned long long int snapshot_record_type(const char * record_types, unsigned long long int i) {
+	unsigned long long int type = 0;
+	memcpy(&type, record_types + sizeof(unsigned long long int) * i, sizeof(unsigned long long int));
+	return type;
+}
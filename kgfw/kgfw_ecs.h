@@ -36,49 +36,183 @@ struct kgfw_component_node {
 
 typedef struct kgfw_component_collection {
 	unsigned long long int count;
-	kgfw_component_node_t * handles;
+	/* archetype chunk storage holding the entity's components, owned by ECS system */
+	void * archetype;
+	/* row of the entity inside of its archetype */
+	unsigned long long int row;
 } kgfw_component_collection_t;
 
+/* generational entity handle, low 32 bits are the slot index and high 32 bits the slot generation */
+typedef unsigned long long int kgfw_entity_handle_t;
+
 typedef struct kgfw_entity {
 	/* entity id */
 	kgfw_uuid_t id;
-	/* heap-allocated c-string owned by ECS system */
+	/* stays unique for the lifetime of the ECS system, unlike the entity's address */
+	kgfw_entity_handle_t handle;
+	/* c-string owned by ECS system */
 	const char * name;
 	kgfw_transform_t transform;
+	/* ECS tick the transform was last marked changed at */
+	unsigned long long int transform_tick;
 	kgfw_component_collection_t components;
 } kgfw_entity_t;
 
+/*
+	component types a system touches besides the types bound to it (which are always written).
+	systems whose accesses do not conflict are updated in parallel on kgfw_jobs workers, so their
+	update must not create/destroy entities or attach/destroy components
+*/
+typedef struct kgfw_system_access {
+	const kgfw_uuid_t * reads;
+	unsigned long long int reads_count;
+	const kgfw_uuid_t * writes;
+	unsigned long long int writes_count;
+} kgfw_system_access_t;
+
+/*
+	components of one type stored back to back inside of one archetype chunk.
+	entities[i] owns the component at KGFW_COMPONENT_SPAN_AT(span, i)
+*/
+typedef struct kgfw_component_span {
+	kgfw_component_t * components;
+	kgfw_entity_t ** entities;
+	unsigned long long int count;
+	/* component size in bytes */
+	unsigned long long int stride;
+	/* ECS tick each component was last marked changed at */
+	unsigned long long int * ticks;
+	/* newest of ticks (and of any rows that were in the chunk before) */
+	unsigned long long int * chunk_tick;
+} kgfw_component_span_t;
+
+#define KGFW_COMPONENT_SPAN_AT(span, i) ((kgfw_component_t *) (((char *) (span)->components) + (i) * (span)->stride))
+#define KGFW_COMPONENT_SPAN_CHANGED(span, i, since) ((span)->ticks[(i)] >= (since))
+
+typedef void (*kgfw_component_span_f)(kgfw_component_span_t * span, void * data);
+
 /* implementation of an ECS system */
 struct kgfw_system {
 	kgfw_system_update_f update;
 	kgfw_system_start_f start;
 	kgfw_system_destroy_f destroy;
+	/* set by ECS system after every update, pass as since to only visit what changed in between */
+	unsigned long long int last_tick;
 };
 
 #define KGFW_ECS_INVALID_ID 0
+#define KGFW_ECS_INVALID_HANDLE 0
 
 KGFW_PUBLIC int kgfw_ecs_init(void);
 KGFW_PUBLIC void kgfw_ecs_deinit(void);
 KGFW_PUBLIC void kgfw_ecs_update(void);
+/* current change tick, anything marked changed from now on is changed since this tick */
+KGFW_PUBLIC unsigned long long int kgfw_ecs_tick(void);
 
 /* if name == NULL, the name of the entity will be "Entity [entity.id]" */
 KGFW_PUBLIC kgfw_entity_t * kgfw_entity_new(const char * name);
 /* if name == NULL, the name of the entity will be "Entity [entity.id]" */
 KGFW_PUBLIC kgfw_entity_t * kgfw_entity_copy(const char * name, kgfw_entity_t * source);
+/*
+	spawns count copies of prefab, each with the prefab's transform and its own copy of every component.
+	the batch is stored back to back and start is called one component type at a time over the whole batch.
+	if name == NULL every entity gets the default name. entities (may be NULL) receives the spawned entities,
+	NULL for any destroyed by a start callback. returns the number spawned, less than count on error
+ */
+KGFW_PUBLIC unsigned long long int kgfw_entity_instantiate(kgfw_entity_t * prefab, const char * name, unsigned long long int count, kgfw_entity_t ** entities);
+/* while kgfw_ecs_update is updating systems the destruction is deferred like kgfw_ecs_defer_destroy */
 KGFW_PUBLIC void kgfw_entity_destroy(kgfw_entity_t * entity);
 KGFW_PUBLIC kgfw_entity_t * kgfw_entity_get(kgfw_uuid_t id);
 KGFW_PUBLIC kgfw_entity_t * kgfw_entity_get_via_name(const char * name);
+/* returns NULL if the entity the handle refers to was destroyed */
+KGFW_PUBLIC kgfw_entity_t * kgfw_entity_resolve(kgfw_entity_handle_t handle);
 KGFW_PUBLIC kgfw_component_t * kgfw_entity_get_component(kgfw_entity_t * entity, kgfw_uuid_t type_id);
+/* also schedules the world matrices of the entity and its children to be recomputed by the next kgfw_ecs_update */
+KGFW_PUBLIC void kgfw_entity_mark_transform_changed(kgfw_entity_t * entity);
+/*
+	parent == NULL makes entity a root again. a child's transform is relative to its parent,
+	destroying an entity hands its children to its own parent.
+	returns non-zero on error or if parent is entity or one of its descendants
+ */
+KGFW_PUBLIC int kgfw_entity_set_parent(kgfw_entity_t * entity, kgfw_entity_t * parent);
+KGFW_PUBLIC kgfw_entity_t * kgfw_entity_get_parent(kgfw_entity_t * entity);
+/* world matrix as of the last kgfw_ecs_update, entities that were never parented just use their own transform */
+KGFW_PUBLIC void kgfw_entity_world_matrix(kgfw_entity_t * entity, mat4x4 out_m);
+/* every entity that was ever parented in depth-first order, datas are the entities. only read it outside of kgfw_ecs_update */
+KGFW_PUBLIC kgfw_transform_hierarchy_t * kgfw_ecs_transforms(void);
 
 /*
 	default component system_id is 0 (only update, start, and destroy function pointers)
 	returns KGFW_ECS_INVALID_ID on error
  */
 KGFW_PUBLIC kgfw_uuid_t kgfw_component_construct(const char * name, unsigned long long int component_size, void * component_data, kgfw_uuid_t system_id);
-/* returns KGFW_ECS_INVALID_ID on error */
-KGFW_PUBLIC kgfw_uuid_t kgfw_system_construct(const char * name, unsigned long long int system_size, void * system_data);
+/*
+	if access == NULL the system's access is undeclared and it runs alone on the main thread
+	returns KGFW_ECS_INVALID_ID on error
+ */
+KGFW_PUBLIC kgfw_uuid_t kgfw_system_construct(const char * name, unsigned long long int system_size, void * system_data, const kgfw_system_access_t * access);
+/*
+	components are stored by value in archetype chunks (one column per component type), so any
+	component pointer is only valid until the next attach/destroy of a component or entity in the
+	same archetype. hold on to the entity and use kgfw_entity_get_component to get it again.
+	while kgfw_ecs_update is updating systems, attaching and destroying are deferred like
+	kgfw_ecs_defer_attach and kgfw_ecs_defer_detach, and attaching returns NULL.
+	returns NULL on error or if the entity already has a component of that type
+ */
 KGFW_PUBLIC kgfw_component_t * kgfw_entity_attach_component(kgfw_entity_t * entity, kgfw_uuid_t type_id);
 KGFW_PUBLIC void kgfw_component_destroy(kgfw_component_t * component);
+/*
+	change detection is opt-in: writers mark what they changed, readers compare against a tick
+	they saved earlier (kgfw_ecs_tick or kgfw_system.last_tick). new components count as changed
+*/
+KGFW_PUBLIC void kgfw_component_mark_changed(kgfw_component_t * component);
+KGFW_PUBLIC unsigned char kgfw_component_changed_since(kgfw_component_t * component, unsigned long long int since);
+KGFW_PUBLIC void kgfw_component_span_mark_changed(kgfw_component_span_t * span, unsigned long long int index);
+/*
+	calls func once per archetype chunk holding components of type_id.
+	func must not create/destroy entities or attach/destroy components
+	returns the number of components visited
+ */
+KGFW_PUBLIC unsigned long long int kgfw_ecs_each(kgfw_uuid_t type_id, kgfw_component_span_f func, void * data);
+/* same as kgfw_ecs_each but spans are spread over kgfw_jobs workers, func only touches its own span */
+KGFW_PUBLIC unsigned long long int kgfw_ecs_each_parallel(kgfw_uuid_t type_id, kgfw_component_span_f func, void * data);
+/*
+	same as kgfw_ecs_each but chunks without a component changed since the tick are skipped.
+	spans may still hold unchanged components, check them with KGFW_COMPONENT_SPAN_CHANGED
+ */
+KGFW_PUBLIC unsigned long long int kgfw_ecs_each_changed(kgfw_uuid_t type_id, unsigned long long int since, kgfw_component_span_f func, void * data);
+KGFW_PUBLIC unsigned long long int kgfw_ecs_each_changed_parallel(kgfw_uuid_t type_id, unsigned long long int since, kgfw_component_span_f func, void * data);
+/*
+	deferred structural changes, safe to record from systems updating in parallel (any kgfw_jobs thread).
+	commands are played back after every system level of kgfw_ecs_update and by kgfw_ecs_commands_flush.
+	a playback runs all spawns first, then attaches and detaches grouped by component type, then destroys.
+	attaches and detaches of the same type keep the order they were recorded in (per recording thread),
+	so a detach followed by an attach replaces the component
+ */
+/* the returned handle is only valid in other deferred commands until the next playback */
+KGFW_PUBLIC kgfw_entity_handle_t kgfw_ecs_defer_spawn(const char * name);
+/* the defer functions return non-zero on error */
+KGFW_PUBLIC int kgfw_ecs_defer_destroy(kgfw_entity_handle_t entity);
+/* if component_data == NULL the type's template is copied, otherwise it is copied by value (type size) */
+KGFW_PUBLIC int kgfw_ecs_defer_attach(kgfw_entity_handle_t entity, kgfw_uuid_t type_id, const void * component_data);
+KGFW_PUBLIC int kgfw_ecs_defer_detach(kgfw_entity_handle_t entity, kgfw_uuid_t type_id);
+/* call from the main thread while no systems are updating */
+KGFW_PUBLIC void kgfw_ecs_commands_flush(void);
+/*
+	writes every entity (id, name, transform) and the raw bytes of every component into buffer.
+	returns the snapshot size in bytes, nothing is written if buffer == NULL or size is too small
+ */
+KGFW_PUBLIC unsigned long long int kgfw_ecs_snapshot(void * buffer, unsigned long long int size);
+/*
+	adds the entities of a snapshot to the world, destroying every existing entity first if replace != 0.
+	component types are matched by name and must be registered with the same size. component function
+	pointers, type ids and entity pointers are taken from this process and instance ids are regenerated,
+	any other pointer inside of a component is restored as is. start is called on every restored component.
+	entity ids already in use are regenerated
+	returns 0 on success, 1 if the snapshot is malformed, 2 if a component type does not match and
+	3 if out of memory (the world is then partially restored)
+ */
+KGFW_PUBLIC int kgfw_ecs_restore(const void * buffer, unsigned long long int size, unsigned char replace);
 KGFW_PUBLIC const char * kgfw_component_type_get_name(kgfw_uuid_t type_id);
 KGFW_PUBLIC kgfw_uuid_t kgfw_component_type_get_id(const char * type_name);
 
@@ -0,0 +1,317 @@
+#include "kgfw_event.h"
+#include "kgfw_jobs.h"
+#include "kgfw_thread.h"
+#include "kgfw_hash.h"
+#include "kgfw_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define EVENT_TYPES_MAX 256
+/* events a buffer starts out with, buffers double whenever a frame emits more */
+#define EVENT_CAPACITY_MIN 64
+
+typedef struct event_buffer {
+	unsigned char * events;
+	unsigned long long int count;
+	unsigned long long int capacity;
+} event_buffer_t;
+
+typedef struct event_subscriber {
+	kgfw_event_batch_f func;
+	void * data;
+	unsigned char parallel;
+} event_subscriber_t;
+
+typedef struct event_type {
+	char * name;
+	kgfw_hash_t hash;
+	unsigned long long int size;
+	/*
+		emits append to recording under the mutex, dispatch swaps it with dispatching so
+		subscribers read a buffer nothing writes to, and can emit more events themselves
+	*/
+	event_buffer_t recording;
+	event_buffer_t dispatching;
+	kgfw_mutex_t mutex;
+	event_subscriber_t * subscribers;
+	unsigned long long int subscribers_count;
+} event_type_t;
+
+/* one batch for one parallel subscriber */
+typedef struct event_job {
+	kgfw_event_batch_f func;
+	void * data;
+	const void * events;
+	unsigned long long int count;
+} event_job_t;
+
+struct {
+	/* type n is types[n - 1], types never move so emits only lock their own type */
+	event_type_t * types[EVENT_TYPES_MAX];
+	unsigned long long int count;
+
+	/* [jobs_capacity], reused by every dispatch */
+	kgfw_job_t * jobs;
+	event_job_t * jobs_data;
+	unsigned long long int jobs_capacity;
+
+	unsigned char running;
+	unsigned char dispatching;
+} static state = {
+	{ NULL },
+	0,
+	NULL,
+	NULL,
+	0,
+	0,
+	0,
+};
+
+static int event_buffer_grow(event_buffer_t * buffer, unsigned long long int size);
+static int event_jobs_reserve(unsigned long long int count);
+static void event_job(void * data);
+
+int kgfw_event_init(void) {
+	state.running = 1;
+	return 0;
+}
+
+void kgfw_event_deinit(void) {
+	for (unsigned long long int i = 0; i < state.count; ++i) {
+		event_type_t * type = state.types[i];
+		kgfw_mutex_destroy(&type->mutex);
+		if (type->recording.events != NULL) {
+			free(type->recording.events);
+		}
+		if (type->dispatching.events != NULL) {
+			free(type->dispatching.events);
+		}
+		if (type->subscribers != NULL) {
+			free(type->subscribers);
+		}
+		free(type->name);
+		free(type);
+		state.types[i] = NULL;
+	}
+	state.count = 0;
+
+	if (state.jobs != NULL) {
+		free(state.jobs);
+		state.jobs = NULL;
+	}
+	if (state.jobs_data != NULL) {
+		free(state.jobs_data);
+		state.jobs_data = NULL;
+	}
+	state.jobs_capacity = 0;
+	state.running = 0;
+}
+
+kgfw_event_type_t kgfw_event_type_register(const char * name, unsigned long long int event_size) {
+	if (!state.running || name == NULL || event_size == 0) {
+		return KGFW_EVENT_INVALID_TYPE;
+	}
+
+	kgfw_event_type_t existing = kgfw_event_type_get(name);
+	if (existing != KGFW_EVENT_INVALID_TYPE) {
+		if (state.types[existing - 1]->size != event_size) {
+			kgfw_logf(KGFW_LOG_SEVERITY_WARN, "event type \"%s\" is already registered with a different size", name);
+			return KGFW_EVENT_INVALID_TYPE;
+		}
+		return existing;
+	}
+
+	if (state.count >= EVENT_TYPES_MAX) {
+		kgfw_logf(KGFW_LOG_SEVERITY_WARN, "too many event types, \"%s\" was not registered", name);
+		return KGFW_EVENT_INVALID_TYPE;
+	}
+
+	event_type_t * type = malloc(sizeof(event_type_t));
+	if (type == NULL) {
+		return KGFW_EVENT_INVALID_TYPE;
+	}
+	memset(type, 0, sizeof(event_type_t));
+
+	unsigned long long int len = strlen(name);
+	type->name = malloc(sizeof(char) * (len + 1));
+	if (type->name == NULL) {
+		free(type);
+		return KGFW_EVENT_INVALID_TYPE;
+	}
+	memcpy(type->name, name, len + 1);
+	type->hash = kgfw_hash(name);
+	type->size = event_size;
+
+	if (kgfw_mutex_init(&type->mutex) != 0) {
+		free(type->name);
+		free(type);
+		return KGFW_EVENT_INVALID_TYPE;
+	}
+
+	state.types[state.count] = type;
+	++state.count;
+	return (kgfw_event_type_t) state.count;
+}
+
+kgfw_event_type_t kgfw_event_type_get(const char * name) {
+	if (name == NULL) {
+		return KGFW_EVENT_INVALID_TYPE;
+	}
+
+	kgfw_hash_t hash = kgfw_hash(name);
+	for (unsigned long long int i = 0; i < state.count; ++i) {
+		if (state.types[i]->hash == hash && strcmp(state.types[i]->name, name) == 0) {
+			return (kgfw_event_type_t) (i + 1);
+		}
+	}
+
+	return KGFW_EVENT_INVALID_TYPE;
+}
+
+int kgfw_event_subscribe(kgfw_event_type_t type, kgfw_event_batch_f func, void * data, unsigned char parallel) {
+	if (type == KGFW_EVENT_INVALID_TYPE || type > state.count || func == NULL) {
+		return 1;
+	}
+
+	event_type_t * t = state.types[type - 1];
+	event_subscriber_t * subscribers = realloc(t->subscribers, sizeof(event_subscriber_t) * (t->subscribers_count + 1));
+	if (subscribers == NULL) {
+		return 2;
+	}
+	t->subscribers = subscribers;
+	t->subscribers[t->subscribers_count].func = func;
+	t->subscribers[t->subscribers_count].data = data;
+	t->subscribers[t->subscribers_count].parallel = parallel;
+	++t->subscribers_count;
+
+	return 0;
+}
+
+int kgfw_event_emit(kgfw_event_type_t type, const void * event) {
+	if (type == KGFW_EVENT_INVALID_TYPE || type > state.count || event == NULL) {
+		return 1;
+	}
+
+	event_type_t * t = state.types[type - 1];
+	kgfw_mutex_lock(&t->mutex);
+	if (t->recording.count == t->recording.capacity) {
+		if (event_buffer_grow(&t->recording, t->size) != 0) {
+			kgfw_mutex_unlock(&t->mutex);
+			return 2;
+		}
+	}
+	memcpy(t->recording.events + t->recording.count * t->size, event, t->size);
+	++t->recording.count;
+	kgfw_mutex_unlock(&t->mutex);
+
+	return 0;
+}
+
+void kgfw_event_dispatch(void) {
+	/* a subscriber dispatching again would hand out the batches being read */
+	if (!state.running || state.dispatching) {
+		return;
+	}
+	state.dispatching = 1;
+
+	unsigned long long int count = state.count;
+	unsigned long long int parallel = 0;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		event_type_t * type = state.types[i];
+		kgfw_mutex_lock(&type->mutex);
+		event_buffer_t swap = type->dispatching;
+		type->dispatching = type->recording;
+		type->recording = swap;
+		kgfw_mutex_unlock(&type->mutex);
+
+		if (type->dispatching.count == 0) {
+			continue;
+		}
+		for (unsigned long long int j = 0; j < type->subscribers_count; ++j) {
+			if (type->subscribers[j].parallel) {
+				++parallel;
+			}
+		}
+	}
+
+	/* parallel subscribers run serially if there is no room for their jobs */
+	unsigned char run_parallel = (parallel > 0 && event_jobs_reserve(parallel) == 0);
+	kgfw_job_counter_t counter = { 0 };
+	if (run_parallel) {
+		unsigned long long int job = 0;
+		for (unsigned long long int i = 0; i < count; ++i) {
+			event_type_t * type = state.types[i];
+			for (unsigned long long int j = 0; j < type->subscribers_count && type->dispatching.count > 0; ++j) {
+				if (!type->subscribers[j].parallel) {
+					continue;
+				}
+				state.jobs_data[job].func = type->subscribers[j].func;
+				state.jobs_data[job].data = type->subscribers[j].data;
+				state.jobs_data[job].events = type->dispatching.events;
+				state.jobs_data[job].count = type->dispatching.count;
+				state.jobs[job].func = event_job;
+				state.jobs[job].data = &state.jobs_data[job];
+				++job;
+			}
+		}
+		kgfw_jobs_run(state.jobs, parallel, &counter);
+	}
+
+	/* subscribers may subscribe more while being dispatched to, so the count is read every time */
+	for (unsigned long long int i = 0; i < count; ++i) {
+		event_type_t * type = state.types[i];
+		for (unsigned long long int j = 0; j < type->subscribers_count && type->dispatching.count > 0; ++j) {
+			if (type->subscribers[j].parallel && run_parallel) {
+				continue;
+			}
+			type->subscribers[j].func(type->dispatching.events, type->dispatching.count, type->subscribers[j].data);
+		}
+	}
+
+	if (run_parallel) {
+		kgfw_jobs_wait(&counter);
+	}
+
+	for (unsigned long long int i = 0; i < count; ++i) {
+		state.types[i]->dispatching.count = 0;
+	}
+	state.dispatching = 0;
+}
+
+static int event_buffer_grow(event_buffer_t * buffer, unsigned long long int size) {
+	unsigned long long int capacity = (buffer->capacity == 0) ? EVENT_CAPACITY_MIN : buffer->capacity * 2;
+	unsigned char * events = realloc(buffer->events, size * capacity);
+	if (events == NULL) {
+		return 1;
+	}
+
+	buffer->events = events;
+	buffer->capacity = capacity;
+	return 0;
+}
+
+static int event_jobs_reserve(unsigned long long int count) {
+	if (count <= state.jobs_capacity) {
+		return 0;
+	}
+
+	kgfw_job_t * jobs = realloc(state.jobs, sizeof(kgfw_job_t) * count);
+	if (jobs == NULL) {
+		return 1;
+	}
+	state.jobs = jobs;
+
+	event_job_t * jobs_data = realloc(state.jobs_data, sizeof(event_job_t) * count);
+	if (jobs_data == NULL) {
+		return 1;
+	}
+	state.jobs_data = jobs_data;
+	state.jobs_capacity = count;
+
+	return 0;
+}
+
+static void event_job(void * data) {
+	event_job_t * job = data;
+	job->func(job->events, job->count, job->data);
+}
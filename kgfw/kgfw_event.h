@@ -0,0 +1,39 @@
+#ifndef KRISVERS_KGFW_EVENT_H
+#define KRISVERS_KGFW_EVENT_H
+
+#include "kgfw_defines.h"
+
+/*
+	typed event bus. events are copied into a contiguous per-type buffer when emitted and
+	handed to subscribers in one batch per type by kgfw_event_dispatch, so producers
+	(ex. GLFW callbacks) never call into consumers
+*/
+
+typedef unsigned int kgfw_event_type_t;
+
+#define KGFW_EVENT_INVALID_TYPE 0
+
+/* events are [count] events of the type's size stored back to back, ex. cast to const my_event_t * */
+typedef void (*kgfw_event_batch_f)(const void * events, unsigned long long int count, void * data);
+
+KGFW_PUBLIC int kgfw_event_init(void);
+KGFW_PUBLIC void kgfw_event_deinit(void);
+
+/*
+	registering a name again with the same size returns the existing type.
+	returns KGFW_EVENT_INVALID_TYPE on error, if the bus is not running or if the name is taken by a different size
+ */
+KGFW_PUBLIC kgfw_event_type_t kgfw_event_type_register(const char * name, unsigned long long int event_size);
+KGFW_PUBLIC kgfw_event_type_t kgfw_event_type_get(const char * name);
+/*
+	parallel subscribers run on kgfw_jobs workers alongside every other parallel subscriber, so they
+	must only read the events and their own data. the others run in subscription order on the dispatching thread
+	returns non-zero on error
+ */
+KGFW_PUBLIC int kgfw_event_subscribe(kgfw_event_type_t type, kgfw_event_batch_f func, void * data, unsigned char parallel);
+/* safe to call from any thread. events emitted while dispatching go to the next dispatch. returns non-zero on error */
+KGFW_PUBLIC int kgfw_event_emit(kgfw_event_type_t type, const void * event);
+/* call from the main thread at a fixed point of the frame, hands every emitted event to the subscribers */
+KGFW_PUBLIC void kgfw_event_dispatch(void);
+
+#endif
@@ -7,6 +7,11 @@
 #include "kgfw_log.h"
 #include "kgfw_time.h"
 #include "kgfw_console.h"
+#include "kgfw_transform.h"
+#include "kgfw_render_queue.h"
+#include "kgfw_bvh.h"
+#include "kgfw_simplify.h"
+#include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +35,161 @@
 #define GL_CALL(statement) statement;
 #endif
 
+/* every uniform mesh_draw sets, resolved once per program */
+typedef enum uniform_enum {
+	UNIFORM_M = 0,
+	UNIFORM_VP,
+	UNIFORM_TIME,
+	UNIFORM_VIEW_POS,
+	UNIFORM_TEXTURED_COLOR,
+	UNIFORM_TEXTURED_NORMAL,
+	UNIFORM_TEXTURE_COLOR,
+	UNIFORM_TEXTURE_NORMAL,
+	UNIFORM_COUNT,
+} uniform_enum;
+
+static const char * uniform_names[UNIFORM_COUNT] = {
+	"unif_m",
+	"unif_vp",
+	"unif_time",
+	"unif_view_pos",
+	"unif_textured_color",
+	"unif_textured_normal",
+	"unif_texture_color",
+	"unif_texture_normal",
+};
+
+/*
+	draw keys, most expensive state first. GL names are cut down to their low bits,
+	names that collide only cost extra state changes since binds compare the full names
+*/
+#define DRAW_KEY_PROGRAM_SHIFT 52
+#define DRAW_KEY_PROGRAM_MASK 0xFFFull
+#define DRAW_KEY_TEXTURE_SHIFT 38
+#define DRAW_KEY_TEXTURE_MASK 0x3FFFull
+#define DRAW_KEY_NORMAL_SHIFT 28
+#define DRAW_KEY_NORMAL_MASK 0x3FFull
+#define DRAW_KEY_VAO_SHIFT 16
+#define DRAW_KEY_VAO_MASK 0xFFFull
+#define DRAW_KEY_DEPTH_MASK 0xFFFFull
+
+/* never a GL name, forces the next bind */
+#define GL_NAME_UNBOUND 0xFFFFFFFFu
+
+typedef struct program_uniforms {
+	GLuint program;
+	/* -1 for uniforms the program does not have or keeps in a uniform block */
+	GLint locations[UNIFORM_COUNT];
+	/* GL_INVALID_INDEX if the program does not declare the block, it is then given the uniforms one by one */
+	GLuint frame_block;
+	GLuint draw_block;
+} program_uniforms_t;
+
+/* std140 layouts of the kgfw_frame and kgfw_draw uniform blocks */
+typedef struct frame_block {
+	mat4x4 vp;
+	float view_pos[3];
+	float time;
+} frame_block_t;
+
+typedef struct draw_block {
+	mat4x4 m;
+	float textured_color;
+	float textured_normal;
+	float _pad[2];
+} draw_block_t;
+
+#define UBO_BINDING_FRAME 0
+#define UBO_BINDING_DRAW 1
+/* regions of the draw ring, the GPU can still be reading the two written before the current one */
+#define UBO_RING_REGIONS 3
+#define UBO_RING_MIN_SLOTS 256
+
+/*
+	vertex and index buffers uploaded once per source mesh and shared by every node created
+	from it, released when the last of those nodes is freed
+*/
+typedef struct mesh_geometry {
+	/* the source arrays identify the geometry, they are only read again to batch static nodes */
+	const kgfw_graphics_vertex_t * vertices;
+	const unsigned int * indices;
+	const kgfw_graphics_mesh_lod_t * lods_source;
+	unsigned long long int lods_source_count;
+	unsigned long long int vbo_size;
+	unsigned long long int ibo_size;
+
+	GLuint vao;
+	GLuint vbo;
+	GLuint ibo;
+	unsigned long long int references;
+
+	/* of the vertices in model space */
+	kgfw_aabb_t aabb;
+	kgfw_sphere_t sphere;
+
+	/* [lods_count] ranges of the index buffer, the full index set is level 0 and the source's lods follow it */
+	struct {
+		unsigned long long int offset;
+		unsigned long long int count;
+		float error;
+	} lods[KGFW_GRAPHICS_MESH_LODS_MAX + 1];
+	unsigned int lods_count;
+} mesh_geometry_t;
+
+/*
+	static nodes sharing a program and textures, merged into the batching buffers. its members are
+	[member, member + members_count) of the batching member arrays
+*/
+typedef struct mesh_batch {
+	/* drawn with this member's state, every member's is the same */
+	struct mesh_node * first;
+	unsigned long long int member;
+	unsigned long long int members_count;
+	/* visible members this frame, packed from member in the draw arrays */
+	unsigned long long int draws_count;
+} mesh_batch_t;
+
+/* textures uploaded once per source image and sampling settings, shared the same way as geometry */
+typedef struct texture_cached {
+	/* identifies the texture, the bitmap is never read after the upload */
+	kgfw_graphics_texture_t source;
+	GLuint id;
+	unsigned long long int references;
+} texture_cached_t;
+
+/* first of the four vertex attribute locations the per-instance model matrix takes */
+#define INSTANCE_ATTRIBUTE 4
+#define INSTANCES_MIN_CAPACITY 64
+
+typedef struct mesh_instances {
+	/* per-instance model matrices, has room for vbo_capacity instances */
+	GLuint vbo;
+	unsigned long long int vbo_capacity;
+
+	/* [count] packed instance matrices, uploaded as they are */
+	mat4x4 * matrices;
+	kgfw_graphics_instance_t * handles;
+	unsigned long long int count;
+	unsigned long long int capacity;
+
+	/* [handles_count] handle to packed index, free handles are chained through it */
+	unsigned int * indices;
+	unsigned long long int handles_count;
+	unsigned long long int handles_capacity;
+	kgfw_graphics_instance_t free_handle;
+
+	/* packed range changed since the last upload */
+	unsigned long long int dirty_begin;
+	unsigned long long int dirty_end;
+
+	/* of every instance relative to the node, recomputed when bounds_dirty is set */
+	kgfw_aabb_t aabb;
+	kgfw_sphere_t sphere;
+	/* largest axis scale of any instance */
+	float scale;
+	unsigned char bounds_dirty;
+} mesh_instances_t;
+
 typedef struct mesh_node {
 	struct {
 		float pos[3];
@@ -60,6 +220,20 @@ typedef struct mesh_node {
 		unsigned long long int vbo_size;
 		unsigned long long int ibo_size;
 	} gl;
+
+	kgfw_transform_node_t hierarchy;
+	/* gl.vao, vbo and ibo belong to it, except the vertex array of an instanced node */
+	mesh_geometry_t * geometry;
+	/* NULL unless created by kgfw_graphics_mesh_new_instanced */
+	mesh_instances_t * instances;
+	/* world bounds in the visibility tree, moved whenever the hierarchy updates the node */
+	kgfw_bvh_leaf_t leaf;
+	/* world bounding sphere as of the last update, lods are picked by its distance to the camera */
+	kgfw_sphere_t sphere;
+	unsigned char is_static;
+	/* set while the node is drawn as part of a batch, batch_member indexes the batching member arrays */
+	mesh_batch_t * batch;
+	unsigned long long int batch_member;
 } mesh_node_t;
 
 struct {
@@ -69,8 +243,101 @@ struct {
 	GLuint fshader;
 	GLuint program;
 	mat4x4 vp;
+	/* size of the viewport in pixels, for projecting lod errors onto the screen */
+	unsigned int viewport_width;
+	unsigned int viewport_height;
+	/* pixels of error a lod may show, see kgfw_graphics_lod_error */
+	float lod_error;
 
 	mesh_node_t * mesh_root;
+	/* every mesh in depth-first order, drawn straight from its world matrices */
+	kgfw_transform_hierarchy_t meshes;
+	/* every uploaded geometry, looked up by source arrays when a node is created */
+	struct {
+		mesh_geometry_t ** geometries;
+		unsigned long long int count;
+		unsigned long long int capacity;
+	} geometries;
+	/* every uploaded texture, looked up by source when a texture is given to a node */
+	struct {
+		texture_cached_t ** textures;
+		unsigned long long int count;
+		unsigned long long int capacity;
+	} textures;
+	/* world bounds of every mesh, culled against the camera's frustum before drawing */
+	kgfw_bvh_t bvh;
+	/* meshes that passed culling this frame */
+	struct {
+		mesh_node_t ** nodes;
+		unsigned long long int count;
+		unsigned long long int capacity;
+		/* set if the list could not grow, everything is drawn instead */
+		unsigned char overflow;
+	} visible;
+	/*
+		vertices and indices of every batched node, with world transforms baked in. rebuilt before drawing
+		whenever dirty is set, by a static node changing, moving or being destroyed
+	*/
+	struct {
+		GLuint vao;
+		GLuint vbo;
+		GLuint ibo;
+		mesh_batch_t * batches;
+		unsigned long long int count;
+		/* [members_count] where each member's indices are in the batching buffers */
+		GLsizei * counts;
+		const void ** offsets;
+		GLint * base_vertices;
+		/* [members_count] the visible members of each batch this frame */
+		GLsizei * draw_counts;
+		const void ** draw_offsets;
+		GLint * draw_base_vertices;
+		unsigned long long int members_count;
+		unsigned char dirty;
+	} batching;
+	/* indices into visible, sorted by draw key every frame */
+	kgfw_render_queue_t queue;
+	/*
+		kgfw_frame is written once a frame. kgfw_draw is one slot per queued draw in a ring
+		of regions, each region is fenced after the draws reading it and waited on before
+		it is written again
+	*/
+	struct {
+		GLuint frame;
+		GLuint ring;
+		/* for draws that did not get a ring slot */
+		GLuint single;
+		/* bytes between slots, the block size rounded up to the offset alignment */
+		unsigned long long int stride;
+		/* slots per region */
+		unsigned long long int slots;
+		unsigned int region;
+		GLsync fences[UBO_RING_REGIONS];
+	} ubo;
+	/* what the draws so far this frame left bound, binds matching it are skipped */
+	struct {
+		GLuint program;
+		GLuint tex;
+		GLuint normal;
+		GLuint vao;
+		/* the textured uniforms set for the bound program, -1 if not yet set */
+		int textured_color;
+		int textured_normal;
+	} bound;
+
+	/*
+		uniform locations of every program drawn with so far. GL reuses program names,
+		so a program's table is dropped when it is deleted or relinked
+	*/
+	struct {
+		program_uniforms_t * tables;
+		unsigned long long int count;
+		unsigned long long int capacity;
+		/* the table of the last program looked up */
+		program_uniforms_t * last;
+		/* used if a table could not be stored */
+		program_uniforms_t uncached;
+	} programs;
 
 	struct {
 		float r, g, b;
@@ -95,6 +362,9 @@ struct {
 	.program = 0,
 
 	.vp = { 0 },
+	.viewport_width = 1,
+	.viewport_height = 1,
+	.lod_error = 1.0f,
 	.mesh_root = NULL,
 
 	.clear_color = { 0, 0, 0 },
@@ -108,34 +378,45 @@ struct {
 	}
 };
 
-struct {
-	mat4x4 model;
-	mat4x4 model_r;
-	vec3 pos;
-	vec3 rot;
-	vec3 scale;
-} static recurse_state = {
-	.model = {
-		{ 1, 0, 0, 0 },
-		{ 0, 1, 0, 0 },
-		{ 0, 0, 1, 0 },
-		{ 0, 0, 0, 1 },
-	},
-};
-
 static void update_settings(unsigned int change);
 static void register_commands(void);
 
-static void meshes_draw_recursive(mesh_node_t * mesh);
-static void meshes_draw_recursive_fchild(mesh_node_t * mesh);
 static void meshes_free(mesh_node_t * node);
-static mesh_node_t * meshes_new(void);
-static void mesh_draw(mesh_node_t * mesh, mat4x4 out_m);
+static mesh_node_t * meshes_new(kgfw_graphics_mesh_t * mesh);
+static mesh_geometry_t * mesh_geometry_acquire(kgfw_graphics_mesh_t * mesh);
+static void mesh_geometry_release(mesh_geometry_t * geometry);
+static void vertex_attributes(GLuint vbo, GLuint ibo);
+static GLuint texture_acquire(kgfw_graphics_texture_t * texture);
+static void texture_release(GLuint id);
+static void mesh_bind(mesh_node_t * mesh, mat4x4 model, long long int slot);
+static void mesh_draw(mesh_node_t * mesh, mat4x4 model, long long int slot);
+static void mesh_draw_block(mesh_node_t * mesh, mat4x4 model, draw_block_t * out_block);
+static unsigned char mesh_drawable(mesh_node_t * mesh);
+static unsigned long long int mesh_draw_key(mesh_node_t * mesh, mat4x4 model);
+static unsigned int mesh_lod(mesh_node_t * mesh, mat4x4 model);
+static int mesh_instances_reserve(mesh_instances_t * instances, unsigned long long int count);
+static void mesh_instances_upload(mesh_instances_t * instances);
+static void mesh_instances_free(mesh_instances_t * instances);
+static void mesh_instances_changed(mesh_node_t * mesh);
+static void mesh_bounds(mesh_node_t * mesh, mat4x4 world, kgfw_aabb_t * out_aabb, kgfw_sphere_t * out_sphere);
+static void meshes_bounds_update(void);
+static void meshes_visible_push(void * leaf_data, void * data);
+static void batches_build(void);
+static void batches_free(void);
+static int batch_compare(const void * a, const void * b);
+static void batch_push(mesh_node_t * mesh);
+static void batch_draw(mesh_batch_t * batch);
 static void meshes_free_recursive_fchild(mesh_node_t * mesh);
 static void meshes_free_recursive(mesh_node_t * mesh);
 static void gl_errors(void);
 
 static int shaders_load(const char * vpath, const char * fpath, GLuint * out_program);
+static const program_uniforms_t * program_uniforms(GLuint program);
+static void program_uniforms_resolve(program_uniforms_t * table, GLuint program);
+static void program_uniforms_forget(GLuint program);
+static unsigned char * uniform_ring_map(unsigned long long int count);
+static int uniform_ring_unmap(void);
+static void uniform_ring_wait(unsigned int region);
 
 void kgfw_graphics_settings_set(kgfw_graphics_settings_action_enum action, unsigned int settings) {
 	unsigned int change = 0;
@@ -186,6 +467,21 @@ int kgfw_graphics_init(kgfw_window_t * window, kgfw_camera_t * camera) {
 		if (window->internal != NULL) {
 			GL_CALL(glViewport(0, 0, window->width, window->height));
 		}
+		state.viewport_width = window->width;
+		state.viewport_height = window->height;
+	}
+
+	if (kgfw_transform_hierarchy_init(&state.meshes) != 0) {
+		return 2;
+	}
+	if (kgfw_render_queue_init(&state.queue) != 0) {
+		kgfw_transform_hierarchy_deinit(&state.meshes);
+		return 2;
+	}
+	if (kgfw_bvh_init(&state.bvh) != 0) {
+		kgfw_render_queue_deinit(&state.queue);
+		kgfw_transform_hierarchy_deinit(&state.meshes);
+		return 2;
 	}
 
 	state.program = GL_CALL(glCreateProgram());
@@ -194,6 +490,32 @@ int kgfw_graphics_init(kgfw_window_t * window, kgfw_camera_t * camera) {
 		return r;
 	}
 
+	GLint alignment = 0;
+	GL_CALL(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+	if (alignment <= 0) {
+		alignment = 256;
+	}
+	state.ubo.stride = ((sizeof(draw_block_t) + alignment - 1) / alignment) * alignment;
+	state.ubo.slots = 0;
+	state.ubo.region = 0;
+	GL_CALL(glGenBuffers(1, &state.ubo.frame));
+	GL_CALL(glGenBuffers(1, &state.ubo.ring));
+	GL_CALL(glGenBuffers(1, &state.ubo.single));
+	GL_CALL(glBindBuffer(GL_UNIFORM_BUFFER, state.ubo.frame));
+	GL_CALL(glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_block_t), NULL, GL_DYNAMIC_DRAW));
+	GL_CALL(glBindBuffer(GL_UNIFORM_BUFFER, state.ubo.single));
+	GL_CALL(glBufferData(GL_UNIFORM_BUFFER, sizeof(draw_block_t), NULL, GL_DYNAMIC_DRAW));
+	GL_CALL(glBindBufferBase(GL_UNIFORM_BUFFER, UBO_BINDING_FRAME, state.ubo.frame));
+
+	/*
+		meshes that are not instanced leave the instance matrix attribute disabled, shaders then
+		read its current value, which is kept at identity so unif_m * in_instance_m is just unif_m
+	*/
+	GL_CALL(glVertexAttrib4f(INSTANCE_ATTRIBUTE + 0, 1, 0, 0, 0));
+	GL_CALL(glVertexAttrib4f(INSTANCE_ATTRIBUTE + 1, 0, 1, 0, 0));
+	GL_CALL(glVertexAttrib4f(INSTANCE_ATTRIBUTE + 2, 0, 0, 1, 0));
+	GL_CALL(glVertexAttrib4f(INSTANCE_ATTRIBUTE + 3, 0, 0, 0, 1));
+
 	GL_CALL(glEnable(GL_DEPTH_TEST));
 	GL_CALL(glEnable(GL_FRAMEBUFFER_SRGB));
 	//GL_CALL(glPolygonMode(GL_FRONT_AND_BACK, GL_POINT));
@@ -229,20 +551,91 @@ int kgfw_graphics_draw(void) {
 
 	mat4x4_mul(state.vp, p, v);
 
-	if (state.mesh_root != NULL) {
-		mat4x4_identity(recurse_state.model);
+	frame_block_t frame;
+	memcpy(frame.vp, state.vp, sizeof(mat4x4));
+	memcpy(frame.view_pos, state.camera->pos, sizeof(vec3));
+	frame.time = kgfw_time_get();
+	GL_CALL(glBindBuffer(GL_UNIFORM_BUFFER, state.ubo.frame));
+	GL_CALL(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame_block_t), &frame));
+	GL_CALL(glBindBufferBase(GL_UNIFORM_BUFFER, UBO_BINDING_FRAME, state.ubo.frame));
+
+	/* only meshes marked changed since the last draw (and their children) are recomputed */
+	kgfw_transform_hierarchy_update(&state.meshes);
+	meshes_bounds_update();
+	if (state.batching.dirty) {
+		batches_build();
+	}
+	for (unsigned long long int b = 0; b < state.batching.count; ++b) {
+		state.batching.batches[b].draws_count = 0;
+	}
 
-		recurse_state.pos[0] = 0;
-		recurse_state.pos[1] = 0;
-		recurse_state.pos[2] = 0;
-		recurse_state.rot[0] = 0;
-		recurse_state.rot[1] = 0;
-		recurse_state.rot[2] = 0;
-		recurse_state.scale[0] = 1;
-		recurse_state.scale[1] = 1;
-		recurse_state.scale[2] = 1;
+	/* anything may have been bound since the last frame */
+	state.bound.program = GL_NAME_UNBOUND;
+	state.bound.tex = GL_NAME_UNBOUND;
+	state.bound.normal = GL_NAME_UNBOUND;
+	state.bound.vao = GL_NAME_UNBOUND;
+
+	state.visible.count = 0;
+	state.visible.overflow = 0;
+	if (state.settings & KGFW_GRAPHICS_SETTINGS_CULLING) {
+		kgfw_frustum_t frustum;
+		kgfw_frustum_from_matrix(&frustum, state.vp);
+		kgfw_bvh_cull(&state.bvh, &frustum, meshes_visible_push, NULL);
+	}
+	if (!(state.settings & KGFW_GRAPHICS_SETTINGS_CULLING) || state.visible.overflow) {
+		state.visible.count = 0;
+		state.visible.overflow = 0;
+		for (unsigned long long int i = 0; i < state.meshes.count && !state.visible.overflow; ++i) {
+			meshes_visible_push(state.meshes.datas[i], NULL);
+		}
+	}
 
-		meshes_draw_recursive_fchild(state.mesh_root);
+	kgfw_render_queue_clear(&state.queue);
+	unsigned long long int i = 0;
+	for (; i < state.visible.count; ++i) {
+		mesh_node_t * mesh = state.visible.nodes[i];
+		if (!mesh_drawable(mesh)) {
+			continue;
+		}
+		if (mesh->batch != NULL) {
+			batch_push(mesh);
+			continue;
+		}
+		if (kgfw_render_queue_push(&state.queue, mesh_draw_key(mesh, kgfw_transform_hierarchy_world(&state.meshes, mesh->hierarchy)), (unsigned int) i) != 0) {
+			break;
+		}
+	}
+
+	kgfw_render_queue_sort(&state.queue);
+
+	/* every queued draw's block is written in one go, draws then only pick their slot */
+	unsigned char * slots = uniform_ring_map(state.queue.count);
+	if (slots != NULL) {
+		for (unsigned long long int q = 0; q < state.queue.count; ++q) {
+			mesh_node_t * mesh = state.visible.nodes[state.queue.items[q]];
+			mesh_draw_block(mesh, kgfw_transform_hierarchy_world(&state.meshes, mesh->hierarchy), (draw_block_t *) (slots + q * state.ubo.stride));
+		}
+		if (uniform_ring_unmap() != 0) {
+			slots = NULL;
+		}
+	}
+
+	for (unsigned long long int q = 0; q < state.queue.count; ++q) {
+		mesh_node_t * mesh = state.visible.nodes[state.queue.items[q]];
+		mesh_draw(mesh, kgfw_transform_hierarchy_world(&state.meshes, mesh->hierarchy), (slots != NULL) ? (long long int) q : -1);
+	}
+	if (slots != NULL) {
+		state.ubo.fences[state.ubo.region] = GL_CALL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+	}
+
+	for (unsigned long long int b = 0; b < state.batching.count; ++b) {
+		batch_draw(&state.batching.batches[b]);
+	}
+
+	/* meshes that did not fit in the queue are drawn unsorted */
+	for (; i < state.visible.count; ++i) {
+		mesh_node_t * mesh = state.visible.nodes[i];
+		mesh_draw(mesh, kgfw_transform_hierarchy_world(&state.meshes, mesh->hierarchy), -1);
 	}
 
 	return 0;
@@ -250,11 +643,6 @@ int kgfw_graphics_draw(void) {
 
 void kgfw_graphics_mesh_texture(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_texture_t * texture, kgfw_graphics_texture_use_enum use) {
 	mesh_node_t * m = (mesh_node_t *) mesh;
-	GLenum fmt = (texture->fmt == KGFW_GRAPHICS_TEXTURE_FORMAT_RGBA) ? GL_RGBA : GL_BGRA;
-	GLenum filtering = (texture->filtering == KGFW_GRAPHICS_TEXTURE_FILTERING_NEAREST) ? GL_NEAREST : GL_LINEAR;
-	GLenum filtering_mipmap = (texture->filtering == KGFW_GRAPHICS_TEXTURE_FILTERING_NEAREST) ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR;
-	GLenum u_wrap = (texture->u_wrap == KGFW_GRAPHICS_TEXTURE_WRAP_CLAMP) ? GL_CLAMP_TO_BORDER : GL_REPEAT;
-	GLenum v_wrap = (texture->v_wrap == KGFW_GRAPHICS_TEXTURE_WRAP_CLAMP) ? GL_CLAMP_TO_BORDER : GL_REPEAT;
 	GLuint * t = NULL;
 	if (use == KGFW_GRAPHICS_TEXTURE_USE_COLOR) {
 		t = &m->gl.tex;
@@ -263,17 +651,15 @@ void kgfw_graphics_mesh_texture(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_
 		t = &m->gl.normal;
 	}
 
-	if (*t == 0) {
-		GL_CALL(glGenTextures(1, t));
+	/* acquired first so giving a node the texture it already has never uploads it again */
+	GLuint id = texture_acquire(texture);
+	if (*t != 0) {
+		texture_release(*t);
+	}
+	*t = id;
+	if (m->is_static) {
+		state.batching.dirty = 1;
 	}
-
-	GL_CALL(glBindTexture(GL_TEXTURE_2D, *t));
-	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, u_wrap));
-	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, v_wrap));
-	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering));
-	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering_mipmap));
-	GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture->width, texture->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, texture->bitmap));
-	GL_CALL(glGenerateMipmap(GL_TEXTURE_2D));
 }
 
 void kgfw_graphics_mesh_texture_detach(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_texture_use_enum use) {
@@ -287,33 +673,41 @@ void kgfw_graphics_mesh_texture_detach(kgfw_graphics_mesh_node_t * mesh, kgfw_gr
 	}
 
 	if (*t != 0) {
-		GL_CALL(glDeleteTextures(1, t));
+		texture_release(*t);
 		*t = 0;
 	}
+	if (m->is_static) {
+		state.batching.dirty = 1;
+	}
 }
 
 kgfw_graphics_mesh_node_t * kgfw_graphics_mesh_new(kgfw_graphics_mesh_t * mesh, kgfw_graphics_mesh_node_t * parent) {
-	mesh_node_t * node = meshes_new();
+	mesh_node_t * node = meshes_new(mesh);
+	if (node == NULL) {
+		return NULL;
+	}
+
+	/* the node's transform starts with the same fields as kgfw_transform_t */
+	node->hierarchy = kgfw_transform_hierarchy_add(&state.meshes, (const kgfw_transform_t *) &node->transform, node, (parent == NULL) ? KGFW_TRANSFORM_NODE_NONE : ((mesh_node_t *) parent)->hierarchy);
+	if (node->hierarchy == KGFW_TRANSFORM_NODE_NONE) {
+		meshes_free(node);
+		return NULL;
+	}
+	/* the world bounds are corrected by the next update, the node was just marked changed */
+	kgfw_aabb_t aabb;
+	kgfw_sphere_t sphere;
+	mesh_bounds(node, kgfw_transform_hierarchy_world(&state.meshes, node->hierarchy), &aabb, &sphere);
+	node->sphere = sphere;
+	node->leaf = kgfw_bvh_insert(&state.bvh, &aabb, &sphere, node);
+	if (node->leaf == KGFW_BVH_LEAF_NONE) {
+		kgfw_transform_hierarchy_remove(&state.meshes, node->hierarchy);
+		meshes_free(node);
+		return NULL;
+	}
 	node->parent = (mesh_node_t *) parent;
 	memcpy(node->transform.pos, mesh->pos, sizeof(vec3));
 	memcpy(node->transform.rot, mesh->rot, sizeof(vec3));
 	memcpy(node->transform.scale, mesh->scale, sizeof(vec3));
-	node->gl.vbo_size = mesh->vertices_count;
-	node->gl.ibo_size = mesh->indices_count;
-	GL_CALL(glBindVertexArray(node->gl.vao));
-	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, node->gl.vbo));
-	GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(kgfw_graphics_vertex_t) * mesh->vertices_count, mesh->vertices, GL_STATIC_DRAW));
-	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, node->gl.ibo));
-	GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * mesh->indices_count, mesh->indices, GL_STATIC_DRAW));
-
-	GL_CALL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(kgfw_graphics_vertex_t), (void *) offsetof(kgfw_graphics_vertex_t, x)));
-	GL_CALL(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(kgfw_graphics_vertex_t), (void *) offsetof(kgfw_graphics_vertex_t, r)));
-	GL_CALL(glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(kgfw_graphics_vertex_t), (void *) offsetof(kgfw_graphics_vertex_t, nx)));
-	GL_CALL(glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(kgfw_graphics_vertex_t), (void *) offsetof(kgfw_graphics_vertex_t, u)));
-	GL_CALL(glEnableVertexAttribArray(0));
-	GL_CALL(glEnableVertexAttribArray(1));
-	GL_CALL(glEnableVertexAttribArray(2));
-	GL_CALL(glEnableVertexAttribArray(3));
 
 	if (parent == NULL) {
 		if (state.mesh_root == NULL) {
@@ -363,9 +757,256 @@ void kgfw_graphics_mesh_destroy(kgfw_graphics_mesh_node_t * mesh) {
 		state.mesh_root = NULL;
 	}
 
+	/* the batch may refer to the node */
+	if (((mesh_node_t *) mesh)->is_static) {
+		state.batching.dirty = 1;
+	}
+	kgfw_transform_hierarchy_remove(&state.meshes, ((mesh_node_t *) mesh)->hierarchy);
+	kgfw_bvh_remove(&state.bvh, ((mesh_node_t *) mesh)->leaf);
 	meshes_free((mesh_node_t *) mesh);
 }
 
+void kgfw_graphics_mesh_transform_changed(kgfw_graphics_mesh_node_t * mesh) {
+	if (mesh == NULL) {
+		return;
+	}
+
+	mesh_node_t * m = (mesh_node_t *) mesh;
+	kgfw_transform_hierarchy_set_absolute(&state.meshes, m->hierarchy, m->transform.absolute);
+	kgfw_transform_hierarchy_mark_dirty(&state.meshes, m->hierarchy);
+}
+
+kgfw_graphics_mesh_node_t * kgfw_graphics_mesh_new_instanced(kgfw_graphics_mesh_t * mesh, kgfw_graphics_mesh_node_t * parent) {
+	mesh_instances_t * instances = malloc(sizeof(mesh_instances_t));
+	if (instances == NULL) {
+		return NULL;
+	}
+	memset(instances, 0, sizeof(mesh_instances_t));
+	instances->free_handle = KGFW_GRAPHICS_INSTANCE_NONE;
+	if (mesh_instances_reserve(instances, INSTANCES_MIN_CAPACITY) != 0) {
+		mesh_instances_free(instances);
+		return NULL;
+	}
+
+	mesh_node_t * node = (mesh_node_t *) kgfw_graphics_mesh_new(mesh, parent);
+	if (node == NULL) {
+		mesh_instances_free(instances);
+		return NULL;
+	}
+	node->instances = instances;
+
+	/* the instance attributes are vertex array state, so the shared vertex array cannot be used */
+	GL_CALL(glGenVertexArrays(1, &node->gl.vao));
+	GL_CALL(glBindVertexArray(node->gl.vao));
+	vertex_attributes(node->geometry->vbo, node->geometry->ibo);
+	GL_CALL(glGenBuffers(1, &instances->vbo));
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, instances->vbo));
+	GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(mat4x4) * instances->capacity, NULL, GL_DYNAMIC_DRAW));
+	instances->vbo_capacity = instances->capacity;
+	for (unsigned int i = 0; i < 4; ++i) {
+		GL_CALL(glVertexAttribPointer(INSTANCE_ATTRIBUTE + i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4x4), (void *) (sizeof(vec4) * i)));
+		GL_CALL(glVertexAttribDivisor(INSTANCE_ATTRIBUTE + i, 1));
+		GL_CALL(glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + i));
+	}
+	GL_CALL(glBindVertexArray(0));
+
+	return (kgfw_graphics_mesh_node_t *) node;
+}
+
+kgfw_graphics_instance_t kgfw_graphics_mesh_instance_add(kgfw_graphics_mesh_node_t * mesh, const kgfw_transform_t * transform) {
+	if (mesh == NULL || transform == NULL) {
+		return KGFW_GRAPHICS_INSTANCE_NONE;
+	}
+	mesh_instances_t * instances = ((mesh_node_t *) mesh)->instances;
+	if (instances == NULL) {
+		return KGFW_GRAPHICS_INSTANCE_NONE;
+	}
+
+	if (mesh_instances_reserve(instances, instances->count + 1) != 0) {
+		return KGFW_GRAPHICS_INSTANCE_NONE;
+	}
+
+	kgfw_graphics_instance_t handle = instances->free_handle;
+	if (handle != KGFW_GRAPHICS_INSTANCE_NONE) {
+		instances->free_handle = instances->indices[handle];
+	}
+	else {
+		if (instances->handles_count == instances->handles_capacity) {
+			unsigned long long int capacity = instances->handles_capacity * 2;
+			if (capacity >= KGFW_GRAPHICS_INSTANCE_NONE) {
+				return KGFW_GRAPHICS_INSTANCE_NONE;
+			}
+			unsigned int * indices = realloc(instances->indices, sizeof(unsigned int) * capacity);
+			if (indices == NULL) {
+				return KGFW_GRAPHICS_INSTANCE_NONE;
+			}
+			instances->indices = indices;
+			instances->handles_capacity = capacity;
+		}
+		handle = (kgfw_graphics_instance_t) instances->handles_count++;
+	}
+
+	unsigned long long int i = instances->count++;
+	instances->indices[handle] = (unsigned int) i;
+	instances->handles[i] = handle;
+	kgfw_transform_matrix(transform, instances->matrices[i]);
+	if (instances->dirty_begin >= instances->dirty_end) {
+		instances->dirty_begin = i;
+	}
+	instances->dirty_end = instances->count;
+	mesh_instances_changed((mesh_node_t *) mesh);
+
+	return handle;
+}
+
+void kgfw_graphics_mesh_instance_set(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_instance_t instance, const kgfw_transform_t * transform) {
+	if (mesh == NULL || transform == NULL) {
+		return;
+	}
+	mesh_instances_t * instances = ((mesh_node_t *) mesh)->instances;
+	if (instances == NULL || instance >= instances->handles_count) {
+		return;
+	}
+
+	unsigned long long int i = instances->indices[instance];
+	if (i >= instances->count || instances->handles[i] != instance) {
+		return;
+	}
+
+	kgfw_transform_matrix(transform, instances->matrices[i]);
+	if (instances->dirty_begin >= instances->dirty_end) {
+		instances->dirty_begin = i;
+		instances->dirty_end = i + 1;
+	}
+	else {
+		instances->dirty_begin = (i < instances->dirty_begin) ? i : instances->dirty_begin;
+		instances->dirty_end = (i + 1 > instances->dirty_end) ? i + 1 : instances->dirty_end;
+	}
+	mesh_instances_changed((mesh_node_t *) mesh);
+}
+
+void kgfw_graphics_mesh_instance_remove(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_instance_t instance) {
+	if (mesh == NULL) {
+		return;
+	}
+	mesh_instances_t * instances = ((mesh_node_t *) mesh)->instances;
+	if (instances == NULL || instance >= instances->handles_count) {
+		return;
+	}
+
+	unsigned long long int i = instances->indices[instance];
+	if (i >= instances->count || instances->handles[i] != instance) {
+		return;
+	}
+
+	/* the last instance fills the hole so the matrices stay packed */
+	unsigned long long int last = --instances->count;
+	if (i != last) {
+		memcpy(instances->matrices[i], instances->matrices[last], sizeof(mat4x4));
+		instances->handles[i] = instances->handles[last];
+		instances->indices[instances->handles[i]] = (unsigned int) i;
+		if (instances->dirty_begin >= instances->dirty_end) {
+			instances->dirty_begin = i;
+			instances->dirty_end = i + 1;
+		}
+		else {
+			instances->dirty_begin = (i < instances->dirty_begin) ? i : instances->dirty_begin;
+			instances->dirty_end = (i + 1 > instances->dirty_end) ? i + 1 : instances->dirty_end;
+		}
+	}
+
+	instances->indices[instance] = instances->free_handle;
+	instances->free_handle = instance;
+	mesh_instances_changed((mesh_node_t *) mesh);
+}
+
+unsigned long long int kgfw_graphics_mesh_instance_count(kgfw_graphics_mesh_node_t * mesh) {
+	if (mesh == NULL || ((mesh_node_t *) mesh)->instances == NULL) {
+		return 0;
+	}
+
+	return ((mesh_node_t *) mesh)->instances->count;
+}
+
+int kgfw_graphics_mesh_lods_generate(kgfw_graphics_mesh_t * mesh, unsigned long long int levels) {
+	kgfw_graphics_mesh_lods_free(mesh);
+	if (levels > KGFW_GRAPHICS_MESH_LODS_MAX) {
+		levels = KGFW_GRAPHICS_MESH_LODS_MAX;
+	}
+	if (levels == 0 || mesh->indices_count < 3) {
+		return 0;
+	}
+
+	mesh->lods = malloc(sizeof(kgfw_graphics_mesh_lod_t) * levels);
+	unsigned int * scratch = malloc(sizeof(unsigned int) * mesh->indices_count);
+	if (mesh->lods == NULL || scratch == NULL) {
+		free(scratch);
+		kgfw_graphics_mesh_lods_free(mesh);
+		return 1;
+	}
+
+	/* every level is simplified from the full index set, so errors do not pile up from level to level */
+	unsigned long long int previous = mesh->indices_count;
+	float previous_error = 0;
+	for (unsigned long long int l = 0; l < levels; ++l) {
+		unsigned long long int target = previous / 2 - (previous / 2) % 3;
+		unsigned long long int count = 0;
+		float error = 0;
+		if (kgfw_simplify(&mesh->vertices[0].x, mesh->vertices_count, sizeof(kgfw_graphics_vertex_t), mesh->indices, mesh->indices_count, target, FLT_MAX, scratch, &count, &error) != 0) {
+			free(scratch);
+			kgfw_graphics_mesh_lods_free(mesh);
+			return 1;
+		}
+		if (count == 0 || count > previous * 3 / 4) {
+			break;
+		}
+
+		unsigned int * indices = malloc(sizeof(unsigned int) * count);
+		if (indices == NULL) {
+			free(scratch);
+			kgfw_graphics_mesh_lods_free(mesh);
+			return 1;
+		}
+		memcpy(indices, scratch, sizeof(unsigned int) * count);
+		previous_error = (error > previous_error) ? error : previous_error;
+		mesh->lods[mesh->lods_count].indices = indices;
+		mesh->lods[mesh->lods_count].indices_count = count;
+		mesh->lods[mesh->lods_count].error = previous_error;
+		++mesh->lods_count;
+		previous = count;
+	}
+
+	free(scratch);
+	return 0;
+}
+
+void kgfw_graphics_mesh_lods_free(kgfw_graphics_mesh_t * mesh) {
+	if (mesh->lods != NULL) {
+		for (unsigned long long int l = 0; l < mesh->lods_count; ++l) {
+			free(mesh->lods[l].indices);
+		}
+		free(mesh->lods);
+	}
+	mesh->lods = NULL;
+	mesh->lods_count = 0;
+}
+
+void kgfw_graphics_lod_error(float pixels) {
+	state.lod_error = pixels;
+}
+
+void kgfw_graphics_mesh_static(kgfw_graphics_mesh_node_t * mesh, unsigned char is_static) {
+	if (mesh == NULL) {
+		return;
+	}
+
+	mesh_node_t * m = (mesh_node_t *) mesh;
+	if (m->is_static != (is_static != 0)) {
+		m->is_static = (is_static != 0);
+		state.batching.dirty = 1;
+	}
+}
+
 void kgfw_graphics_set_window(kgfw_window_t * window) {
 	state.window = window;
 	if (window != NULL) {
@@ -373,11 +1014,15 @@ void kgfw_graphics_set_window(kgfw_window_t * window) {
 			glfwMakeContextCurrent(window->internal);
 		}
 		GL_CALL(glViewport(0, 0, window->width, window->height));
+		state.viewport_width = window->width;
+		state.viewport_height = window->height;
 	}
 }
 
 void kgfw_graphics_viewport(unsigned int width, unsigned int height) {
 	GL_CALL(glViewport(0, 0, width, height));
+	state.viewport_width = width;
+	state.viewport_height = height;
 }
 
 kgfw_window_t * kgfw_graphics_get_window(void) {
@@ -386,6 +1031,55 @@ kgfw_window_t * kgfw_graphics_get_window(void) {
 
 void kgfw_graphics_deinit(void) {
 	meshes_free_recursive_fchild(state.mesh_root);
+	kgfw_transform_hierarchy_deinit(&state.meshes);
+	kgfw_render_queue_deinit(&state.queue);
+	kgfw_bvh_deinit(&state.bvh);
+	if (state.visible.nodes != NULL) {
+		free(state.visible.nodes);
+		state.visible.nodes = NULL;
+	}
+	state.visible.count = 0;
+	state.visible.capacity = 0;
+	batches_free();
+	if (state.batching.vao != 0) {
+		GL_CALL(glDeleteVertexArrays(1, &state.batching.vao));
+		GL_CALL(glDeleteBuffers(1, &state.batching.vbo));
+		GL_CALL(glDeleteBuffers(1, &state.batching.ibo));
+		state.batching.vao = 0;
+		state.batching.vbo = 0;
+		state.batching.ibo = 0;
+	}
+	state.batching.dirty = 0;
+	/* released with the last node using them, only the list is left */
+	if (state.geometries.geometries != NULL) {
+		free(state.geometries.geometries);
+		state.geometries.geometries = NULL;
+	}
+	state.geometries.count = 0;
+	state.geometries.capacity = 0;
+	if (state.textures.textures != NULL) {
+		free(state.textures.textures);
+		state.textures.textures = NULL;
+	}
+	state.textures.count = 0;
+	state.textures.capacity = 0;
+	for (unsigned int r = 0; r < UBO_RING_REGIONS; ++r) {
+		if (state.ubo.fences[r] != NULL) {
+			GL_CALL(glDeleteSync(state.ubo.fences[r]));
+			state.ubo.fences[r] = NULL;
+		}
+	}
+	GL_CALL(glDeleteBuffers(1, &state.ubo.frame));
+	GL_CALL(glDeleteBuffers(1, &state.ubo.ring));
+	GL_CALL(glDeleteBuffers(1, &state.ubo.single));
+	state.ubo.slots = 0;
+	if (state.programs.tables != NULL) {
+		free(state.programs.tables);
+		state.programs.tables = NULL;
+	}
+	state.programs.count = 0;
+	state.programs.capacity = 0;
+	state.programs.last = NULL;
 }
 
 static mesh_node_t * meshes_alloc(void) {
@@ -406,174 +1100,734 @@ static void meshes_free(mesh_node_t * node) {
 		return;
 	}
 
-	if (node->gl.vbo != 0) {
-		GL_CALL(glDeleteBuffers(1, &node->gl.vbo));
-	}
-	if (node->gl.ibo != 0) {
-		GL_CALL(glDeleteBuffers(1, &node->gl.ibo));
-	}
 	if (node->gl.program != 0) {
+		program_uniforms_forget(node->gl.program);
 		GL_CALL(glDeleteProgram(node->gl.program));
 	}
-	if (node->gl.vao != 0) {
-		GL_CALL(glDeleteVertexArrays(1, &node->gl.vao));
+	if (node->geometry != NULL) {
+		if (node->gl.vao != 0 && node->gl.vao != node->geometry->vao) {
+			GL_CALL(glDeleteVertexArrays(1, &node->gl.vao));
+		}
+		mesh_geometry_release(node->geometry);
 	}
 	if (node->gl.tex != 0) {
-		GL_CALL(glDeleteTextures(1, &node->gl.tex));
+		texture_release(node->gl.tex);
 	}
 	if (node->gl.normal != 0) {
-		GL_CALL(glDeleteTextures(1, &node->gl.normal));
+		texture_release(node->gl.normal);
+	}
+	if (node->instances != NULL) {
+		mesh_instances_free(node->instances);
 	}
 
 	free(node);
 }
 
-static void meshes_gen(mesh_node_t * node) {
-	GL_CALL(glGenVertexArrays(1, &node->gl.vao));
-	GL_CALL(glGenBuffers(1, &node->gl.vbo));
-	GL_CALL(glGenBuffers(1, &node->gl.ibo));
-	node->gl.tex = 0;
-	node->gl.normal = 0;
-}
-
-static mesh_node_t * meshes_new(void) {
+static mesh_node_t * meshes_new(kgfw_graphics_mesh_t * mesh) {
 	mesh_node_t * m = meshes_alloc();
 	if (m == NULL) {
 		return NULL;
 	}
 
-	meshes_gen(m);
+	m->geometry = mesh_geometry_acquire(mesh);
+	if (m->geometry == NULL) {
+		meshes_free(m);
+		return NULL;
+	}
+	m->gl.vao = m->geometry->vao;
+	m->gl.vbo = m->geometry->vbo;
+	m->gl.ibo = m->geometry->ibo;
+	m->gl.vbo_size = m->geometry->vbo_size;
+	m->gl.ibo_size = m->geometry->ibo_size;
 	return m;
 }
 
-static void mesh_transform(mesh_node_t * mesh, mat4x4 out_m) {
-	if (mesh->transform.absolute) {
-		mat4x4_identity(out_m);
-		mat4x4_translate(out_m, recurse_state.pos[0] + mesh->transform.pos[0], recurse_state.pos[1] + mesh->transform.pos[1], recurse_state.pos[0] + mesh->transform.pos[2]);
-		recurse_state.pos[0] = mesh->transform.pos[0];
-		recurse_state.pos[1] = mesh->transform.pos[1];
-		recurse_state.pos[2] = mesh->transform.pos[2];
-		recurse_state.rot[0] = mesh->transform.rot[0];
-		recurse_state.rot[1] = mesh->transform.rot[1];
-		recurse_state.rot[2] = mesh->transform.rot[2];
-		recurse_state.scale[0] = mesh->transform.scale[0];
-		recurse_state.scale[1] = mesh->transform.scale[1];
-		recurse_state.scale[2] = mesh->transform.scale[2];
-	} else {
-		mat4x4_translate_in_place(out_m, recurse_state.pos[0] + mesh->transform.pos[0], recurse_state.pos[1] + mesh->transform.pos[1], recurse_state.pos[2] + mesh->transform.pos[2]);
-		recurse_state.pos[0] += mesh->transform.pos[0];
-		recurse_state.pos[1] += mesh->transform.pos[1];
-		recurse_state.pos[2] += mesh->transform.pos[2];
-		recurse_state.rot[0] += mesh->transform.rot[0];
-		recurse_state.rot[1] += mesh->transform.rot[1];
-		recurse_state.rot[2] += mesh->transform.rot[2];
-		recurse_state.scale[0] *= mesh->transform.scale[0];
-		recurse_state.scale[1] *= mesh->transform.scale[1];
-		recurse_state.scale[2] *= mesh->transform.scale[2];
-	}
-	mat4x4_identity(recurse_state.model_r);
-	mat4x4_rotate_X(out_m, out_m, (recurse_state.rot[0]) * 3.141592f / 180.0f);
-	mat4x4_rotate_Y(out_m, out_m, (recurse_state.rot[1]) * 3.141592f / 180.0f);
-	mat4x4_rotate_Z(out_m, out_m, (recurse_state.rot[2]) * 3.141592f / 180.0f);
-	mat4x4_rotate_X(recurse_state.model_r, recurse_state.model_r, (recurse_state.rot[0]) * 3.141592f / 180.0f);
-	mat4x4_rotate_Y(recurse_state.model_r, recurse_state.model_r, (recurse_state.rot[1]) * 3.141592f / 180.0f);
-	mat4x4_rotate_Z(recurse_state.model_r, recurse_state.model_r, (recurse_state.rot[2]) * 3.141592f / 180.0f);
-	mat4x4_scale_aniso(out_m, out_m, recurse_state.scale[0], recurse_state.scale[1], recurse_state.scale[2]);
-}
-
-static void mesh_draw(mesh_node_t * mesh, mat4x4 out_m) {
-	if (mesh == NULL || out_m == NULL) {
+static mesh_geometry_t * mesh_geometry_acquire(kgfw_graphics_mesh_t * mesh) {
+	for (unsigned long long int i = 0; i < state.geometries.count; ++i) {
+		mesh_geometry_t * g = state.geometries.geometries[i];
+		if (g->vertices == mesh->vertices && g->indices == mesh->indices && g->vbo_size == mesh->vertices_count && g->ibo_size == mesh->indices_count &&
+			g->lods_source == mesh->lods && g->lods_source_count == mesh->lods_count) {
+			++g->references;
+			return g;
+		}
+	}
+
+	if (state.geometries.count == state.geometries.capacity) {
+		unsigned long long int capacity = (state.geometries.capacity == 0) ? 16 : state.geometries.capacity * 2;
+		mesh_geometry_t ** geometries = realloc(state.geometries.geometries, sizeof(mesh_geometry_t *) * capacity);
+		if (geometries == NULL) {
+			return NULL;
+		}
+		state.geometries.geometries = geometries;
+		state.geometries.capacity = capacity;
+	}
+
+	mesh_geometry_t * g = malloc(sizeof(mesh_geometry_t));
+	if (g == NULL) {
+		return NULL;
+	}
+	g->vertices = mesh->vertices;
+	g->indices = mesh->indices;
+	g->lods_source = mesh->lods;
+	g->lods_source_count = mesh->lods_count;
+	g->vbo_size = mesh->vertices_count;
+	g->ibo_size = mesh->indices_count;
+	g->references = 1;
+	kgfw_bounds_from_points(&mesh->vertices[0].x, mesh->vertices_count, sizeof(kgfw_graphics_vertex_t), &g->aabb, &g->sphere);
+
+	/* every level goes in the one index buffer, after the full index set */
+	g->lods[0].offset = 0;
+	g->lods[0].count = mesh->indices_count;
+	g->lods[0].error = 0;
+	g->lods_count = 1;
+	unsigned long long int indices_total = mesh->indices_count;
+	for (unsigned long long int l = 0; l < mesh->lods_count && l < KGFW_GRAPHICS_MESH_LODS_MAX; ++l) {
+		g->lods[g->lods_count].offset = indices_total;
+		g->lods[g->lods_count].count = mesh->lods[l].indices_count;
+		g->lods[g->lods_count].error = mesh->lods[l].error;
+		indices_total += mesh->lods[l].indices_count;
+		++g->lods_count;
+	}
+
+	GL_CALL(glGenVertexArrays(1, &g->vao));
+	GL_CALL(glGenBuffers(1, &g->vbo));
+	GL_CALL(glGenBuffers(1, &g->ibo));
+	GL_CALL(glBindVertexArray(g->vao));
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g->vbo));
+	GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(kgfw_graphics_vertex_t) * mesh->vertices_count, mesh->vertices, GL_STATIC_DRAW));
+	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g->ibo));
+	GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices_total, NULL, GL_STATIC_DRAW));
+	GL_CALL(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(unsigned int) * mesh->indices_count, mesh->indices));
+	for (unsigned int l = 1; l < g->lods_count; ++l) {
+		GL_CALL(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * g->lods[l].offset, sizeof(unsigned int) * g->lods[l].count, mesh->lods[l - 1].indices));
+	}
+	vertex_attributes(g->vbo, g->ibo);
+	GL_CALL(glBindVertexArray(0));
+
+	state.geometries.geometries[state.geometries.count++] = g;
+	return g;
+}
+
+static void mesh_geometry_release(mesh_geometry_t * geometry) {
+	if (--geometry->references != 0) {
 		return;
 	}
-	if (mesh->gl.vbo_size == 0 || mesh->gl.ibo_size == 0 || mesh->gl.vbo == 0 || mesh->gl.ibo == 0) {
+
+	for (unsigned long long int i = 0; i < state.geometries.count; ++i) {
+		if (state.geometries.geometries[i] == geometry) {
+			state.geometries.geometries[i] = state.geometries.geometries[--state.geometries.count];
+			break;
+		}
+	}
+
+	GL_CALL(glDeleteVertexArrays(1, &geometry->vao));
+	GL_CALL(glDeleteBuffers(1, &geometry->vbo));
+	GL_CALL(glDeleteBuffers(1, &geometry->ibo));
+	free(geometry);
+}
+
+/* points the bound vertex array at buffers of kgfw_graphics_vertex_t and their indices */
+static void vertex_attributes(GLuint vbo, GLuint ibo) {
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+	GL_CALL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(kgfw_graphics_vertex_t), (void *) offsetof(kgfw_graphics_vertex_t, x)));
+	GL_CALL(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(kgfw_graphics_vertex_t), (void *) offsetof(kgfw_graphics_vertex_t, r)));
+	GL_CALL(glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(kgfw_graphics_vertex_t), (void *) offsetof(kgfw_graphics_vertex_t, nx)));
+	GL_CALL(glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(kgfw_graphics_vertex_t), (void *) offsetof(kgfw_graphics_vertex_t, u)));
+	GL_CALL(glEnableVertexAttribArray(0));
+	GL_CALL(glEnableVertexAttribArray(1));
+	GL_CALL(glEnableVertexAttribArray(2));
+	GL_CALL(glEnableVertexAttribArray(3));
+}
+
+static GLuint texture_acquire(kgfw_graphics_texture_t * texture) {
+	for (unsigned long long int i = 0; i < state.textures.count; ++i) {
+		texture_cached_t * c = state.textures.textures[i];
+		if (c->source.bitmap == texture->bitmap && c->source.width == texture->width && c->source.height == texture->height && c->source.fmt == texture->fmt &&
+			c->source.u_wrap == texture->u_wrap && c->source.v_wrap == texture->v_wrap && c->source.filtering == texture->filtering) {
+			++c->references;
+			return c->id;
+		}
+	}
+
+	if (state.textures.count == state.textures.capacity) {
+		unsigned long long int capacity = (state.textures.capacity == 0) ? 16 : state.textures.capacity * 2;
+		texture_cached_t ** textures = realloc(state.textures.textures, sizeof(texture_cached_t *) * capacity);
+		if (textures == NULL) {
+			return 0;
+		}
+		state.textures.textures = textures;
+		state.textures.capacity = capacity;
+	}
+
+	texture_cached_t * c = malloc(sizeof(texture_cached_t));
+	if (c == NULL) {
+		return 0;
+	}
+	c->source = *texture;
+	c->references = 1;
+
+	GLenum filtering = (texture->filtering == KGFW_GRAPHICS_TEXTURE_FILTERING_NEAREST) ? GL_NEAREST : GL_LINEAR;
+	GLenum filtering_mipmap = (texture->filtering == KGFW_GRAPHICS_TEXTURE_FILTERING_NEAREST) ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR;
+	GLenum u_wrap = (texture->u_wrap == KGFW_GRAPHICS_TEXTURE_WRAP_CLAMP) ? GL_CLAMP_TO_BORDER : GL_REPEAT;
+	GLenum v_wrap = (texture->v_wrap == KGFW_GRAPHICS_TEXTURE_WRAP_CLAMP) ? GL_CLAMP_TO_BORDER : GL_REPEAT;
+	GL_CALL(glGenTextures(1, &c->id));
+	GL_CALL(glBindTexture(GL_TEXTURE_2D, c->id));
+	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, u_wrap));
+	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, v_wrap));
+	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering));
+	GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering_mipmap));
+	GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture->width, texture->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, texture->bitmap));
+	GL_CALL(glGenerateMipmap(GL_TEXTURE_2D));
+
+	state.textures.textures[state.textures.count++] = c;
+	return c->id;
+}
+
+static void texture_release(GLuint id) {
+	for (unsigned long long int i = 0; i < state.textures.count; ++i) {
+		texture_cached_t * c = state.textures.textures[i];
+		if (c->id != id) {
+			continue;
+		}
+		if (--c->references != 0) {
+			return;
+		}
+
+		state.textures.textures[i] = state.textures.textures[--state.textures.count];
+		GL_CALL(glDeleteTextures(1, &c->id));
+		free(c);
+		return;
+	}
+}
+
+static void mesh_draw(mesh_node_t * mesh, mat4x4 model, long long int slot) {
+	if (model == NULL || !mesh_drawable(mesh)) {
 		return;
 	}
 
+	mesh_bind(mesh, model, slot);
+
+	/* the index buffer is part of the vertex array's state */
+	if (mesh->gl.vao != state.bound.vao) {
+		GL_CALL(glBindVertexArray(mesh->gl.vao));
+		state.bound.vao = mesh->gl.vao;
+	}
+	//GL_CALL(glDrawArrays(GL_TRIANGLES, 0, mesh->gl.vbo_size));
+	unsigned int lod = mesh_lod(mesh, model);
+	GLsizei count = (GLsizei) mesh->geometry->lods[lod].count;
+	const void * offset = (const void *) (sizeof(unsigned int) * mesh->geometry->lods[lod].offset);
+	if (mesh->instances != NULL) {
+		mesh_instances_upload(mesh->instances);
+		GL_CALL(glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset, mesh->instances->count));
+	}
+	else {
+		GL_CALL(glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset));
+	}
+}
+
+/* everything a draw of mesh needs besides its vertex array */
+static void mesh_bind(mesh_node_t * mesh, mat4x4 model, long long int slot) {
 	GLuint program = (mesh->gl.program == 0) ? state.program : mesh->gl.program;
-	GL_CALL(glUseProgram(program));
-	GLint uniform_model = GL_CALL(glGetUniformLocation(program, "unif_m"));
-	GLint uniform_vp = GL_CALL(glGetUniformLocation(program, "unif_vp"));
-	GLint uniform_time = GL_CALL(glGetUniformLocation(program, "unif_time"));
-	GLint uniform_view = GL_CALL(glGetUniformLocation(program, "unif_view_pos"));
-	GLint uniform_textured_color = GL_CALL(glGetUniformLocation(program, "unif_textured_color"));
-	GLint uniform_textured_normal = GL_CALL(glGetUniformLocation(program, "unif_textured_normal"));
-	GLint uniform_texture_color = GL_CALL(glGetUniformLocation(program, "unif_texture_color"));
-	GLint uniform_texture_normal = GL_CALL(glGetUniformLocation(program, "unif_texture_normal"));
-
-	mat4x4_identity(out_m);
-	mesh_transform(mesh, out_m);
-
-	GL_CALL(glUniformMatrix4fv(uniform_model, 1, GL_FALSE, &out_m[0][0]));
-	GL_CALL(glUniformMatrix4fv(uniform_vp, 1, GL_FALSE, &state.vp[0][0]));
-	GL_CALL(glUniform1f(uniform_time, kgfw_time_get()));
-	GL_CALL(glUniform3f(uniform_view, state.camera->pos[0], state.camera->pos[1], state.camera->pos[2]));
-
-	GL_CALL(glUniform1i(uniform_texture_color, 0));
-	if (mesh->gl.tex == 0) {
-		GL_CALL(glUniform1f(uniform_textured_color, 0));
-		GL_CALL(glActiveTexture(GL_TEXTURE0));
-		GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
-	} else {
-		GL_CALL(glUniform1f(uniform_textured_color, 1));
+	const program_uniforms_t * uniforms = program_uniforms(program);
+	const GLint * locations = uniforms->locations;
+	if (program != state.bound.program) {
+		GL_CALL(glUseProgram(program));
+		state.bound.program = program;
+		state.bound.textured_color = -1;
+		state.bound.textured_normal = -1;
+
+		/* the same for every mesh this frame, only needs setting once per program */
+		if (uniforms->frame_block == GL_INVALID_INDEX) {
+			GL_CALL(glUniformMatrix4fv(locations[UNIFORM_VP], 1, GL_FALSE, &state.vp[0][0]));
+			GL_CALL(glUniform1f(locations[UNIFORM_TIME], kgfw_time_get()));
+			GL_CALL(glUniform3f(locations[UNIFORM_VIEW_POS], state.camera->pos[0], state.camera->pos[1], state.camera->pos[2]));
+		}
+		GL_CALL(glUniform1i(locations[UNIFORM_TEXTURE_COLOR], 0));
+		GL_CALL(glUniform1i(locations[UNIFORM_TEXTURE_NORMAL], 1));
+	}
+
+	if (uniforms->draw_block != GL_INVALID_INDEX) {
+		if (slot >= 0) {
+			GL_CALL(glBindBufferRange(GL_UNIFORM_BUFFER, UBO_BINDING_DRAW, state.ubo.ring, (state.ubo.region * state.ubo.slots + slot) * state.ubo.stride, sizeof(draw_block_t)));
+		}
+		else {
+			draw_block_t block;
+			mesh_draw_block(mesh, model, &block);
+			GL_CALL(glBindBuffer(GL_UNIFORM_BUFFER, state.ubo.single));
+			GL_CALL(glBufferData(GL_UNIFORM_BUFFER, sizeof(draw_block_t), &block, GL_DYNAMIC_DRAW));
+			GL_CALL(glBindBufferRange(GL_UNIFORM_BUFFER, UBO_BINDING_DRAW, state.ubo.single, 0, sizeof(draw_block_t)));
+		}
+	}
+	else {
+		GL_CALL(glUniformMatrix4fv(locations[UNIFORM_M], 1, GL_FALSE, &model[0][0]));
+
+		int textured = (mesh->gl.tex != 0);
+		if (textured != state.bound.textured_color) {
+			GL_CALL(glUniform1f(locations[UNIFORM_TEXTURED_COLOR], (float) textured));
+			state.bound.textured_color = textured;
+		}
+		textured = (mesh->gl.normal != 0);
+		if (textured != state.bound.textured_normal) {
+			GL_CALL(glUniform1f(locations[UNIFORM_TEXTURED_NORMAL], (float) textured));
+			state.bound.textured_normal = textured;
+		}
+	}
+
+	if (mesh->gl.tex != state.bound.tex) {
 		GL_CALL(glActiveTexture(GL_TEXTURE0));
 		GL_CALL(glBindTexture(GL_TEXTURE_2D, mesh->gl.tex));
+		state.bound.tex = mesh->gl.tex;
 	}
 
-	GL_CALL(glUniform1i(uniform_texture_normal, 1));
-	if (mesh->gl.normal == 0) {
-		GL_CALL(glUniform1f(uniform_textured_normal, 0));
-		GL_CALL(glActiveTexture(GL_TEXTURE1));
-		GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
-	} else {
-		GL_CALL(glUniform1f(uniform_textured_normal, 1));
+	if (mesh->gl.normal != state.bound.normal) {
 		GL_CALL(glActiveTexture(GL_TEXTURE1));
 		GL_CALL(glBindTexture(GL_TEXTURE_2D, mesh->gl.normal));
+		state.bound.normal = mesh->gl.normal;
 	}
+}
 
-	GL_CALL(glBindVertexArray(mesh->gl.vao));
-	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, mesh->gl.vbo));
-	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->gl.ibo));
-	//GL_CALL(glDrawArrays(GL_TRIANGLES, 0, mesh->gl.vbo_size));
-	GL_CALL(glDrawElements(GL_TRIANGLES, mesh->gl.ibo_size, GL_UNSIGNED_INT, 0));
+static void mesh_draw_block(mesh_node_t * mesh, mat4x4 model, draw_block_t * out_block) {
+	memcpy(out_block->m, model, sizeof(mat4x4));
+	out_block->textured_color = (mesh->gl.tex != 0) ? 1.0f : 0.0f;
+	out_block->textured_normal = (mesh->gl.normal != 0) ? 1.0f : 0.0f;
+	out_block->_pad[0] = 0;
+	out_block->_pad[1] = 0;
 }
 
-static void meshes_draw_recursive(mesh_node_t * mesh) {
+static unsigned char mesh_drawable(mesh_node_t * mesh) {
 	if (mesh == NULL) {
+		return 0;
+	}
+
+	if (mesh->instances != NULL && mesh->instances->count == 0) {
+		return 0;
+	}
+
+	return !(mesh->gl.vbo_size == 0 || mesh->gl.ibo_size == 0 || mesh->gl.vbo == 0 || mesh->gl.ibo == 0);
+}
+
+static unsigned long long int mesh_draw_key(mesh_node_t * mesh, mat4x4 model) {
+	GLuint program = (mesh->gl.program == 0) ? state.program : mesh->gl.program;
+
+	/* front to back within the same state, so depth testing rejects more fragments */
+	float dx = model[3][0] - state.camera->pos[0];
+	float dy = model[3][1] - state.camera->pos[1];
+	float dz = model[3][2] - state.camera->pos[2];
+	float depth = (state.camera->fplane > 0) ? sqrtf(dx * dx + dy * dy + dz * dz) / state.camera->fplane : 0;
+	if (depth > 1) {
+		depth = 1;
+	}
+
+	return ((program & DRAW_KEY_PROGRAM_MASK) << DRAW_KEY_PROGRAM_SHIFT) |
+		((mesh->gl.tex & DRAW_KEY_TEXTURE_MASK) << DRAW_KEY_TEXTURE_SHIFT) |
+		((mesh->gl.normal & DRAW_KEY_NORMAL_MASK) << DRAW_KEY_NORMAL_SHIFT) |
+		((mesh->gl.vao & DRAW_KEY_VAO_MASK) << DRAW_KEY_VAO_SHIFT) |
+		((unsigned long long int) (depth * DRAW_KEY_DEPTH_MASK) & DRAW_KEY_DEPTH_MASK);
+}
+
+/*
+	the simplest level whose error covers no more than state.lod_error pixels at the mesh's closest point.
+	instanced meshes pick one level for every instance, by whichever is closest
+*/
+static unsigned int mesh_lod(mesh_node_t * mesh, mat4x4 model) {
+	mesh_geometry_t * g = mesh->geometry;
+	if (g->lods_count < 2 || !(state.settings & KGFW_GRAPHICS_SETTINGS_LOD)) {
+		return 0;
+	}
+
+	float scale = 0;
+	for (unsigned int a = 0; a < 3; ++a) {
+		float s = vec3_len(model[a]);
+		scale = (s > scale) ? s : scale;
+	}
+	if (mesh->instances != NULL) {
+		scale *= mesh->instances->scale;
+	}
+
+	/* pixels a unit of error covers */
+	float pixels;
+	if (state.camera->ortho) {
+		pixels = (float) state.viewport_height / (2 * state.camera->scale[1]);
+	}
+	else {
+		float dx = mesh->sphere.center[0] - state.camera->pos[0];
+		float dy = mesh->sphere.center[1] - state.camera->pos[1];
+		float dz = mesh->sphere.center[2] - state.camera->pos[2];
+		float distance = sqrtf(dx * dx + dy * dy + dz * dz) - mesh->sphere.radius;
+		if (distance < state.camera->nplane) {
+			distance = state.camera->nplane;
+		}
+		if (distance <= 0) {
+			return 0;
+		}
+		pixels = (float) state.viewport_height / (2 * distance * tanf(state.camera->fov * 3.141592f / 360.0f));
+	}
+
+	unsigned int level = 0;
+	while (level + 1 < g->lods_count && g->lods[level + 1].error * scale * pixels <= state.lod_error) {
+		++level;
+	}
+	return level;
+}
+
+static int mesh_instances_reserve(mesh_instances_t * instances, unsigned long long int count) {
+	if (count <= instances->capacity) {
+		return 0;
+	}
+
+	unsigned long long int capacity = (instances->capacity == 0) ? INSTANCES_MIN_CAPACITY : instances->capacity;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+
+	void * p = realloc(instances->matrices, sizeof(mat4x4) * capacity);
+	if (p == NULL) {
+		return 1;
+	}
+	instances->matrices = p;
+	p = realloc(instances->handles, sizeof(kgfw_graphics_instance_t) * capacity);
+	if (p == NULL) {
+		return 1;
+	}
+	instances->handles = p;
+	if (instances->indices == NULL) {
+		instances->indices = malloc(sizeof(unsigned int) * capacity);
+		if (instances->indices == NULL) {
+			return 1;
+		}
+		instances->handles_capacity = capacity;
+	}
+
+	instances->capacity = capacity;
+	return 0;
+}
+
+static void mesh_instances_upload(mesh_instances_t * instances) {
+	if (instances->dirty_end > instances->count) {
+		instances->dirty_end = instances->count;
+	}
+	if (instances->dirty_begin >= instances->dirty_end) {
 		return;
 	}
 
-	mesh_draw(mesh, recurse_state.model);
-	if (mesh->child == NULL) {
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, instances->vbo));
+	if (instances->vbo_capacity < instances->count) {
+		/* the vertex array keeps pointing at the same buffer, only its storage is replaced */
+		GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(mat4x4) * instances->capacity, NULL, GL_DYNAMIC_DRAW));
+		instances->vbo_capacity = instances->capacity;
+		instances->dirty_begin = 0;
+		instances->dirty_end = instances->count;
+	}
+	GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, sizeof(mat4x4) * instances->dirty_begin, sizeof(mat4x4) * (instances->dirty_end - instances->dirty_begin), instances->matrices[instances->dirty_begin]));
+
+	instances->dirty_begin = 0;
+	instances->dirty_end = 0;
+}
+
+static void mesh_instances_free(mesh_instances_t * instances) {
+	if (instances->vbo != 0) {
+		GL_CALL(glDeleteBuffers(1, &instances->vbo));
+	}
+	free(instances->matrices);
+	free(instances->handles);
+	free(instances->indices);
+	free(instances);
+}
+
+/* the node's bounds are recomputed with its world matrix by the next update */
+static void mesh_instances_changed(mesh_node_t * mesh) {
+	mesh->instances->bounds_dirty = 1;
+	kgfw_transform_hierarchy_mark_dirty(&state.meshes, mesh->hierarchy);
+}
+
+static void mesh_bounds(mesh_node_t * mesh, mat4x4 world, kgfw_aabb_t * out_aabb, kgfw_sphere_t * out_sphere) {
+	mesh_instances_t * instances = mesh->instances;
+	if (instances == NULL || instances->count == 0) {
+		kgfw_aabb_transform(&mesh->geometry->aabb, world, out_aabb);
+		kgfw_sphere_transform(&mesh->geometry->sphere, world, out_sphere);
 		return;
 	}
 
-	meshes_draw_recursive_fchild(mesh->child);
+	if (instances->bounds_dirty) {
+		instances->scale = 0;
+		for (unsigned long long int i = 0; i < instances->count; ++i) {
+			kgfw_aabb_t aabb;
+			kgfw_aabb_transform(&mesh->geometry->aabb, instances->matrices[i], &aabb);
+			if (i == 0) {
+				instances->aabb = aabb;
+			} else {
+				kgfw_aabb_union(&instances->aabb, &aabb, &instances->aabb);
+			}
+			for (unsigned int a = 0; a < 3; ++a) {
+				float scale = vec3_len(instances->matrices[i][a]);
+				instances->scale = (scale > instances->scale) ? scale : instances->scale;
+			}
+		}
+
+		/* centered on the box and reaching the far side of every instance's sphere */
+		float radius = 0;
+		for (unsigned int a = 0; a < 3; ++a) {
+			instances->sphere.center[a] = (instances->aabb.min[a] + instances->aabb.max[a]) * 0.5f;
+		}
+		for (unsigned long long int i = 0; i < instances->count; ++i) {
+			kgfw_sphere_t sphere;
+			kgfw_sphere_transform(&mesh->geometry->sphere, instances->matrices[i], &sphere);
+			float dx = sphere.center[0] - instances->sphere.center[0];
+			float dy = sphere.center[1] - instances->sphere.center[1];
+			float dz = sphere.center[2] - instances->sphere.center[2];
+			float r = sqrtf(dx * dx + dy * dy + dz * dz) + sphere.radius;
+			if (r > radius) {
+				radius = r;
+			}
+		}
+		instances->sphere.radius = radius;
+		instances->bounds_dirty = 0;
+	}
+
+	kgfw_aabb_transform(&instances->aabb, world, out_aabb);
+	kgfw_sphere_transform(&instances->sphere, world, out_sphere);
 }
 
-static void meshes_draw_recursive_fchild(mesh_node_t * mesh) {
-	if (mesh == NULL) {
+/* moves the visibility tree leaves of every mesh the last hierarchy update recomputed */
+static void meshes_bounds_update(void) {
+	kgfw_transform_hierarchy_t * h = &state.meshes;
+	unsigned long long int ranges = (h->updated_all) ? 1 : h->updated_count;
+	for (unsigned long long int r = 0; r < ranges; ++r) {
+		unsigned long long int begin = (h->updated_all) ? 0 : h->updated[r];
+		unsigned long long int end = (h->updated_all) ? h->count : begin + h->sizes[begin];
+		for (unsigned long long int i = begin; i < end; ++i) {
+			mesh_node_t * mesh = h->datas[i];
+			kgfw_aabb_t aabb;
+			kgfw_sphere_t sphere;
+			mesh_bounds(mesh, h->worlds[i], &aabb, &sphere);
+			mesh->sphere = sphere;
+			/* the baked copy of the node is out of date */
+			if (mesh->is_static) {
+				state.batching.dirty = 1;
+			}
+			kgfw_bvh_move(&state.bvh, mesh->leaf, &aabb, &sphere);
+		}
+	}
+}
+
+static void meshes_visible_push(void * leaf_data, void * data) {
+	if (state.visible.count == state.visible.capacity) {
+		unsigned long long int capacity = (state.visible.capacity == 0) ? 256 : state.visible.capacity * 2;
+		mesh_node_t ** nodes = realloc(state.visible.nodes, sizeof(mesh_node_t *) * capacity);
+		if (nodes == NULL) {
+			state.visible.overflow = 1;
+			return;
+		}
+		state.visible.nodes = nodes;
+		state.visible.capacity = capacity;
+	}
+
+	state.visible.nodes[state.visible.count++] = leaf_data;
+}
+
+/* merges every static node into batches by program and textures, nodes that fit no batch are drawn on their own */
+static void batches_build(void) {
+	state.batching.dirty = 0;
+	for (unsigned long long int i = 0; i < state.meshes.count; ++i) {
+		((mesh_node_t *) state.meshes.datas[i])->batch = NULL;
+	}
+	batches_free();
+	/* needs GL 3.2, not there on WebGL */
+	if (!(state.settings & KGFW_GRAPHICS_SETTINGS_BATCHING) || glMultiDrawElementsBaseVertex == NULL) {
+		return;
+	}
+
+	mesh_node_t ** members = malloc(sizeof(mesh_node_t *) * (state.meshes.count + 1));
+	if (members == NULL) {
+		return;
+	}
+	unsigned long long int members_count = 0;
+	for (unsigned long long int i = 0; i < state.meshes.count; ++i) {
+		mesh_node_t * mesh = state.meshes.datas[i];
+		if (mesh->is_static && mesh->instances == NULL && mesh_drawable(mesh)) {
+			members[members_count++] = mesh;
+		}
+	}
+	qsort(members, members_count, sizeof(mesh_node_t *), batch_compare);
+
+	/* runs of a single node gain nothing from batching and are dropped */
+	unsigned long long int batched = 0;
+	unsigned long long int batches_count = 0;
+	unsigned long long int vertices_count = 0;
+	unsigned long long int indices_count = 0;
+	for (unsigned long long int i = 0; i < members_count;) {
+		unsigned long long int end = i + 1;
+		while (end < members_count && batch_compare(&members[i], &members[end]) == 0) {
+			++end;
+		}
+		if (end - i > 1) {
+			for (unsigned long long int m = i; m < end; ++m) {
+				vertices_count += members[m]->geometry->vbo_size;
+				indices_count += members[m]->geometry->ibo_size;
+				members[batched++] = members[m];
+			}
+			++batches_count;
+		}
+		i = end;
+	}
+	if (batches_count == 0 || vertices_count > 0x7FFFFFFF) {
+		free(members);
 		return;
 	}
 
-	vec3 pos;
-	vec3 rot;
-	vec3 scale;
-	memcpy(pos, recurse_state.pos, sizeof(pos));
-	memcpy(rot, recurse_state.rot, sizeof(rot));
-	memcpy(scale, recurse_state.scale, sizeof(scale));
+	kgfw_graphics_vertex_t * vertices = malloc(sizeof(kgfw_graphics_vertex_t) * vertices_count);
+	unsigned int * indices = malloc(sizeof(unsigned int) * indices_count);
+	state.batching.batches = malloc(sizeof(mesh_batch_t) * batches_count);
+	state.batching.counts = malloc(sizeof(GLsizei) * batched);
+	state.batching.offsets = malloc(sizeof(const void *) * batched);
+	state.batching.base_vertices = malloc(sizeof(GLint) * batched);
+	state.batching.draw_counts = malloc(sizeof(GLsizei) * batched);
+	state.batching.draw_offsets = malloc(sizeof(const void *) * batched);
+	state.batching.draw_base_vertices = malloc(sizeof(GLint) * batched);
+	if (vertices == NULL || indices == NULL || state.batching.batches == NULL || state.batching.counts == NULL || state.batching.offsets == NULL ||
+		state.batching.base_vertices == NULL || state.batching.draw_counts == NULL || state.batching.draw_offsets == NULL || state.batching.draw_base_vertices == NULL) {
+		free(vertices);
+		free(indices);
+		free(members);
+		batches_free();
+		return;
+	}
 
-	meshes_draw_recursive(mesh);
-	for (mesh_node_t * m = mesh;;) {
-		m = m->sibling;
-		if (m == NULL) {
-			break;
+	/* indices are copied as they are, each member's draw adds its base vertex */
+	unsigned long long int vertex = 0;
+	unsigned long long int index = 0;
+	for (unsigned long long int m = 0; m < batched; ++m) {
+		mesh_node_t * mesh = members[m];
+		mesh_geometry_t * g = mesh->geometry;
+		if (m == 0 || batch_compare(&members[m - 1], &members[m]) != 0) {
+			mesh_batch_t * b = &state.batching.batches[state.batching.count++];
+			b->first = mesh;
+			b->member = m;
+			b->members_count = 0;
+			b->draws_count = 0;
+		}
+		mesh_batch_t * b = &state.batching.batches[state.batching.count - 1];
+		++b->members_count;
+		mesh->batch = b;
+		mesh->batch_member = m;
+
+		vec4 * world = kgfw_transform_hierarchy_world(&state.meshes, mesh->hierarchy);
+		/* normals go through the inverse transpose so non-uniform scale keeps them perpendicular */
+		mat4x4 inverse;
+		mat4x4_invert(inverse, world);
+		for (unsigned long long int v = 0; v < g->vbo_size; ++v) {
+			const kgfw_graphics_vertex_t * in = &g->vertices[v];
+			kgfw_graphics_vertex_t * out = &vertices[vertex + v];
+			*out = *in;
+			out->x = world[0][0] * in->x + world[1][0] * in->y + world[2][0] * in->z + world[3][0];
+			out->y = world[0][1] * in->x + world[1][1] * in->y + world[2][1] * in->z + world[3][1];
+			out->z = world[0][2] * in->x + world[1][2] * in->y + world[2][2] * in->z + world[3][2];
+			vec3 n = {
+				inverse[0][0] * in->nx + inverse[0][1] * in->ny + inverse[0][2] * in->nz,
+				inverse[1][0] * in->nx + inverse[1][1] * in->ny + inverse[1][2] * in->nz,
+				inverse[2][0] * in->nx + inverse[2][1] * in->ny + inverse[2][2] * in->nz,
+			};
+			float length = vec3_len(n);
+			if (length > 0) {
+				vec3_scale(n, n, 1.0f / length);
+			}
+			out->nx = n[0];
+			out->ny = n[1];
+			out->nz = n[2];
 		}
+		memcpy(&indices[index], g->indices, sizeof(unsigned int) * g->ibo_size);
+
+		state.batching.counts[m] = (GLsizei) g->ibo_size;
+		state.batching.offsets[m] = (const void *) (sizeof(unsigned int) * index);
+		state.batching.base_vertices[m] = (GLint) vertex;
+		vertex += g->vbo_size;
+		index += g->ibo_size;
+	}
+	state.batching.members_count = batched;
+
+	if (state.batching.vao == 0) {
+		GL_CALL(glGenVertexArrays(1, &state.batching.vao));
+		GL_CALL(glGenBuffers(1, &state.batching.vbo));
+		GL_CALL(glGenBuffers(1, &state.batching.ibo));
+		GL_CALL(glBindVertexArray(state.batching.vao));
+		vertex_attributes(state.batching.vbo, state.batching.ibo);
+		GL_CALL(glBindVertexArray(0));
+		state.bound.vao = GL_NAME_UNBOUND;
+	}
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, state.batching.vbo));
+	GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(kgfw_graphics_vertex_t) * vertices_count, vertices, GL_STATIC_DRAW));
+	/* element array bindings belong to the bound vertex array, the batch's own is safe to change */
+	GL_CALL(glBindVertexArray(state.batching.vao));
+	GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices_count, indices, GL_STATIC_DRAW));
+	GL_CALL(glBindVertexArray(0));
+	state.bound.vao = GL_NAME_UNBOUND;
+
+	free(vertices);
+	free(indices);
+	free(members);
+}
+
+/* the buffers are kept for the next build */
+static void batches_free(void) {
+	free(state.batching.batches);
+	free(state.batching.counts);
+	free(state.batching.offsets);
+	free(state.batching.base_vertices);
+	free(state.batching.draw_counts);
+	free(state.batching.draw_offsets);
+	free(state.batching.draw_base_vertices);
+	state.batching.batches = NULL;
+	state.batching.counts = NULL;
+	state.batching.offsets = NULL;
+	state.batching.base_vertices = NULL;
+	state.batching.draw_counts = NULL;
+	state.batching.draw_offsets = NULL;
+	state.batching.draw_base_vertices = NULL;
+	state.batching.count = 0;
+	state.batching.members_count = 0;
+}
+
+/* by the state a node is drawn with */
+static int batch_compare(const void * a, const void * b) {
+	const mesh_node_t * x = *(mesh_node_t * const *) a;
+	const mesh_node_t * y = *(mesh_node_t * const *) b;
+	GLuint px = (x->gl.program == 0) ? state.program : x->gl.program;
+	GLuint py = (y->gl.program == 0) ? state.program : y->gl.program;
+	if (px != py) {
+		return (px < py) ? -1 : 1;
+	}
+	if (x->gl.tex != y->gl.tex) {
+		return (x->gl.tex < y->gl.tex) ? -1 : 1;
+	}
+	if (x->gl.normal != y->gl.normal) {
+		return (x->gl.normal < y->gl.normal) ? -1 : 1;
+	}
+	return 0;
+}
+
+static void batch_push(mesh_node_t * mesh) {
+	mesh_batch_t * b = mesh->batch;
+	unsigned long long int d = b->member + b->draws_count++;
+	state.batching.draw_counts[d] = state.batching.counts[mesh->batch_member];
+	state.batching.draw_offsets[d] = state.batching.offsets[mesh->batch_member];
+	state.batching.draw_base_vertices[d] = state.batching.base_vertices[mesh->batch_member];
+}
+
+/* every visible member in one call, their transforms are already in the vertices */
+static void batch_draw(mesh_batch_t * batch) {
+	if (batch->draws_count == 0) {
+		return;
+	}
 
-		memcpy(recurse_state.pos, pos, sizeof(pos));
-		memcpy(recurse_state.rot, rot, sizeof(rot));
-		memcpy(recurse_state.scale, scale, sizeof(scale));
-		meshes_draw_recursive(m);
+	mat4x4 identity;
+	mat4x4_identity(identity);
+	mesh_bind(batch->first, identity, -1);
+	if (state.batching.vao != state.bound.vao) {
+		GL_CALL(glBindVertexArray(state.batching.vao));
+		state.bound.vao = state.batching.vao;
 	}
+	GL_CALL(glMultiDrawElementsBaseVertex(GL_TRIANGLES, &state.batching.draw_counts[batch->member], GL_UNSIGNED_INT, &state.batching.draw_offsets[batch->member], (GLsizei) batch->draws_count, &state.batching.draw_base_vertices[batch->member]));
 }
 
 static void meshes_free_recursive(mesh_node_t * mesh) {
@@ -607,6 +1861,9 @@ static void meshes_free_recursive_fchild(mesh_node_t * mesh) {
 }
 
 static void update_settings(unsigned int change) {
+	if (change & KGFW_GRAPHICS_SETTINGS_BATCHING) {
+		state.batching.dirty = 1;
+	}
 	if (change & KGFW_GRAPHICS_SETTINGS_VSYNC) {
 		if (state.window != NULL) {
 			if (state.settings & KGFW_GRAPHICS_SETTINGS_VSYNC) {
@@ -634,6 +1891,7 @@ static int gfx_command(int argc, char ** argv) {
 		}
 
 		if (strcmp("shaders", argv[2]) == 0) {
+			program_uniforms_forget(state.program);
 			GL_CALL(glDeleteProgram(state.program));
 			state.program = GL_CALL(glCreateProgram());
 			int r = shaders_load("assets/shaders/shader.vert", "assets/shaders/shader.frag", &state.program);
@@ -657,6 +1915,18 @@ static int gfx_command(int argc, char ** argv) {
 			kgfw_graphics_settings_set(KGFW_GRAPHICS_SETTINGS_ACTION_ENABLE, KGFW_GRAPHICS_SETTINGS_VSYNC);
 			return 0;
 		}
+		if (strcmp("culling", argv[2]) == 0) {
+			kgfw_graphics_settings_set(KGFW_GRAPHICS_SETTINGS_ACTION_ENABLE, KGFW_GRAPHICS_SETTINGS_CULLING);
+			return 0;
+		}
+		if (strcmp("lod", argv[2]) == 0) {
+			kgfw_graphics_settings_set(KGFW_GRAPHICS_SETTINGS_ACTION_ENABLE, KGFW_GRAPHICS_SETTINGS_LOD);
+			return 0;
+		}
+		if (strcmp("batching", argv[2]) == 0) {
+			kgfw_graphics_settings_set(KGFW_GRAPHICS_SETTINGS_ACTION_ENABLE, KGFW_GRAPHICS_SETTINGS_BATCHING);
+			return 0;
+		}
 
 		kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "no option %s", argv[2]);
 	}
@@ -672,11 +1942,23 @@ static int gfx_command(int argc, char ** argv) {
 			kgfw_graphics_settings_set(KGFW_GRAPHICS_SETTINGS_ACTION_DISABLE, KGFW_GRAPHICS_SETTINGS_VSYNC);
 			return 0;
 		}
+		if (strcmp("culling", argv[2]) == 0) {
+			kgfw_graphics_settings_set(KGFW_GRAPHICS_SETTINGS_ACTION_DISABLE, KGFW_GRAPHICS_SETTINGS_CULLING);
+			return 0;
+		}
+		if (strcmp("lod", argv[2]) == 0) {
+			kgfw_graphics_settings_set(KGFW_GRAPHICS_SETTINGS_ACTION_DISABLE, KGFW_GRAPHICS_SETTINGS_LOD);
+			return 0;
+		}
+		if (strcmp("batching", argv[2]) == 0) {
+			kgfw_graphics_settings_set(KGFW_GRAPHICS_SETTINGS_ACTION_DISABLE, KGFW_GRAPHICS_SETTINGS_BATCHING);
+			return 0;
+		}
 
 		kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "no option %s", argv[2]);
 	}
 	else if (strcmp("options", argv[1]) == 0) {
-		const char * options = "vsync    shaders";
+		const char * options = "vsync    culling    lod    batching    shaders";
 		const char * arguments = "[option]    see 'gfx options'";
 		kgfw_logf(KGFW_LOG_SEVERITY_CONSOLE, "options: %s", options);
 	}
@@ -704,7 +1986,7 @@ static void gl_errors(void) {
 static int shaders_load(const char * vpath, const char * fpath, GLuint * out_program) {
 	const GLchar * fallback_vshader =
 		"#version 330 core\n"
-		"layout(location = 0) in vec3 in_pos; layout(location = 1) in vec3 in_color; layout(location = 2) in vec3 in_normal; layout(location = 3) in vec2 in_uv; uniform mat4 unif_m; uniform mat4 unif_vp; out vec3 v_pos; out vec3 v_color; out vec3 v_normal; out vec2 v_uv; void main() { gl_Position = unif_vp * unif_m * vec4(in_pos, 1.0); v_pos = vec3(unif_m * vec4(in_pos, 1.0)); v_color = in_color; v_normal = in_normal; v_uv = in_uv; }";
+		"layout(location = 0) in vec3 in_pos; layout(location = 1) in vec3 in_color; layout(location = 2) in vec3 in_normal; layout(location = 3) in vec2 in_uv; layout(location = 4) in mat4 in_instance_m; layout(std140) uniform kgfw_frame { mat4 unif_vp; vec3 unif_view_pos; float unif_time; }; layout(std140) uniform kgfw_draw { mat4 unif_m; float unif_textured_color; float unif_textured_normal; }; out vec3 v_pos; out vec3 v_color; out vec3 v_normal; out vec2 v_uv; void main() { mat4 m = unif_m * in_instance_m; gl_Position = unif_vp * m * vec4(in_pos, 1.0); v_pos = vec3(m * vec4(in_pos, 1.0)); v_color = in_color; v_normal = in_normal; v_uv = in_uv; }";
 	const GLchar * fallback_fshader =
 		"#version 330 core\n"
 		"in vec3 v_pos; in vec3 v_color; in vec3 v_normal; in vec2 v_uv; out vec4 out_color; void main() { out_color = vec4(v_color, 1); }";
@@ -817,9 +2099,122 @@ static int shaders_load(const char * vpath, const char * fpath, GLuint * out_pro
 	GL_CALL(glDeleteShader(vert));
 	GL_CALL(glDeleteShader(frag));
 
+	/* resolved now so drawing never has to look them up by name */
+	program_uniforms_forget(*out_program);
+	program_uniforms(*out_program);
+
 	return 0;
 }
 
+static const program_uniforms_t * program_uniforms(GLuint program) {
+	if (state.programs.last != NULL && state.programs.last->program == program) {
+		return state.programs.last;
+	}
+
+	for (unsigned long long int i = 0; i < state.programs.count; ++i) {
+		if (state.programs.tables[i].program == program) {
+			state.programs.last = &state.programs.tables[i];
+			return state.programs.last;
+		}
+	}
+
+	/* programs that were not linked by shaders_load are resolved the first time they are drawn with */
+	if (state.programs.count == state.programs.capacity) {
+		unsigned long long int capacity = (state.programs.capacity == 0) ? 4 : state.programs.capacity * 2;
+		program_uniforms_t * tables = realloc(state.programs.tables, sizeof(program_uniforms_t) * capacity);
+		if (tables == NULL) {
+			program_uniforms_resolve(&state.programs.uncached, program);
+			return &state.programs.uncached;
+		}
+		state.programs.tables = tables;
+		state.programs.capacity = capacity;
+	}
+
+	state.programs.last = &state.programs.tables[state.programs.count++];
+	program_uniforms_resolve(state.programs.last, program);
+	return state.programs.last;
+}
+
+static void program_uniforms_resolve(program_uniforms_t * table, GLuint program) {
+	table->program = program;
+	for (unsigned int i = 0; i < UNIFORM_COUNT; ++i) {
+		table->locations[i] = GL_CALL(glGetUniformLocation(program, uniform_names[i]));
+	}
+
+	table->frame_block = GL_CALL(glGetUniformBlockIndex(program, "kgfw_frame"));
+	if (table->frame_block != GL_INVALID_INDEX) {
+		GL_CALL(glUniformBlockBinding(program, table->frame_block, UBO_BINDING_FRAME));
+	}
+	table->draw_block = GL_CALL(glGetUniformBlockIndex(program, "kgfw_draw"));
+	if (table->draw_block != GL_INVALID_INDEX) {
+		GL_CALL(glUniformBlockBinding(program, table->draw_block, UBO_BINDING_DRAW));
+	}
+}
+
+static void program_uniforms_forget(GLuint program) {
+	for (unsigned long long int i = 0; i < state.programs.count; ++i) {
+		if (state.programs.tables[i].program == program) {
+			state.programs.tables[i] = state.programs.tables[--state.programs.count];
+			break;
+		}
+	}
+	state.programs.last = NULL;
+}
+
+/* maps the next region for count slots, NULL if the draws have to go without */
+static unsigned char * uniform_ring_map(unsigned long long int count) {
+	if (count == 0) {
+		return NULL;
+	}
+
+	GL_CALL(glBindBuffer(GL_UNIFORM_BUFFER, state.ubo.ring));
+	if (count > state.ubo.slots) {
+		unsigned long long int slots = (state.ubo.slots == 0) ? UBO_RING_MIN_SLOTS : state.ubo.slots;
+		while (slots < count) {
+			slots *= 2;
+		}
+
+		/* the old storage is orphaned and freed by the driver once the GPU is done with it */
+		for (unsigned int r = 0; r < UBO_RING_REGIONS; ++r) {
+			if (state.ubo.fences[r] != NULL) {
+				GL_CALL(glDeleteSync(state.ubo.fences[r]));
+				state.ubo.fences[r] = NULL;
+			}
+		}
+		GL_CALL(glBufferData(GL_UNIFORM_BUFFER, state.ubo.stride * slots * UBO_RING_REGIONS, NULL, GL_STREAM_DRAW));
+		state.ubo.slots = slots;
+	}
+
+	state.ubo.region = (state.ubo.region + 1) % UBO_RING_REGIONS;
+	uniform_ring_wait(state.ubo.region);
+
+	/* the fence already guarantees the GPU is done with the region */
+	unsigned char * p = GL_CALL(glMapBufferRange(GL_UNIFORM_BUFFER, state.ubo.region * state.ubo.slots * state.ubo.stride, count * state.ubo.stride, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	return p;
+}
+
+/* returns non-zero if the written slots were lost */
+static int uniform_ring_unmap(void) {
+	GL_CALL(glBindBuffer(GL_UNIFORM_BUFFER, state.ubo.ring));
+	GLboolean r = GL_CALL(glUnmapBuffer(GL_UNIFORM_BUFFER));
+	return (r == GL_TRUE) ? 0 : 1;
+}
+
+static void uniform_ring_wait(unsigned int region) {
+	if (state.ubo.fences[region] == NULL) {
+		return;
+	}
+
+	for (;;) {
+		GLenum r = GL_CALL(glClientWaitSync(state.ubo.fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000));
+		if (r != GL_TIMEOUT_EXPIRED) {
+			break;
+		}
+	}
+	GL_CALL(glDeleteSync(state.ubo.fences[region]));
+	state.ubo.fences[region] = NULL;
+}
+
 void kgfw_graphics_clear_color(float red, float green, float blue) {
 	state.clear_color.r = red;
 	state.clear_color.g = green;
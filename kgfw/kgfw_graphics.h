@@ -4,6 +4,7 @@
 #include "kgfw_defines.h"
 #include "kgfw_window.h"
 #include "kgfw_camera.h"
+#include "kgfw_transform.h"
 #include "../lib/include/linmath.h"
 
 typedef struct kgfw_graphics_vertex {
@@ -38,11 +39,25 @@ typedef struct kgfw_graphics_texture {
 	kgfw_graphics_texture_filtering_enum filtering;
 } kgfw_graphics_texture_t;
 
+/* the most levels a mesh's lod chain can have besides its full index set */
+#define KGFW_GRAPHICS_MESH_LODS_MAX 8
+
+typedef struct kgfw_graphics_mesh_lod {
+	/* into the mesh's vertices */
+	unsigned int * indices;
+	unsigned long long int indices_count;
+	/* how far the level strays from the full mesh, in the mesh's units */
+	float error;
+} kgfw_graphics_mesh_lod_t;
+
 typedef struct kgfw_graphics_mesh {
 	kgfw_graphics_vertex_t * vertices;
 	unsigned long long int vertices_count;
 	unsigned int * indices;
 	unsigned long long int indices_count;
+	/* optional, progressively simpler versions of indices ordered by increasing error. see kgfw_graphics_mesh_lods_generate */
+	kgfw_graphics_mesh_lod_t * lods;
+	unsigned long long int lods_count;
 
 	float pos[3];
 	float rot[3];
@@ -105,6 +120,11 @@ typedef struct kgfw_graphics_mesh_node {
 	} _internal;
 } kgfw_graphics_mesh_node_t;
 
+/* refers to one instance of an instanced mesh node, stays the same when other instances are removed */
+typedef unsigned int kgfw_graphics_instance_t;
+
+#define KGFW_GRAPHICS_INSTANCE_NONE 0xFFFFFFFFu
+
 typedef enum kgfw_graphics_settings_action {
 	KGFW_GRAPHICS_SETTINGS_ACTION_SET = 1,
 	KGFW_GRAPHICS_SETTINGS_ACTION_ENABLE,
@@ -113,9 +133,15 @@ typedef enum kgfw_graphics_settings_action {
 
 typedef enum kgfw_graphics_settings {
 	KGFW_GRAPHICS_SETTINGS_VSYNC = 1,
+	/* meshes outside the camera's frustum are not drawn */
+	KGFW_GRAPHICS_SETTINGS_CULLING = 2,
+	/* meshes with lods are drawn with the simplest level that looks the same at their distance */
+	KGFW_GRAPHICS_SETTINGS_LOD = 4,
+	/* static meshes sharing a program and textures are merged and drawn together */
+	KGFW_GRAPHICS_SETTINGS_BATCHING = 8,
 } kgfw_graphics_settings_enum;
 
-#define KGFW_GRAPHICS_SETTINGS_DEFAULT (KGFW_GRAPHICS_SETTINGS_VSYNC)
+#define KGFW_GRAPHICS_SETTINGS_DEFAULT (KGFW_GRAPHICS_SETTINGS_VSYNC | KGFW_GRAPHICS_SETTINGS_CULLING | KGFW_GRAPHICS_SETTINGS_LOD | KGFW_GRAPHICS_SETTINGS_BATCHING)
 
 typedef enum kgfw_graphics_texture_use {
 	KGFW_GRAPHICS_TEXTURE_USE_COLOR,
@@ -127,8 +153,41 @@ KGFW_PUBLIC void kgfw_graphics_set_window(kgfw_window_t * window);
 KGFW_PUBLIC kgfw_window_t * kgfw_graphics_get_window(void);
 KGFW_PUBLIC int kgfw_graphics_draw(void);
 KGFW_PUBLIC void kgfw_graphics_viewport(unsigned int width, unsigned int height);
+/*
+	nodes created from the same vertex and index arrays share one upload of them until the last of those nodes is destroyed.
+	the arrays must not be changed in place while nodes created from them exist
+*/
 KGFW_PUBLIC kgfw_graphics_mesh_node_t * kgfw_graphics_mesh_new(kgfw_graphics_mesh_t * mesh, kgfw_graphics_mesh_node_t * parent);
 KGFW_PUBLIC void kgfw_graphics_mesh_destroy(kgfw_graphics_mesh_node_t * mesh);
+/* call after writing to mesh->transform, meshes that are never changed cost nothing to keep transformed */
+KGFW_PUBLIC void kgfw_graphics_mesh_transform_changed(kgfw_graphics_mesh_node_t * mesh);
+/*
+	one copy of mesh's vertices drawn once per instance with a single instanced draw call.
+	instances are placed relative to the node, the node draws nothing until instances are added
+*/
+KGFW_PUBLIC kgfw_graphics_mesh_node_t * kgfw_graphics_mesh_new_instanced(kgfw_graphics_mesh_t * mesh, kgfw_graphics_mesh_node_t * parent);
+/* returns KGFW_GRAPHICS_INSTANCE_NONE on error or if mesh was not created instanced */
+KGFW_PUBLIC kgfw_graphics_instance_t kgfw_graphics_mesh_instance_add(kgfw_graphics_mesh_node_t * mesh, const kgfw_transform_t * transform);
+KGFW_PUBLIC void kgfw_graphics_mesh_instance_set(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_instance_t instance, const kgfw_transform_t * transform);
+KGFW_PUBLIC void kgfw_graphics_mesh_instance_remove(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_instance_t instance);
+KGFW_PUBLIC unsigned long long int kgfw_graphics_mesh_instance_count(kgfw_graphics_mesh_node_t * mesh);
+/*
+	static meshes with the same program and textures have their vertices copied into shared buffers with their world
+	transforms baked in, and are drawn with one multi-draw call. the copies are rebuilt whenever a static mesh moves or
+	changes, so only flag meshes that rarely do. the source arrays of static meshes are read again when rebuilding,
+	so they have to stay valid. instanced meshes and lods are not batched
+*/
+KGFW_PUBLIC void kgfw_graphics_mesh_static(kgfw_graphics_mesh_node_t * mesh, unsigned char is_static);
+/*
+	fills mesh->lods with up to levels (at most KGFW_GRAPHICS_MESH_LODS_MAX) quadric error simplifications of its indices,
+	each with about half the triangles of the one before. stops early once a level would barely be simpler.
+	call before creating nodes from the mesh. returns non-zero on error, the mesh is left without lods
+*/
+KGFW_PUBLIC int kgfw_graphics_mesh_lods_generate(kgfw_graphics_mesh_t * mesh, unsigned long long int levels);
+KGFW_PUBLIC void kgfw_graphics_mesh_lods_free(kgfw_graphics_mesh_t * mesh);
+/* how many pixels of error a lod may show on screen before a more detailed one is drawn, 1 by default */
+KGFW_PUBLIC void kgfw_graphics_lod_error(float pixels);
+/* textures with the same bitmap and settings are uploaded once and shared, the bitmap must not be changed in place while in use */
 KGFW_PUBLIC void kgfw_graphics_mesh_texture(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_texture_t * texture, kgfw_graphics_texture_use_enum use);
 KGFW_PUBLIC void kgfw_graphics_mesh_texture_detach(kgfw_graphics_mesh_node_t * mesh, kgfw_graphics_texture_use_enum use);
 KGFW_PUBLIC void kgfw_graphics_deinit(void);
@@ -25,6 +25,9 @@ struct {
 
 	unsigned char gamepad_enabled;
 	kgfw_gamepad_t gamepads[KGFW_GAMEPAD_MAX];
+
+	kgfw_event_type_t key_events;
+	kgfw_event_type_t mouse_button_events;
 } static key_state = {
 	.gamepad_enabled = 1,
 	.gamepads = {
@@ -120,6 +123,8 @@ static void kgfw_glfw_key(GLFWwindow * window, int key, int scancode, int mods,
 static void kgfw_glfw_mouse(GLFWwindow * window, double x, double y);
 static void kgfw_glfw_scroll(GLFWwindow * window, double x, double y);
 static void kgfw_glfw_mouse_buttons(GLFWwindow * window, int button, int action, int mods);
+static void input_key_events(const void * events, unsigned long long int count, void * data);
+static void input_mouse_button_events(const void * events, unsigned long long int count, void * data);
 
 int kgfw_input_register_window(kgfw_window_t * window) {
 	if (window == NULL) {
@@ -246,8 +251,11 @@ void kgfw_input_update(void) {
 static void kgfw_glfw_key(GLFWwindow * window, int key, int scancode, int action, int mods) {
 	key_state.prev_keys[glfw_key_to_kgfw(key) % KGFW_KEY_MAX] = key_state.keys[glfw_key_to_kgfw(key) % KGFW_KEY_MAX];
 	key_state.keys[glfw_key_to_kgfw(key) % KGFW_KEY_MAX] = (action);
-	for (unsigned long long int i = 0; i < key_state.callback_count; ++i) {
-		key_state.callbacks[i](glfw_key_to_kgfw(key) % KGFW_KEY_MAX, (action));
+
+	/* callbacks run on the next dispatch, or right away if the event can't be queued */
+	kgfw_input_key_event_t event = { glfw_key_to_kgfw(key) % KGFW_KEY_MAX, (action) };
+	if (kgfw_event_emit(kgfw_input_key_event_type(), &event) != 0) {
+		input_key_events(&event, 1, NULL);
 	}
 }
 
@@ -289,9 +297,10 @@ static void kgfw_glfw_mouse_buttons(GLFWwindow * window, int button, int action,
 	}
 
 	key_state.mouse[button] = (action);
-	kgfw_window_t * win = glfwGetWindowUserPointer(window);
-	for (unsigned long long int i = 0; i < key_state.mouse_callback_count; ++i) {
-		key_state.mouse_callbacks[i](win, button % KGFW_MOUSE_BUTTON_MAX, (action));
+
+	kgfw_input_mouse_button_event_t event = { glfwGetWindowUserPointer(window), button % KGFW_MOUSE_BUTTON_MAX, (action), key_state.mouse_x, key_state.mouse_y };
+	if (kgfw_event_emit(kgfw_input_mouse_button_event_type(), &event) != 0) {
+		input_mouse_button_events(&event, 1, NULL);
 	}
 }
 
@@ -368,3 +377,44 @@ int kgfw_input_gamepad_register_callback(kgfw_input_gamepad_callback callback) {
 	key_state.gamepad_callbacks[key_state.gamepad_callback_count++] = callback;
 	return 0;
 }
+
+kgfw_event_type_t kgfw_input_key_event_type(void) {
+	if (key_state.key_events == KGFW_EVENT_INVALID_TYPE) {
+		key_state.key_events = kgfw_event_type_register("input_key", sizeof(kgfw_input_key_event_t));
+		if (key_state.key_events != KGFW_EVENT_INVALID_TYPE) {
+			kgfw_event_subscribe(key_state.key_events, input_key_events, NULL, 0);
+		}
+	}
+
+	return key_state.key_events;
+}
+
+kgfw_event_type_t kgfw_input_mouse_button_event_type(void) {
+	if (key_state.mouse_button_events == KGFW_EVENT_INVALID_TYPE) {
+		key_state.mouse_button_events = kgfw_event_type_register("input_mouse_button", sizeof(kgfw_input_mouse_button_event_t));
+		if (key_state.mouse_button_events != KGFW_EVENT_INVALID_TYPE) {
+			kgfw_event_subscribe(key_state.mouse_button_events, input_mouse_button_events, NULL, 0);
+		}
+	}
+
+	return key_state.mouse_button_events;
+}
+
+/* forwards batches to the callbacks registered with kgfw_input_*_register_callback */
+static void input_key_events(const void * events, unsigned long long int count, void * data) {
+	const kgfw_input_key_event_t * key_events = events;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		for (unsigned long long int j = 0; j < key_state.callback_count; ++j) {
+			key_state.callbacks[j](key_events[i].key, key_events[i].action);
+		}
+	}
+}
+
+static void input_mouse_button_events(const void * events, unsigned long long int count, void * data) {
+	const kgfw_input_mouse_button_event_t * button_events = events;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		for (unsigned long long int j = 0; j < key_state.mouse_callback_count; ++j) {
+			key_state.mouse_callbacks[j](button_events[i].window, button_events[i].button, button_events[i].action);
+		}
+	}
+}
@@ -3,6 +3,7 @@
 
 #include "kgfw_defines.h"
 #include "kgfw_window.h"
+#include "kgfw_event.h"
 
 typedef enum kgfw_input_key_enum {
 	KGFW_KEY_UNKNOWN = 0,
@@ -196,6 +197,21 @@ typedef void (*kgfw_input_mouse_button_callback)(kgfw_window_t * window, kgfw_in
 /* takes key value and action value (0: immediate keyup, 1: immediate keydown, 2: repeated keydown, 3: repeated keyup) */
 typedef void (*kgfw_input_gamepad_callback)(kgfw_gamepad_t * gamepad);
 
+/* emitted on the "input_key" event type, action is the same as kgfw_input_key_callback's */
+typedef struct kgfw_input_key_event {
+	kgfw_input_key_enum key;
+	unsigned char action;
+} kgfw_input_key_event_t;
+
+/* emitted on the "input_mouse_button" event type, x and y are the mouse position when the button changed */
+typedef struct kgfw_input_mouse_button_event {
+	kgfw_window_t * window;
+	kgfw_input_mouse_button_enum button;
+	unsigned char action;
+	float x;
+	float y;
+} kgfw_input_mouse_button_event_t;
+
 KGFW_PUBLIC void kgfw_input_update(void);
 /* registers window input to redirect to main input */
 KGFW_PUBLIC int kgfw_input_register_window(kgfw_window_t * window);
@@ -219,6 +235,12 @@ KGFW_PUBLIC int kgfw_input_key_register_callback(kgfw_input_key_callback callbac
 KGFW_PUBLIC int kgfw_input_mouse_button_register_callback(kgfw_input_mouse_button_callback callback);
 /* register a callback for mouse gamepad input */
 KGFW_PUBLIC int kgfw_input_gamepad_register_callback(kgfw_input_gamepad_callback callback);
+/*
+	event types window input is emitted on, registered on first use. the key and mouse button callbacks
+	are called from kgfw_event_dispatch as well. returns KGFW_EVENT_INVALID_TYPE if the event bus is not running
+*/
+KGFW_PUBLIC kgfw_event_type_t kgfw_input_key_event_type(void);
+KGFW_PUBLIC kgfw_event_type_t kgfw_input_mouse_button_event_type(void);
 
 /*
 	if gamepad_id = 1..KGFW_GAMEPAD_MAX, it will return an address to the gamepad of the associated id or NULL if none found
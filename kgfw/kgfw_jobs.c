@@ -0,0 +1,459 @@
+#include "kgfw_jobs.h"
+#include "kgfw_thread.h"
+#include "kgfw_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(KGFW_MSVC)
+#define JOBS_THREAD_LOCAL __declspec(thread)
+#else
+#define JOBS_THREAD_LOCAL __thread
+#endif
+
+/* power of two, jobs pushed onto a full deque run inline */
+#define JOBS_DEQUE_CAPACITY 4096
+#define JOBS_DEQUE_MASK (JOBS_DEQUE_CAPACITY - 1)
+/* failed attempts to find a job before a worker goes to sleep */
+#define JOBS_SPIN_COUNT 64
+/* parallel for ranges per thread, more than one so stealing can even out uneven ranges */
+#define JOBS_RANGES_PER_THREAD 4
+#define JOBS_RANGES_STACK 64
+
+/*
+	chase-lev work-stealing deque. the owning thread pushes and pops at the bottom,
+	other threads steal from the top. every access is sequentially consistent
+*/
+typedef struct deque {
+	volatile long long int top;
+	/* keeps the owner's bottom off of the thieves' cache line */
+	unsigned char pad[64 - sizeof(long long int)];
+	volatile long long int bottom;
+	void * volatile jobs[JOBS_DEQUE_CAPACITY];
+} deque_t;
+
+/* jobs waiting on a dependency counter */
+typedef struct pending {
+	kgfw_job_t * jobs;
+	unsigned long long int count;
+	kgfw_job_counter_t * dependency;
+	struct pending * next;
+} pending_t;
+
+typedef struct parallel_range {
+	kgfw_job_range_f func;
+	void * data;
+	unsigned long long int begin;
+	unsigned long long int end;
+} parallel_range_t;
+
+struct {
+	/* [deques_count], 0 belongs to the main thread */
+	deque_t * deques;
+	unsigned long long int deques_count;
+	kgfw_thread_t * threads;
+	unsigned int threads_count;
+
+	/* jobs sitting in deques, lets idle workers sleep */
+	volatile long long int queued;
+	volatile long long int sleeping;
+	volatile long long int exit;
+	kgfw_mutex_t mutex;
+	kgfw_cond_t wake;
+
+	pending_t * pending;
+	volatile long long int pending_count;
+	kgfw_mutex_t pending_mutex;
+} static state = {
+	NULL, 0,
+	NULL, 0,
+	0, 0, 0,
+};
+
+static JOBS_THREAD_LOCAL int thread_index = -1;
+
+static void worker_main(void * arg);
+static int deque_push(deque_t * deque, kgfw_job_t * job);
+static kgfw_job_t * deque_pop(deque_t * deque);
+static kgfw_job_t * deque_steal(deque_t * deque);
+static kgfw_job_t * jobs_next(int self);
+static void jobs_submit(kgfw_job_t * jobs, unsigned long long int count);
+static void job_execute(kgfw_job_t * job);
+static void pending_release(kgfw_job_counter_t * dependency);
+static void parallel_for_job(void * data);
+
+int kgfw_jobs_init(int workers) {
+	if (state.deques != NULL) {
+		return 1;
+	}
+
+	if (workers < 0) {
+		workers = (int) kgfw_thread_hardware_count() - 1;
+	}
+
+	state.deques_count = (unsigned long long int) workers + 1;
+	state.deques = malloc(sizeof(deque_t) * state.deques_count);
+	if (state.deques == NULL) {
+		state.deques_count = 0;
+		return 2;
+	}
+	memset(state.deques, 0, sizeof(deque_t) * state.deques_count);
+
+	state.threads = malloc(sizeof(kgfw_thread_t) * (state.deques_count));
+	if (state.threads == NULL) {
+		free(state.deques);
+		state.deques = NULL;
+		state.deques_count = 0;
+		return 3;
+	}
+
+	state.threads_count = 0;
+	state.queued = 0;
+	state.sleeping = 0;
+	state.exit = 0;
+	state.pending = NULL;
+	state.pending_count = 0;
+	kgfw_mutex_init(&state.mutex);
+	kgfw_cond_init(&state.wake);
+	kgfw_mutex_init(&state.pending_mutex);
+
+	thread_index = 0;
+	for (int i = 0; i < workers; ++i) {
+		if (kgfw_thread_create(&state.threads[i], worker_main, &state.deques[i + 1]) != 0) {
+			kgfw_logf(KGFW_LOG_SEVERITY_WARN, "jobs started %i of %i workers", i, workers);
+			break;
+		}
+		++state.threads_count;
+	}
+
+	return 0;
+}
+
+/* queued jobs that were never waited on are dropped */
+void kgfw_jobs_deinit(void) {
+	if (state.deques == NULL) {
+		return;
+	}
+
+	kgfw_atomic_store(&state.exit, 1);
+	kgfw_mutex_lock(&state.mutex);
+	kgfw_cond_broadcast(&state.wake);
+	kgfw_mutex_unlock(&state.mutex);
+	for (unsigned int i = 0; i < state.threads_count; ++i) {
+		kgfw_thread_join(&state.threads[i]);
+	}
+
+	while (state.pending != NULL) {
+		pending_t * next = state.pending->next;
+		free(state.pending);
+		state.pending = next;
+	}
+
+	kgfw_mutex_destroy(&state.pending_mutex);
+	kgfw_cond_destroy(&state.wake);
+	kgfw_mutex_destroy(&state.mutex);
+	free(state.threads);
+	free(state.deques);
+	state.threads = NULL;
+	state.threads_count = 0;
+	state.deques = NULL;
+	state.deques_count = 0;
+	thread_index = -1;
+}
+
+unsigned int kgfw_jobs_worker_count(void) {
+	return state.threads_count;
+}
+
+int kgfw_jobs_thread_index(void) {
+	return thread_index;
+}
+
+void kgfw_jobs_run(kgfw_job_t * jobs, unsigned long long int count, kgfw_job_counter_t * counter) {
+	if (counter != NULL) {
+		kgfw_atomic_add(&counter->value, (long long int) count);
+	}
+	for (unsigned long long int i = 0; i < count; ++i) {
+		jobs[i].counter = counter;
+	}
+
+	jobs_submit(jobs, count);
+}
+
+void kgfw_jobs_run_after(kgfw_job_t * jobs, unsigned long long int count, kgfw_job_counter_t * counter, kgfw_job_counter_t * dependency) {
+	if (dependency == NULL) {
+		kgfw_jobs_run(jobs, count, counter);
+		return;
+	}
+
+	if (counter != NULL) {
+		kgfw_atomic_add(&counter->value, (long long int) count);
+	}
+	for (unsigned long long int i = 0; i < count; ++i) {
+		jobs[i].counter = counter;
+	}
+
+	pending_t * pending = NULL;
+	if (state.deques != NULL) {
+		pending = malloc(sizeof(pending_t));
+	}
+	if (pending == NULL) {
+		kgfw_jobs_wait(dependency);
+		jobs_submit(jobs, count);
+		return;
+	}
+
+	pending->jobs = jobs;
+	pending->count = count;
+	pending->dependency = dependency;
+
+	kgfw_mutex_lock(&state.pending_mutex);
+	pending->next = state.pending;
+	state.pending = pending;
+	kgfw_atomic_add(&state.pending_count, 1);
+	kgfw_mutex_unlock(&state.pending_mutex);
+
+	/* the dependency may have finished before the batch was visible to job_execute */
+	if (kgfw_atomic_load(&dependency->value) == 0) {
+		pending_release(dependency);
+	}
+}
+
+void kgfw_jobs_wait(kgfw_job_counter_t * counter) {
+	while (kgfw_atomic_load(&counter->value) != 0) {
+		kgfw_job_t * job = jobs_next(thread_index);
+		if (job != NULL) {
+			job_execute(job);
+		} else {
+			kgfw_thread_yield();
+		}
+	}
+}
+
+void kgfw_jobs_parallel_for(unsigned long long int count, unsigned long long int grain, kgfw_job_range_f func, void * data) {
+	if (count == 0) {
+		return;
+	}
+	if (grain == 0) {
+		grain = 1;
+	}
+
+	unsigned long long int ranges_count = (count + grain - 1) / grain;
+	if (state.threads_count == 0 || thread_index < 0 || ranges_count <= 1) {
+		func(0, count, data);
+		return;
+	}
+	if (ranges_count > state.deques_count * JOBS_RANGES_PER_THREAD) {
+		ranges_count = state.deques_count * JOBS_RANGES_PER_THREAD;
+	}
+	unsigned long long int size = (count + ranges_count - 1) / ranges_count;
+	ranges_count = (count + size - 1) / size;
+
+	parallel_range_t ranges_stack[JOBS_RANGES_STACK];
+	kgfw_job_t jobs_stack[JOBS_RANGES_STACK];
+	parallel_range_t * ranges = ranges_stack;
+	kgfw_job_t * jobs = jobs_stack;
+	if (ranges_count > JOBS_RANGES_STACK) {
+		ranges = malloc(sizeof(parallel_range_t) * ranges_count);
+		jobs = malloc(sizeof(kgfw_job_t) * ranges_count);
+		if (ranges == NULL || jobs == NULL) {
+			if (ranges != NULL) {
+				free(ranges);
+			}
+			if (jobs != NULL) {
+				free(jobs);
+			}
+			func(0, count, data);
+			return;
+		}
+	}
+
+	for (unsigned long long int i = 0; i < ranges_count; ++i) {
+		ranges[i].func = func;
+		ranges[i].data = data;
+		ranges[i].begin = i * size;
+		ranges[i].end = (i + 1 == ranges_count) ? count : (i + 1) * size;
+		jobs[i].func = parallel_for_job;
+		jobs[i].data = &ranges[i];
+	}
+
+	kgfw_job_counter_t counter = { 0 };
+	kgfw_jobs_run(jobs, ranges_count, &counter);
+	kgfw_jobs_wait(&counter);
+
+	if (ranges != ranges_stack) {
+		free(ranges);
+		free(jobs);
+	}
+}
+
+static void worker_main(void * arg) {
+	thread_index = (int) ((deque_t *) arg - state.deques);
+
+	unsigned int spins = 0;
+	while (!kgfw_atomic_load(&state.exit)) {
+		kgfw_job_t * job = jobs_next(thread_index);
+		if (job != NULL) {
+			job_execute(job);
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < JOBS_SPIN_COUNT) {
+			kgfw_thread_yield();
+			continue;
+		}
+		spins = 0;
+
+		/* pairs with jobs_submit, it either sees sleeping or this sees queued */
+		kgfw_mutex_lock(&state.mutex);
+		kgfw_atomic_add(&state.sleeping, 1);
+		while (kgfw_atomic_load(&state.queued) == 0 && !kgfw_atomic_load(&state.exit)) {
+			kgfw_cond_wait(&state.wake, &state.mutex);
+		}
+		kgfw_atomic_add(&state.sleeping, -1);
+		kgfw_mutex_unlock(&state.mutex);
+	}
+}
+
+static int deque_push(deque_t * deque, kgfw_job_t * job) {
+	long long int bottom = kgfw_atomic_load(&deque->bottom);
+	long long int top = kgfw_atomic_load(&deque->top);
+	if (bottom - top >= JOBS_DEQUE_CAPACITY) {
+		return 1;
+	}
+
+	kgfw_atomic_store_ptr(&deque->jobs[bottom & JOBS_DEQUE_MASK], job);
+	kgfw_atomic_store(&deque->bottom, bottom + 1);
+	return 0;
+}
+
+static kgfw_job_t * deque_pop(deque_t * deque) {
+	long long int bottom = kgfw_atomic_load(&deque->bottom) - 1;
+	kgfw_atomic_store(&deque->bottom, bottom);
+	long long int top = kgfw_atomic_load(&deque->top);
+	if (top > bottom) {
+		kgfw_atomic_store(&deque->bottom, bottom + 1);
+		return NULL;
+	}
+
+	kgfw_job_t * job = kgfw_atomic_load_ptr(&deque->jobs[bottom & JOBS_DEQUE_MASK]);
+	if (top == bottom) {
+		/* last job, race thieves for it */
+		if (!kgfw_atomic_cas(&deque->top, top, top + 1)) {
+			job = NULL;
+		}
+		kgfw_atomic_store(&deque->bottom, bottom + 1);
+	}
+
+	return job;
+}
+
+static kgfw_job_t * deque_steal(deque_t * deque) {
+	long long int top = kgfw_atomic_load(&deque->top);
+	long long int bottom = kgfw_atomic_load(&deque->bottom);
+	if (top >= bottom) {
+		return NULL;
+	}
+
+	kgfw_job_t * job = kgfw_atomic_load_ptr(&deque->jobs[top & JOBS_DEQUE_MASK]);
+	if (!kgfw_atomic_cas(&deque->top, top, top + 1)) {
+		return NULL;
+	}
+
+	return job;
+}
+
+static kgfw_job_t * jobs_next(int self) {
+	if (state.deques == NULL) {
+		return NULL;
+	}
+
+	kgfw_job_t * job = NULL;
+	if (self >= 0) {
+		job = deque_pop(&state.deques[self]);
+	}
+
+	unsigned long long int start = (self >= 0) ? (unsigned long long int) self + 1 : 0;
+	for (unsigned long long int i = 0; job == NULL && i < state.deques_count; ++i) {
+		unsigned long long int victim = (start + i) % state.deques_count;
+		if (victim != (unsigned long long int) self) {
+			job = deque_steal(&state.deques[victim]);
+		}
+	}
+
+	if (job != NULL) {
+		kgfw_atomic_add(&state.queued, -1);
+	}
+	return job;
+}
+
+static void jobs_submit(kgfw_job_t * jobs, unsigned long long int count) {
+	if (state.deques == NULL || thread_index < 0) {
+		for (unsigned long long int i = 0; i < count; ++i) {
+			job_execute(&jobs[i]);
+		}
+		return;
+	}
+
+	deque_t * deque = &state.deques[thread_index];
+	for (unsigned long long int i = 0; i < count; ++i) {
+		if (deque_push(deque, &jobs[i]) != 0) {
+			job_execute(&jobs[i]);
+		} else {
+			kgfw_atomic_add(&state.queued, 1);
+		}
+	}
+
+	if (kgfw_atomic_load(&state.sleeping) > 0) {
+		kgfw_mutex_lock(&state.mutex);
+		kgfw_cond_broadcast(&state.wake);
+		kgfw_mutex_unlock(&state.mutex);
+	}
+}
+
+static void job_execute(kgfw_job_t * job) {
+	/* the job may be freed by its owner as soon as the counter reaches zero */
+	kgfw_job_counter_t * counter = job->counter;
+	job->func(job->data);
+
+	if (counter != NULL && kgfw_atomic_add(&counter->value, -1) == 0) {
+		if (kgfw_atomic_load(&state.pending_count) > 0) {
+			pending_release(counter);
+		}
+	}
+}
+
+/*
+	the thread that brought dependency to zero may get here after its owner already reused it for more jobs,
+	so batches are only released while the dependency is still at zero
+*/
+static void pending_release(kgfw_job_counter_t * dependency) {
+	pending_t * released = NULL;
+
+	kgfw_mutex_lock(&state.pending_mutex);
+	pending_t ** link = &state.pending;
+	while (*link != NULL) {
+		pending_t * pending = *link;
+		if (pending->dependency == dependency && kgfw_atomic_load(&pending->dependency->value) == 0) {
+			*link = pending->next;
+			pending->next = released;
+			released = pending;
+			kgfw_atomic_add(&state.pending_count, -1);
+		} else {
+			link = &pending->next;
+		}
+	}
+	kgfw_mutex_unlock(&state.pending_mutex);
+
+	while (released != NULL) {
+		pending_t * next = released->next;
+		jobs_submit(released->jobs, released->count);
+		free(released);
+		released = next;
+	}
+}
+
+static void parallel_for_job(void * data) {
+	parallel_range_t * range = data;
+	range->func(range->begin, range->end, range->data);
+}
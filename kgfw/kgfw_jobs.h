@@ -0,0 +1,45 @@
+#ifndef KRISVERS_KGFW_JOBS_H
+#define KRISVERS_KGFW_JOBS_H
+
+#include "kgfw_defines.h"
+
+/* pass to kgfw_jobs_init for one worker per logical processor besides the calling thread */
+#define KGFW_JOBS_WORKERS_DEFAULT -1
+
+typedef void (*kgfw_job_f)(void * data);
+typedef void (*kgfw_job_range_f)(unsigned long long int begin, unsigned long long int end, void * data);
+
+/* number of unfinished jobs, zero initialize before the first kgfw_jobs_run */
+typedef struct kgfw_job_counter {
+	volatile long long int value;
+} kgfw_job_counter_t;
+
+/* owned by the caller, must stay valid until the counter it was run with reaches zero */
+typedef struct kgfw_job {
+	kgfw_job_f func;
+	void * data;
+	/* set by kgfw_jobs_run */
+	kgfw_job_counter_t * counter;
+} kgfw_job_t;
+
+/* the calling thread becomes the main thread of the pool */
+KGFW_PUBLIC int kgfw_jobs_init(int workers);
+KGFW_PUBLIC void kgfw_jobs_deinit(void);
+/* 0 if the pool is not running, jobs then run inline in kgfw_jobs_run */
+KGFW_PUBLIC unsigned int kgfw_jobs_worker_count(void);
+/* 0 for the main thread, 1 to worker count for workers, -1 for any other thread */
+KGFW_PUBLIC int kgfw_jobs_thread_index(void);
+
+/* counter may be NULL. threads outside of the pool run the jobs inline */
+KGFW_PUBLIC void kgfw_jobs_run(kgfw_job_t * jobs, unsigned long long int count, kgfw_job_counter_t * counter);
+/*
+	jobs are held back until dependency reaches zero, run the jobs counted by dependency first.
+	dependency must stay valid until the held-back jobs were submitted, jobs added to it meanwhile hold them back too
+*/
+KGFW_PUBLIC void kgfw_jobs_run_after(kgfw_job_t * jobs, unsigned long long int count, kgfw_job_counter_t * counter, kgfw_job_counter_t * dependency);
+/* executes queued jobs while waiting for the counter to reach zero */
+KGFW_PUBLIC void kgfw_jobs_wait(kgfw_job_counter_t * counter);
+/* splits [0, count) into ranges of at least grain indices and waits for all of them */
+KGFW_PUBLIC void kgfw_jobs_parallel_for(unsigned long long int count, unsigned long long int grain, kgfw_job_range_f func, void * data);
+
+#endif
@@ -0,0 +1,114 @@
+#include "kgfw_render_queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define QUEUE_MIN_CAPACITY 256
+
+static int queue_reserve(kgfw_render_queue_t * queue, unsigned long long int count);
+
+int kgfw_render_queue_init(kgfw_render_queue_t * queue) {
+	memset(queue, 0, sizeof(kgfw_render_queue_t));
+	return queue_reserve(queue, QUEUE_MIN_CAPACITY);
+}
+
+void kgfw_render_queue_deinit(kgfw_render_queue_t * queue) {
+	free(queue->keys);
+	free(queue->items);
+	free(queue->keys_scratch);
+	free(queue->items_scratch);
+	memset(queue, 0, sizeof(kgfw_render_queue_t));
+}
+
+void kgfw_render_queue_clear(kgfw_render_queue_t * queue) {
+	queue->count = 0;
+}
+
+int kgfw_render_queue_push(kgfw_render_queue_t * queue, unsigned long long int key, unsigned int item) {
+	if (queue->count == queue->capacity) {
+		if (queue_reserve(queue, queue->capacity * 2) != 0) {
+			return 1;
+		}
+	}
+
+	queue->keys[queue->count] = key;
+	queue->items[queue->count] = item;
+	++queue->count;
+	return 0;
+}
+
+void kgfw_render_queue_sort(kgfw_render_queue_t * queue) {
+	if (queue->count < 2) {
+		return;
+	}
+
+	/* every byte's histogram in one pass over the keys */
+	unsigned long long int counts[8][256];
+	memset(counts, 0, sizeof(counts));
+	for (unsigned long long int i = 0; i < queue->count; ++i) {
+		unsigned long long int key = queue->keys[i];
+		for (unsigned int b = 0; b < 8; ++b) {
+			++counts[b][(key >> (b * 8)) & 0xFF];
+		}
+	}
+
+	for (unsigned int b = 0; b < 8; ++b) {
+		unsigned long long int * count = counts[b];
+		/* all keys share this byte, the pass would not move anything */
+		if (count[(queue->keys[0] >> (b * 8)) & 0xFF] == queue->count) {
+			continue;
+		}
+
+		unsigned long long int offset = 0;
+		for (unsigned int d = 0; d < 256; ++d) {
+			unsigned long long int c = count[d];
+			count[d] = offset;
+			offset += c;
+		}
+
+		for (unsigned long long int i = 0; i < queue->count; ++i) {
+			unsigned long long int key = queue->keys[i];
+			unsigned long long int to = count[(key >> (b * 8)) & 0xFF]++;
+			queue->keys_scratch[to] = key;
+			queue->items_scratch[to] = queue->items[i];
+		}
+
+		unsigned long long int * keys = queue->keys;
+		unsigned int * items = queue->items;
+		queue->keys = queue->keys_scratch;
+		queue->items = queue->items_scratch;
+		queue->keys_scratch = keys;
+		queue->items_scratch = items;
+	}
+}
+
+static int queue_reserve(kgfw_render_queue_t * queue, unsigned long long int count) {
+	if (count <= queue->capacity) {
+		return 0;
+	}
+
+	void * p = realloc(queue->keys, sizeof(unsigned long long int) * count);
+	if (p == NULL) {
+		return 1;
+	}
+	queue->keys = p;
+	p = realloc(queue->items, sizeof(unsigned int) * count);
+	if (p == NULL) {
+		return 1;
+	}
+	queue->items = p;
+	/* scratch contents never outlive a sort, the old buffers are kept if the new ones cannot be allocated */
+	unsigned long long int * keys_scratch = malloc(sizeof(unsigned long long int) * count);
+	unsigned int * items_scratch = malloc(sizeof(unsigned int) * count);
+	if (keys_scratch == NULL || items_scratch == NULL) {
+		free(keys_scratch);
+		free(items_scratch);
+		return 1;
+	}
+	free(queue->keys_scratch);
+	free(queue->items_scratch);
+	queue->keys_scratch = keys_scratch;
+	queue->items_scratch = items_scratch;
+
+	queue->capacity = count;
+	return 0;
+}
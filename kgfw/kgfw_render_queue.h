@@ -0,0 +1,30 @@
+#ifndef KRISVERS_KGFW_RENDER_QUEUE_H
+#define KRISVERS_KGFW_RENDER_QUEUE_H
+
+#include "kgfw_defines.h"
+
+/*
+	draws are pushed as a 64 bit sort key and an item index, then radix sorted by key so draws
+	sharing state end up next to each other. the most significant bits of a key should hold the
+	most expensive state to change
+*/
+typedef struct kgfw_render_queue {
+	unsigned long long int * keys;
+	unsigned int * items;
+	unsigned long long int count;
+	unsigned long long int capacity;
+
+	/* [capacity] sorting ping-pongs between these and keys/items */
+	unsigned long long int * keys_scratch;
+	unsigned int * items_scratch;
+} kgfw_render_queue_t;
+
+KGFW_PUBLIC int kgfw_render_queue_init(kgfw_render_queue_t * queue);
+KGFW_PUBLIC void kgfw_render_queue_deinit(kgfw_render_queue_t * queue);
+KGFW_PUBLIC void kgfw_render_queue_clear(kgfw_render_queue_t * queue);
+/* returns non-zero if the queue could not grow */
+KGFW_PUBLIC int kgfw_render_queue_push(kgfw_render_queue_t * queue, unsigned long long int key, unsigned int item);
+/* stable least significant byte first radix sort, bytes every key shares are skipped */
+KGFW_PUBLIC void kgfw_render_queue_sort(kgfw_render_queue_t * queue);
+
+#endif
@@ -0,0 +1,317 @@
+#include "kgfw_simplify.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIMPLIFY_LOCKED 1
+#define SIMPLIFY_TOUCHED 2
+
+/* sum of squared distances to planes, p^T A p + 2 b.p + c, weighted by the planes' triangles' areas */
+typedef struct simplify_quadric {
+	double xx, xy, xz, yy, yz, zz;
+	double x, y, z;
+	double c;
+	double w;
+} simplify_quadric_t;
+
+typedef struct simplify_collapse {
+	/* squared distance, per unit of area */
+	double cost;
+	unsigned int from;
+	unsigned int to;
+} simplify_collapse_t;
+
+typedef struct simplify {
+	const float * positions;
+	unsigned long long int stride;
+	unsigned long long int vertices_count;
+
+	/* [vertices_count] */
+	simplify_quadric_t * quadrics;
+	unsigned int * remap;
+	unsigned char * flags;
+	/* [vertices_count + 1] where each vertex's triangles start in triangles */
+	unsigned int * offsets;
+	/* [indices_count] every triangle once per corner */
+	unsigned int * triangles;
+	/* [indices_count] */
+	simplify_collapse_t * collapses;
+	/* [edges_capacity] open addressed, an edge's key is its vertices, low first */
+	unsigned long long int * edges;
+	unsigned int * edges_count;
+	unsigned long long int edges_capacity;
+} simplify_t;
+
+static const float * simplify_position(simplify_t * s, unsigned int vertex);
+static void simplify_quadrics(simplify_t * s, const unsigned int * indices, unsigned long long int indices_count);
+static void simplify_lock_open_edges(simplify_t * s, const unsigned int * indices, unsigned long long int indices_count);
+static double simplify_cost(simplify_t * s, unsigned int from, unsigned int to);
+static unsigned char simplify_flips(simplify_t * s, const unsigned int * indices, unsigned int from, unsigned int to);
+static int simplify_collapse_compare(const void * a, const void * b);
+static void simplify_free(simplify_t * s);
+
+int kgfw_simplify(const float * positions, unsigned long long int vertices_count, unsigned long long int stride, const unsigned int * indices, unsigned long long int indices_count, unsigned long long int target_count, float max_error, unsigned int * out_indices, unsigned long long int * out_count, float * out_error) {
+	indices_count -= indices_count % 3;
+	memcpy(out_indices, indices, sizeof(unsigned int) * indices_count);
+	*out_count = indices_count;
+	*out_error = 0;
+	if (target_count >= indices_count) {
+		return 0;
+	}
+
+	simplify_t s;
+	memset(&s, 0, sizeof(simplify_t));
+	s.positions = positions;
+	s.stride = stride;
+	s.vertices_count = vertices_count;
+	s.edges_capacity = 64;
+	while (s.edges_capacity < indices_count * 2) {
+		s.edges_capacity *= 2;
+	}
+	s.quadrics = calloc(vertices_count, sizeof(simplify_quadric_t));
+	s.remap = malloc(sizeof(unsigned int) * vertices_count);
+	s.flags = calloc(vertices_count, sizeof(unsigned char));
+	s.offsets = malloc(sizeof(unsigned int) * (vertices_count + 1));
+	s.triangles = malloc(sizeof(unsigned int) * indices_count);
+	s.collapses = malloc(sizeof(simplify_collapse_t) * indices_count);
+	s.edges = malloc(sizeof(unsigned long long int) * s.edges_capacity);
+	s.edges_count = malloc(sizeof(unsigned int) * s.edges_capacity);
+	if (s.quadrics == NULL || s.remap == NULL || s.flags == NULL || s.offsets == NULL || s.triangles == NULL || s.collapses == NULL || s.edges == NULL || s.edges_count == NULL) {
+		simplify_free(&s);
+		return 1;
+	}
+	for (unsigned long long int v = 0; v < vertices_count; ++v) {
+		s.remap[v] = (unsigned int) v;
+	}
+
+	simplify_quadrics(&s, indices, indices_count);
+	simplify_lock_open_edges(&s, indices, indices_count);
+
+	double limit = (double) max_error * (double) max_error;
+	double error = 0;
+	unsigned long long int count = indices_count;
+	/* each pass collapses the cheapest edges that do not share a vertex, then rebuilds */
+	while (count > target_count) {
+		memset(s.offsets, 0, sizeof(unsigned int) * (vertices_count + 1));
+		for (unsigned long long int i = 0; i < count; ++i) {
+			++s.offsets[out_indices[i] + 1];
+		}
+		for (unsigned long long int v = 0; v < vertices_count; ++v) {
+			s.offsets[v + 1] += s.offsets[v];
+		}
+		for (unsigned long long int i = 0; i < count; ++i) {
+			s.triangles[s.offsets[out_indices[i]]++] = (unsigned int) (i / 3);
+		}
+		/* filling moved every offset to where the next vertex starts */
+		for (unsigned long long int v = vertices_count; v > 0; --v) {
+			s.offsets[v] = s.offsets[v - 1];
+		}
+		s.offsets[0] = 0;
+
+		unsigned long long int collapses_count = 0;
+		for (unsigned long long int i = 0; i < count; ++i) {
+			unsigned int a = out_indices[i];
+			unsigned int b = out_indices[i - i % 3 + (i + 1) % 3];
+			/* shared edges are seen once from each side */
+			if (a > b) {
+				continue;
+			}
+			double ab = (s.flags[a] & SIMPLIFY_LOCKED) ? HUGE_VAL : simplify_cost(&s, a, b);
+			double ba = (s.flags[b] & SIMPLIFY_LOCKED) ? HUGE_VAL : simplify_cost(&s, b, a);
+			if (ab == HUGE_VAL && ba == HUGE_VAL) {
+				continue;
+			}
+			simplify_collapse_t * c = &s.collapses[collapses_count++];
+			c->cost = (ab <= ba) ? ab : ba;
+			c->from = (ab <= ba) ? a : b;
+			c->to = (ab <= ba) ? b : a;
+		}
+		qsort(s.collapses, collapses_count, sizeof(simplify_collapse_t), simplify_collapse_compare);
+
+		/* most collapses take two triangles with them */
+		unsigned long long int wanted = (count - target_count) / 6 + 1;
+		unsigned long long int collapsed = 0;
+		for (unsigned long long int i = 0; i < collapses_count && collapsed < wanted; ++i) {
+			simplify_collapse_t * c = &s.collapses[i];
+			if (c->cost > limit) {
+				break;
+			}
+			if ((s.flags[c->from] | s.flags[c->to]) & SIMPLIFY_TOUCHED) {
+				continue;
+			}
+			if (simplify_flips(&s, out_indices, c->from, c->to)) {
+				continue;
+			}
+
+			s.remap[c->from] = c->to;
+			simplify_quadric_t * q = &s.quadrics[c->to];
+			const simplify_quadric_t * r = &s.quadrics[c->from];
+			q->xx += r->xx; q->xy += r->xy; q->xz += r->xz;
+			q->yy += r->yy; q->yz += r->yz; q->zz += r->zz;
+			q->x += r->x; q->y += r->y; q->z += r->z;
+			q->c += r->c; q->w += r->w;
+			s.flags[c->from] |= SIMPLIFY_TOUCHED;
+			s.flags[c->to] |= SIMPLIFY_TOUCHED;
+			error = (c->cost > error) ? c->cost : error;
+			++collapsed;
+		}
+		if (collapsed == 0) {
+			break;
+		}
+
+		/* vertices collapsed into this pass were never collapsed themselves, remapping once is enough */
+		unsigned long long int kept = 0;
+		for (unsigned long long int i = 0; i < count; i += 3) {
+			unsigned int a = s.remap[out_indices[i + 0]];
+			unsigned int b = s.remap[out_indices[i + 1]];
+			unsigned int c = s.remap[out_indices[i + 2]];
+			if (a == b || b == c || c == a) {
+				continue;
+			}
+			out_indices[kept++] = a;
+			out_indices[kept++] = b;
+			out_indices[kept++] = c;
+		}
+		count = kept;
+		for (unsigned long long int v = 0; v < vertices_count; ++v) {
+			s.remap[v] = (unsigned int) v;
+			s.flags[v] &= ~SIMPLIFY_TOUCHED;
+		}
+	}
+
+	*out_count = count;
+	*out_error = (float) sqrt(error);
+	simplify_free(&s);
+	return 0;
+}
+
+static const float * simplify_position(simplify_t * s, unsigned int vertex) {
+	return (const float *) ((const char *) s->positions + vertex * s->stride);
+}
+
+static void simplify_quadrics(simplify_t * s, const unsigned int * indices, unsigned long long int indices_count) {
+	for (unsigned long long int i = 0; i < indices_count; i += 3) {
+		const float * p0 = simplify_position(s, indices[i + 0]);
+		const float * p1 = simplify_position(s, indices[i + 1]);
+		const float * p2 = simplify_position(s, indices[i + 2]);
+		double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		double n[3] = {
+			e1[1] * e2[2] - e1[2] * e2[1],
+			e1[2] * e2[0] - e1[0] * e2[2],
+			e1[0] * e2[1] - e1[1] * e2[0],
+		};
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0) {
+			continue;
+		}
+		n[0] /= length;
+		n[1] /= length;
+		n[2] /= length;
+		double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		double w = length * 0.5;
+
+		for (unsigned int k = 0; k < 3; ++k) {
+			simplify_quadric_t * q = &s->quadrics[indices[i + k]];
+			q->xx += w * n[0] * n[0]; q->xy += w * n[0] * n[1]; q->xz += w * n[0] * n[2];
+			q->yy += w * n[1] * n[1]; q->yz += w * n[1] * n[2]; q->zz += w * n[2] * n[2];
+			q->x += w * n[0] * d; q->y += w * n[1] * d; q->z += w * n[2] * d;
+			q->c += w * d * d;
+			q->w += w;
+		}
+	}
+}
+
+/* edges used by one triangle are open, more than two is not a surface either */
+static void simplify_lock_open_edges(simplify_t * s, const unsigned int * indices, unsigned long long int indices_count) {
+	unsigned long long int mask = s->edges_capacity - 1;
+	memset(s->edges_count, 0, sizeof(unsigned int) * s->edges_capacity);
+	for (unsigned long long int i = 0; i < indices_count; ++i) {
+		unsigned int a = indices[i];
+		unsigned int b = indices[i - i % 3 + (i + 1) % 3];
+		unsigned long long int key = (a < b) ? ((unsigned long long int) a << 32 | b) : ((unsigned long long int) b << 32 | a);
+		unsigned long long int slot = (key * 0x9E3779B97F4A7C15ull) >> 20 & mask;
+		while (s->edges_count[slot] != 0 && s->edges[slot] != key) {
+			slot = (slot + 1) & mask;
+		}
+		s->edges[slot] = key;
+		++s->edges_count[slot];
+	}
+
+	for (unsigned long long int slot = 0; slot < s->edges_capacity; ++slot) {
+		if (s->edges_count[slot] == 1 || s->edges_count[slot] > 2) {
+			s->flags[s->edges[slot] >> 32] |= SIMPLIFY_LOCKED;
+			s->flags[s->edges[slot] & 0xFFFFFFFFull] |= SIMPLIFY_LOCKED;
+		}
+	}
+}
+
+/* error of moving from onto to, with both vertices' planes */
+static double simplify_cost(simplify_t * s, unsigned int from, unsigned int to) {
+	const simplify_quadric_t * a = &s->quadrics[from];
+	const simplify_quadric_t * b = &s->quadrics[to];
+	const float * p = simplify_position(s, to);
+	double x = p[0];
+	double y = p[1];
+	double z = p[2];
+	double w = a->w + b->w;
+	if (w == 0) {
+		return 0;
+	}
+
+	double e = (a->xx + b->xx) * x * x + (a->yy + b->yy) * y * y + (a->zz + b->zz) * z * z +
+		2 * ((a->xy + b->xy) * x * y + (a->xz + b->xz) * x * z + (a->yz + b->yz) * y * z) +
+		2 * ((a->x + b->x) * x + (a->y + b->y) * y + (a->z + b->z) * z) +
+		(a->c + b->c);
+	return (e > 0) ? e / w : 0;
+}
+
+/* whether moving from onto to turns any of from's remaining triangles over */
+static unsigned char simplify_flips(simplify_t * s, const unsigned int * indices, unsigned int from, unsigned int to) {
+	for (unsigned int t = s->offsets[from]; t < s->offsets[from + 1]; ++t) {
+		const unsigned int * tri = &indices[s->triangles[t] * 3];
+		unsigned int v[3] = { s->remap[tri[0]], s->remap[tri[1]], s->remap[tri[2]] };
+		/* triangles around the edge disappear */
+		if (v[0] == to || v[1] == to || v[2] == to || v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) {
+			continue;
+		}
+
+		const float * p[3];
+		const float * q[3];
+		for (unsigned int k = 0; k < 3; ++k) {
+			p[k] = simplify_position(s, v[k]);
+			q[k] = (v[k] == from) ? simplify_position(s, to) : p[k];
+		}
+		double n[2][3];
+		for (unsigned int k = 0; k < 2; ++k) {
+			const float ** r = (k == 0) ? p : q;
+			double e1[3] = { r[1][0] - r[0][0], r[1][1] - r[0][1], r[1][2] - r[0][2] };
+			double e2[3] = { r[2][0] - r[0][0], r[2][1] - r[0][1], r[2][2] - r[0][2] };
+			n[k][0] = e1[1] * e2[2] - e1[2] * e2[1];
+			n[k][1] = e1[2] * e2[0] - e1[0] * e2[2];
+			n[k][2] = e1[0] * e2[1] - e1[1] * e2[0];
+		}
+		if (n[0][0] * n[1][0] + n[0][1] * n[1][1] + n[0][2] * n[1][2] <= 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int simplify_collapse_compare(const void * a, const void * b) {
+	double x = ((const simplify_collapse_t *) a)->cost;
+	double y = ((const simplify_collapse_t *) b)->cost;
+	return (x > y) - (x < y);
+}
+
+static void simplify_free(simplify_t * s) {
+	free(s->quadrics);
+	free(s->remap);
+	free(s->flags);
+	free(s->offsets);
+	free(s->triangles);
+	free(s->collapses);
+	free(s->edges);
+	free(s->edges_count);
+}
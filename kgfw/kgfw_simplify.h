@@ -0,0 +1,23 @@
+#ifndef KRISVERS_KGFW_SIMPLIFY_H
+#define KRISVERS_KGFW_SIMPLIFY_H
+
+#include "kgfw_defines.h"
+
+/*
+	quadric error simplification of an indexed triangle list. edges are collapsed into one of their
+	vertices, cheapest first by the summed squared distance to the planes of the original triangles
+	around both, so the result indexes the same vertices and keeps their attributes.
+	vertices on open edges (including uv and normal seams) are never moved, so the result stays watertight
+	wherever the original was
+*/
+
+/*
+	collapses edges until at most target_count indices are left and writes them to out_indices, which must have room for indices_count.
+	stops early if the next collapse's error would be over max_error, or if nothing more can be collapsed.
+	positions are 3 floats, stride bytes apart. out_error gets the largest collapse error, the area weighted
+	root mean square distance of a moved vertex to the original triangles around it, in the positions' units.
+	returns non-zero if memory could not be allocated
+*/
+KGFW_PUBLIC int kgfw_simplify(const float * positions, unsigned long long int vertices_count, unsigned long long int stride, const unsigned int * indices, unsigned long long int indices_count, unsigned long long int target_count, float max_error, unsigned int * out_indices, unsigned long long int * out_count, float * out_error);
+
+#endif
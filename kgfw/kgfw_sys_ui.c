@@ -2,18 +2,28 @@
 #include "kgfw_log.h"
 #include "kgfw_input.h"
 
+#include <string.h>
+
 struct {
 	kgfw_uuid_t comp_uuid;
+	kgfw_uuid_t system_uuid;
 	struct {
 		float x;
 		float y;
 		unsigned char click;
 	} mouse;
 
+	/* camera aspect scale, refreshed once per update on the main thread */
+	struct {
+		float x;
+		float y;
+	} scale;
+
 	kgfw_camera_t * camera;
 	kgfw_window_t * window;
 } static state = {
 	.comp_uuid = 0,
+	.system_uuid = 0,
 
 	.mouse = {
 		.x = 0,
@@ -21,19 +31,46 @@ struct {
 		.click = 0,
 	},
 
+	.scale = {
+		.x = 1,
+		.y = 1,
+	},
+
 	.camera = NULL,
 	.window = NULL,
 };
 
-static void comp_ui_update(kgfw_sys_ui_component_t * self);
+static unsigned char comp_ui_layout(kgfw_sys_ui_component_t * self);
+static void comp_ui_click(kgfw_sys_ui_component_t * self);
 static void comp_ui_start(kgfw_sys_ui_component_t * self);
 static void comp_ui_destroy(kgfw_sys_ui_component_t * self);
 static void ui_mouse_callback(kgfw_window_t * window, kgfw_input_mouse_button_enum button, unsigned char action);
+static void ui_mouse_events(const void * events, unsigned long long int count, void * data);
+static void ui_frame(void);
+static void ui_layout_span(kgfw_component_span_t * span, void * data);
+static void ui_click_span(kgfw_component_span_t * span, void * data);
+static void sys_ui_update(kgfw_system_t * self, kgfw_component_node_t * components);
+static void sys_ui_start(kgfw_system_t * self, kgfw_component_node_t * components);
+static void sys_ui_destroy(kgfw_system_t * self);
 
 kgfw_uuid_t kgfw_sys_ui_init(kgfw_camera_t * camera) {
+	/* click callbacks may touch anything, so the system stays undeclared and runs on the main thread */
+	kgfw_system_t system = {
+		.update = sys_ui_update,
+		.start = sys_ui_start,
+		.destroy = sys_ui_destroy,
+	};
+
+	state.system_uuid = kgfw_system_construct("ui", sizeof(kgfw_system_t), &system, NULL);
+	if (state.system_uuid == KGFW_ECS_INVALID_ID) {
+		kgfw_logf(KGFW_LOG_SEVERITY_WARN, "kgfw UI system construction failed");
+		return 0;
+	}
+
 	kgfw_sys_ui_component_t component = {
 		{
-			.update = (kgfw_component_update_f) comp_ui_update,
+			/* laid out and clicked a span at a time by sys_ui_update, never per component */
+			.update = NULL,
 			.start = (kgfw_component_start_f) comp_ui_start,
 			.destroy = (kgfw_component_destroy_f) comp_ui_destroy,
 
@@ -55,14 +92,16 @@ kgfw_uuid_t kgfw_sys_ui_init(kgfw_camera_t * camera) {
 		.is_clipspace = 1,
 	};
 
-	kgfw_uuid_t uuid = kgfw_component_construct("ui", sizeof(kgfw_sys_ui_component_t), &component, 0);
+	kgfw_uuid_t uuid = kgfw_component_construct("ui", sizeof(kgfw_sys_ui_component_t), &component, state.system_uuid);
 	if (uuid == 0) {
 		kgfw_logf(KGFW_LOG_SEVERITY_WARN, "kgfw UI component construction failed");
 		return 0;
 	}
 
 	state.comp_uuid = uuid;
-	kgfw_input_mouse_button_register_callback(ui_mouse_callback);
+	if (kgfw_event_subscribe(kgfw_input_mouse_button_event_type(), ui_mouse_events, NULL, 0) != 0) {
+		kgfw_input_mouse_button_register_callback(ui_mouse_callback);
+	}
 	state.camera = camera;
 
 	return state.comp_uuid;
@@ -76,18 +115,16 @@ kgfw_uuid_t kgfw_sys_ui_get_uuid(void) {
 	return state.comp_uuid;
 }
 
-static void comp_ui_update(kgfw_sys_ui_component_t * self) {
-	float xs = 1;
-	float ys = 1;
-
-	if (state.camera->ratio < 1) {
-		ys = 1.0f / state.camera->ratio;
-	}
-	else {
-		xs = state.camera->ratio;
+/*
+	only writes to the component's own mesh, safe to run for many components at once.
+	returns 1 if the mesh was rewritten
+*/
+static unsigned char comp_ui_layout(kgfw_sys_ui_component_t * self) {
+	float ys = state.scale.y;
+	if (self->laid_out.mesh == self->mesh && self->laid_out.scale == ys && memcmp(&self->laid_out.rect, &self->rect, sizeof(kgfw_sys_ui_rect_t)) == 0) {
+		return 0;
 	}
 
-	kgfw_input_mouse_pos(&state.mouse.x, &state.mouse.y);
 	float mw = self->rect.width / ys;
 	float mh = self->rect.height / ys;
 	float mx = (self->rect.x - (self->rect.width * self->rect.origin.x)) / ys;
@@ -96,8 +133,19 @@ static void comp_ui_update(kgfw_sys_ui_component_t * self) {
 	self->mesh->transform.pos[1] = my;
 	self->mesh->transform.scale[0] = mw;// - (mw * self->rect.origin.x);
 	self->mesh->transform.scale[1] = mh;// + (mh * self->rect.origin.y);
+	kgfw_graphics_mesh_transform_changed(self->mesh);
+
+	self->laid_out.rect = self->rect;
+	self->laid_out.scale = ys;
+	self->laid_out.mesh = self->mesh;
 
 	//kgfw_logf(KGFW_LOG_SEVERITY_DEBUG, "comp update 0x%llx", self->base.instance_id);
+	return 1;
+}
+
+static void comp_ui_click(kgfw_sys_ui_component_t * self) {
+	float xs = state.scale.x;
+	float ys = state.scale.y;
 
 	if (state.mouse.click && self->click != NULL) {
 		float x = ((state.mouse.x / (float) state.window->width) * 2 - 1) * xs + (self->rect.width * self->rect.origin.x);
@@ -133,4 +181,62 @@ static void ui_mouse_callback(kgfw_window_t * window, kgfw_input_mouse_button_en
 
 	kgfw_input_mouse_pos(&state.mouse.x, &state.mouse.y);
 	state.window = window;
-}
\ No newline at end of file
+}
+
+static void ui_mouse_events(const void * events, unsigned long long int count, void * data) {
+	/* only the latest button change decides the click state */
+	const kgfw_input_mouse_button_event_t * last = &((const kgfw_input_mouse_button_event_t *) events)[count - 1];
+	state.mouse.click = (last->action == 1);
+	state.mouse.x = last->x;
+	state.mouse.y = last->y;
+	state.window = last->window;
+}
+
+static void ui_frame(void) {
+	state.scale.x = 1;
+	state.scale.y = 1;
+
+	if (state.camera->ratio < 1) {
+		state.scale.y = 1.0f / state.camera->ratio;
+	}
+	else {
+		state.scale.x = state.camera->ratio;
+	}
+
+	kgfw_input_mouse_pos(&state.mouse.x, &state.mouse.y);
+}
+
+/* relaid out components are marked changed so mesh consumers can skip the rest */
+static void ui_layout_span(kgfw_component_span_t * span, void * data) {
+	for (unsigned long long int i = 0; i < span->count; ++i) {
+		if (comp_ui_layout((kgfw_sys_ui_component_t *) KGFW_COMPONENT_SPAN_AT(span, i))) {
+			kgfw_component_span_mark_changed(span, i);
+		}
+	}
+}
+
+/* stops at the first component that takes the click */
+static void ui_click_span(kgfw_component_span_t * span, void * data) {
+	for (unsigned long long int i = 0; i < span->count && state.mouse.click; ++i) {
+		comp_ui_click((kgfw_sys_ui_component_t *) KGFW_COMPONENT_SPAN_AT(span, i));
+	}
+}
+
+/* layout is spread over component chunks, clicks stay serial since they call user code */
+static void sys_ui_update(kgfw_system_t * self, kgfw_component_node_t * components) {
+	ui_frame();
+	kgfw_ecs_each_parallel(state.comp_uuid, ui_layout_span, NULL);
+	if (state.mouse.click) {
+		kgfw_ecs_each(state.comp_uuid, ui_click_span, NULL);
+	}
+}
+
+static void sys_ui_start(kgfw_system_t * self, kgfw_component_node_t * components) {
+	for (kgfw_component_node_t * n = components; n != NULL; n = n->next) {
+		n->component->start(n->component);
+	}
+}
+
+static void sys_ui_destroy(kgfw_system_t * self) {
+	return;
+}
@@ -29,6 +29,13 @@ struct kgfw_sys_ui_component {
 	unsigned char is_clipspace;
 
 	kgfw_graphics_mesh_node_t * mesh;
+
+	/* what the mesh was last laid out with, the mesh is only rewritten when any of it changes */
+	struct {
+		kgfw_sys_ui_rect_t rect;
+		float scale;
+		kgfw_graphics_mesh_node_t * mesh;
+	} laid_out;
 };
 
 kgfw_uuid_t kgfw_sys_ui_init(kgfw_camera_t * camera);
@@ -0,0 +1,200 @@
+#include "kgfw_thread.h"
+#include <stdlib.h>
+
+#if defined(KGFW_WINDOWS)
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sched.h>
+#endif
+
+typedef struct thread_start {
+	kgfw_thread_f func;
+	void * arg;
+} thread_start_t;
+
+#if defined(KGFW_WINDOWS)
+static DWORD WINAPI thread_entry(LPVOID param) {
+#else
+static void * thread_entry(void * param) {
+#endif
+	thread_start_t start = *(thread_start_t *) param;
+	free(param);
+
+	start.func(start.arg);
+	return 0;
+}
+
+int kgfw_thread_create(kgfw_thread_t * out_thread, kgfw_thread_f func, void * arg) {
+	thread_start_t * start = malloc(sizeof(thread_start_t));
+	if (start == NULL) {
+		return 1;
+	}
+
+	start->func = func;
+	start->arg = arg;
+
+#if defined(KGFW_WINDOWS)
+	*out_thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+	if (*out_thread == NULL) {
+		free(start);
+		return 2;
+	}
+#else
+	if (pthread_create(out_thread, NULL, thread_entry, start) != 0) {
+		free(start);
+		return 2;
+	}
+#endif
+
+	return 0;
+}
+
+void kgfw_thread_join(kgfw_thread_t * thread) {
+#if defined(KGFW_WINDOWS)
+	WaitForSingleObject(*thread, INFINITE);
+	CloseHandle(*thread);
+#else
+	pthread_join(*thread, NULL);
+#endif
+}
+
+unsigned int kgfw_thread_hardware_count(void) {
+#if defined(KGFW_WINDOWS)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	long count = (long) info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	return (count < 1) ? 1 : (unsigned int) count;
+}
+
+void kgfw_thread_yield(void) {
+#if defined(KGFW_WINDOWS)
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+int kgfw_mutex_init(kgfw_mutex_t * mutex) {
+#if defined(KGFW_WINDOWS)
+	InitializeSRWLock((PSRWLOCK) &mutex->internal);
+	return 0;
+#else
+	return pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void kgfw_mutex_destroy(kgfw_mutex_t * mutex) {
+#if !defined(KGFW_WINDOWS)
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+void kgfw_mutex_lock(kgfw_mutex_t * mutex) {
+#if defined(KGFW_WINDOWS)
+	AcquireSRWLockExclusive((PSRWLOCK) &mutex->internal);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+void kgfw_mutex_unlock(kgfw_mutex_t * mutex) {
+#if defined(KGFW_WINDOWS)
+	ReleaseSRWLockExclusive((PSRWLOCK) &mutex->internal);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+int kgfw_cond_init(kgfw_cond_t * cond) {
+#if defined(KGFW_WINDOWS)
+	InitializeConditionVariable((PCONDITION_VARIABLE) &cond->internal);
+	return 0;
+#else
+	return pthread_cond_init(cond, NULL);
+#endif
+}
+
+void kgfw_cond_destroy(kgfw_cond_t * cond) {
+#if !defined(KGFW_WINDOWS)
+	pthread_cond_destroy(cond);
+#endif
+}
+
+void kgfw_cond_wait(kgfw_cond_t * cond, kgfw_mutex_t * mutex) {
+#if defined(KGFW_WINDOWS)
+	SleepConditionVariableSRW((PCONDITION_VARIABLE) &cond->internal, (PSRWLOCK) &mutex->internal, INFINITE, 0);
+#else
+	pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void kgfw_cond_signal(kgfw_cond_t * cond) {
+#if defined(KGFW_WINDOWS)
+	WakeConditionVariable((PCONDITION_VARIABLE) &cond->internal);
+#else
+	pthread_cond_signal(cond);
+#endif
+}
+
+void kgfw_cond_broadcast(kgfw_cond_t * cond) {
+#if defined(KGFW_WINDOWS)
+	WakeAllConditionVariable((PCONDITION_VARIABLE) &cond->internal);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
+
+#if defined(KGFW_MSVC)
+long long int kgfw_atomic_load(volatile long long int * value) {
+	return _InterlockedCompareExchange64(value, 0, 0);
+}
+
+void kgfw_atomic_store(volatile long long int * value, long long int desired) {
+	_InterlockedExchange64(value, desired);
+}
+
+long long int kgfw_atomic_add(volatile long long int * value, long long int amount) {
+	return _InterlockedExchangeAdd64(value, amount) + amount;
+}
+
+int kgfw_atomic_cas(volatile long long int * value, long long int expected, long long int desired) {
+	return _InterlockedCompareExchange64(value, desired, expected) == expected;
+}
+
+void * kgfw_atomic_load_ptr(void * volatile * value) {
+	return _InterlockedCompareExchangePointer(value, NULL, NULL);
+}
+
+void kgfw_atomic_store_ptr(void * volatile * value, void * desired) {
+	_InterlockedExchangePointer(value, desired);
+}
+#else
+long long int kgfw_atomic_load(volatile long long int * value) {
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+void kgfw_atomic_store(volatile long long int * value, long long int desired) {
+	__atomic_store_n(value, desired, __ATOMIC_SEQ_CST);
+}
+
+long long int kgfw_atomic_add(volatile long long int * value, long long int amount) {
+	return __atomic_add_fetch(value, amount, __ATOMIC_SEQ_CST);
+}
+
+int kgfw_atomic_cas(volatile long long int * value, long long int expected, long long int desired) {
+	return __atomic_compare_exchange_n(value, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void * kgfw_atomic_load_ptr(void * volatile * value) {
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+void kgfw_atomic_store_ptr(void * volatile * value, void * desired) {
+	__atomic_store_n(value, desired, __ATOMIC_SEQ_CST);
+}
+#endif
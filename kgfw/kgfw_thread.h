@@ -0,0 +1,56 @@
+#ifndef KRISVERS_KGFW_THREAD_H
+#define KRISVERS_KGFW_THREAD_H
+
+#include "kgfw_defines.h"
+
+#if defined(KGFW_WINDOWS)
+/* HANDLE */
+typedef void * kgfw_thread_t;
+/* SRWLOCK */
+typedef struct kgfw_mutex {
+	void * internal;
+} kgfw_mutex_t;
+/* CONDITION_VARIABLE */
+typedef struct kgfw_cond {
+	void * internal;
+} kgfw_cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t kgfw_thread_t;
+typedef pthread_mutex_t kgfw_mutex_t;
+typedef pthread_cond_t kgfw_cond_t;
+
+#endif
+
+typedef void (*kgfw_thread_f)(void * arg);
+
+/* returns non-zero if threads are unavailable (ex. emscripten without pthreads) */
+KGFW_PUBLIC int kgfw_thread_create(kgfw_thread_t * out_thread, kgfw_thread_f func, void * arg);
+KGFW_PUBLIC void kgfw_thread_join(kgfw_thread_t * thread);
+/* number of logical processors, at least 1 */
+KGFW_PUBLIC unsigned int kgfw_thread_hardware_count(void);
+KGFW_PUBLIC void kgfw_thread_yield(void);
+
+KGFW_PUBLIC int kgfw_mutex_init(kgfw_mutex_t * mutex);
+KGFW_PUBLIC void kgfw_mutex_destroy(kgfw_mutex_t * mutex);
+KGFW_PUBLIC void kgfw_mutex_lock(kgfw_mutex_t * mutex);
+KGFW_PUBLIC void kgfw_mutex_unlock(kgfw_mutex_t * mutex);
+
+KGFW_PUBLIC int kgfw_cond_init(kgfw_cond_t * cond);
+KGFW_PUBLIC void kgfw_cond_destroy(kgfw_cond_t * cond);
+/* mutex must be locked by the calling thread */
+KGFW_PUBLIC void kgfw_cond_wait(kgfw_cond_t * cond, kgfw_mutex_t * mutex);
+KGFW_PUBLIC void kgfw_cond_signal(kgfw_cond_t * cond);
+KGFW_PUBLIC void kgfw_cond_broadcast(kgfw_cond_t * cond);
+
+/* sequentially consistent atomics */
+KGFW_PUBLIC long long int kgfw_atomic_load(volatile long long int * value);
+KGFW_PUBLIC void kgfw_atomic_store(volatile long long int * value, long long int desired);
+/* returns the new value */
+KGFW_PUBLIC long long int kgfw_atomic_add(volatile long long int * value, long long int amount);
+/* returns non-zero if *value was expected and got replaced by desired */
+KGFW_PUBLIC int kgfw_atomic_cas(volatile long long int * value, long long int expected, long long int desired);
+KGFW_PUBLIC void * kgfw_atomic_load_ptr(void * volatile * value);
+KGFW_PUBLIC void kgfw_atomic_store_ptr(void * volatile * value, void * desired);
+
+#endif
@@ -1,9 +1,425 @@
 #include "kgfw_transform.h"
+#include <stdlib.h>
 #include <string.h>
 
+#define HIERARCHY_DIRTY 0x1
+#define HIERARCHY_ABSOLUTE 0x2
+#define HIERARCHY_MIN_CAPACITY 64
+
+static int hierarchy_reserve(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int count);
+static kgfw_transform_node_t hierarchy_node_alloc(kgfw_transform_hierarchy_t * hierarchy);
+static unsigned long long int hierarchy_index(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node);
+static void hierarchy_copy(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int to, unsigned long long int from, unsigned long long int count);
+static void hierarchy_reindex(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int begin, unsigned long long int end);
+static void hierarchy_resize_ancestors(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node, long long int amount);
+static void hierarchy_dirty(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int index);
+static void hierarchy_subtree_update(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int index);
+static int hierarchy_index_compare(const void * a, const void * b);
+
 void kgfw_transform_identity(kgfw_transform_t * transform) {
 	memset(transform, 0, sizeof(kgfw_transform_t));
 	transform->scale[0] = 1.0f;
 	transform->scale[1] = 1.0f;
 	transform->scale[2] = 1.0f;
 }
+
+void kgfw_transform_matrix(const kgfw_transform_t * transform, mat4x4 out_m) {
+	mat4x4_translate(out_m, transform->pos[0], transform->pos[1], transform->pos[2]);
+	mat4x4_rotate_X(out_m, out_m, transform->rot[0] * 3.141592f / 180.0f);
+	mat4x4_rotate_Y(out_m, out_m, transform->rot[1] * 3.141592f / 180.0f);
+	mat4x4_rotate_Z(out_m, out_m, transform->rot[2] * 3.141592f / 180.0f);
+	mat4x4_scale_aniso(out_m, out_m, transform->scale[0], transform->scale[1], transform->scale[2]);
+}
+
+int kgfw_transform_hierarchy_init(kgfw_transform_hierarchy_t * hierarchy) {
+	memset(hierarchy, 0, sizeof(kgfw_transform_hierarchy_t));
+	hierarchy->free_node = KGFW_TRANSFORM_NODE_NONE;
+	if (kgfw_mutex_init(&hierarchy->mutex) != 0) {
+		return 1;
+	}
+
+	return 0;
+}
+
+void kgfw_transform_hierarchy_deinit(kgfw_transform_hierarchy_t * hierarchy) {
+	free(hierarchy->locals);
+	free(hierarchy->datas);
+	free(hierarchy->worlds);
+	free(hierarchy->parents);
+	free(hierarchy->nodes);
+	free(hierarchy->sizes);
+	free(hierarchy->flags);
+	free(hierarchy->indices);
+	free(hierarchy->dirty);
+	free(hierarchy->updated);
+	kgfw_mutex_destroy(&hierarchy->mutex);
+	memset(hierarchy, 0, sizeof(kgfw_transform_hierarchy_t));
+	hierarchy->free_node = KGFW_TRANSFORM_NODE_NONE;
+}
+
+kgfw_transform_node_t kgfw_transform_hierarchy_add(kgfw_transform_hierarchy_t * hierarchy, const kgfw_transform_t * local, void * data, kgfw_transform_node_t parent) {
+	if (local == NULL) {
+		return KGFW_TRANSFORM_NODE_NONE;
+	}
+
+	unsigned long long int at = hierarchy->count;
+	if (parent != KGFW_TRANSFORM_NODE_NONE) {
+		unsigned long long int p = hierarchy_index(hierarchy, parent);
+		if (p == hierarchy->count) {
+			return KGFW_TRANSFORM_NODE_NONE;
+		}
+		at = p + hierarchy->sizes[p];
+	}
+
+	if (hierarchy_reserve(hierarchy, hierarchy->count + 1) != 0) {
+		return KGFW_TRANSFORM_NODE_NONE;
+	}
+	kgfw_transform_node_t node = hierarchy_node_alloc(hierarchy);
+	if (node == KGFW_TRANSFORM_NODE_NONE) {
+		return KGFW_TRANSFORM_NODE_NONE;
+	}
+
+	hierarchy_copy(hierarchy, at + 1, at, hierarchy->count - at);
+	++hierarchy->count;
+	hierarchy->locals[at] = local;
+	hierarchy->datas[at] = data;
+	hierarchy->parents[at] = parent;
+	hierarchy->nodes[at] = node;
+	hierarchy->sizes[at] = 1;
+	hierarchy->flags[at] = 0;
+	kgfw_transform_matrix(local, hierarchy->worlds[at]);
+	hierarchy_reindex(hierarchy, at, hierarchy->count);
+	hierarchy_resize_ancestors(hierarchy, parent, 1);
+	hierarchy_dirty(hierarchy, at);
+
+	return node;
+}
+
+void kgfw_transform_hierarchy_remove(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node) {
+	unsigned long long int i = hierarchy_index(hierarchy, node);
+	if (i == hierarchy->count) {
+		return;
+	}
+
+	kgfw_transform_node_t parent = hierarchy->parents[i];
+	for (unsigned long long int j = i + 1; j < i + hierarchy->sizes[i]; j += hierarchy->sizes[j]) {
+		hierarchy->parents[j] = parent;
+		hierarchy_dirty(hierarchy, j);
+	}
+	hierarchy_resize_ancestors(hierarchy, parent, -1);
+
+	hierarchy_copy(hierarchy, i, i + 1, hierarchy->count - i - 1);
+	--hierarchy->count;
+	hierarchy_reindex(hierarchy, i, hierarchy->count);
+
+	hierarchy->indices[node] = hierarchy->free_node;
+	hierarchy->free_node = node;
+}
+
+int kgfw_transform_hierarchy_set_parent(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node, kgfw_transform_node_t parent) {
+	unsigned long long int i = hierarchy_index(hierarchy, node);
+	if (i == hierarchy->count) {
+		return 1;
+	}
+
+	unsigned long long int size = hierarchy->sizes[i];
+	/* where the subtree goes before it is taken out */
+	unsigned long long int end = hierarchy->count;
+	if (parent != KGFW_TRANSFORM_NODE_NONE) {
+		unsigned long long int p = hierarchy_index(hierarchy, parent);
+		if (p == hierarchy->count) {
+			return 1;
+		}
+		if (p >= i && p < i + size) {
+			return 2;
+		}
+		end = p + hierarchy->sizes[p];
+	}
+	if (hierarchy->parents[i] == parent) {
+		return 0;
+	}
+
+	/* the spare capacity past count holds the subtree while the nodes in between shift */
+	if (hierarchy_reserve(hierarchy, hierarchy->count + size) != 0) {
+		return 3;
+	}
+
+	unsigned long long int to = (end > i) ? end - size : end;
+	hierarchy_resize_ancestors(hierarchy, hierarchy->parents[i], -((long long int) size));
+	hierarchy_copy(hierarchy, hierarchy->count, i, size);
+	if (to < i) {
+		hierarchy_copy(hierarchy, to + size, to, i - to);
+	} else {
+		hierarchy_copy(hierarchy, i, i + size, to - i);
+	}
+	hierarchy_copy(hierarchy, to, hierarchy->count, size);
+	hierarchy->parents[to] = parent;
+
+	hierarchy_reindex(hierarchy, (to < i) ? to : i, ((to < i) ? i : to) + size);
+	hierarchy_resize_ancestors(hierarchy, parent, (long long int) size);
+	hierarchy_dirty(hierarchy, to);
+
+	return 0;
+}
+
+kgfw_transform_node_t kgfw_transform_hierarchy_parent(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node) {
+	unsigned long long int i = hierarchy_index(hierarchy, node);
+	if (i == hierarchy->count) {
+		return KGFW_TRANSFORM_NODE_NONE;
+	}
+
+	return hierarchy->parents[i];
+}
+
+void * kgfw_transform_hierarchy_data(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node) {
+	unsigned long long int i = hierarchy_index(hierarchy, node);
+	if (i == hierarchy->count) {
+		return NULL;
+	}
+
+	return hierarchy->datas[i];
+}
+
+void kgfw_transform_hierarchy_set_absolute(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node, unsigned char absolute) {
+	unsigned long long int i = hierarchy_index(hierarchy, node);
+	if (i == hierarchy->count) {
+		return;
+	}
+	if (((hierarchy->flags[i] & HIERARCHY_ABSOLUTE) != 0) == (absolute != 0)) {
+		return;
+	}
+
+	hierarchy->flags[i] ^= HIERARCHY_ABSOLUTE;
+	hierarchy_dirty(hierarchy, i);
+}
+
+void kgfw_transform_hierarchy_mark_dirty(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node) {
+	unsigned long long int i = hierarchy_index(hierarchy, node);
+	if (i == hierarchy->count) {
+		return;
+	}
+
+	hierarchy_dirty(hierarchy, i);
+}
+
+void kgfw_transform_hierarchy_update(kgfw_transform_hierarchy_t * hierarchy) {
+	hierarchy->updated_count = 0;
+	hierarchy->updated_all = 0;
+	if (hierarchy->rebuild) {
+		for (unsigned long long int i = 0; i < hierarchy->count; i += hierarchy->sizes[i]) {
+			hierarchy_subtree_update(hierarchy, i);
+		}
+		hierarchy->dirty_count = 0;
+		hierarchy->rebuild = 0;
+		hierarchy->updated_all = 1;
+		return;
+	}
+	if (hierarchy->dirty_count == 0) {
+		return;
+	}
+
+	if (hierarchy->updated_capacity < hierarchy->dirty_count) {
+		unsigned int * updated = realloc(hierarchy->updated, sizeof(unsigned int) * hierarchy->dirty_capacity);
+		if (updated == NULL) {
+			hierarchy->updated_all = 1;
+		} else {
+			hierarchy->updated = updated;
+			hierarchy->updated_capacity = hierarchy->dirty_capacity;
+		}
+	}
+
+	/* nodes are updated in depth-first order so parents are always done first, subtrees already updated are skipped */
+	unsigned long long int count = 0;
+	for (unsigned long long int i = 0; i < hierarchy->dirty_count; ++i) {
+		unsigned long long int index = hierarchy_index(hierarchy, hierarchy->dirty[i]);
+		if (index != hierarchy->count) {
+			hierarchy->dirty[count++] = (unsigned int) index;
+		}
+	}
+	qsort(hierarchy->dirty, count, sizeof(kgfw_transform_node_t), hierarchy_index_compare);
+
+	unsigned long long int end = 0;
+	for (unsigned long long int i = 0; i < count; ++i) {
+		unsigned long long int index = hierarchy->dirty[i];
+		if (index < end) {
+			continue;
+		}
+		hierarchy_subtree_update(hierarchy, index);
+		end = index + hierarchy->sizes[index];
+		if (!hierarchy->updated_all) {
+			hierarchy->updated[hierarchy->updated_count++] = (unsigned int) index;
+		}
+	}
+	hierarchy->dirty_count = 0;
+}
+
+vec4 * kgfw_transform_hierarchy_world(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node) {
+	unsigned long long int i = hierarchy_index(hierarchy, node);
+	if (i == hierarchy->count) {
+		return NULL;
+	}
+
+	return hierarchy->worlds[i];
+}
+
+static int hierarchy_reserve(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int count) {
+	if (count <= hierarchy->capacity) {
+		return 0;
+	}
+
+	unsigned long long int capacity = (hierarchy->capacity == 0) ? HIERARCHY_MIN_CAPACITY : hierarchy->capacity * 2;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+
+	/* every array is assigned as soon as it grows, so a failure part way leaves them valid */
+	const kgfw_transform_t ** locals = realloc(hierarchy->locals, sizeof(kgfw_transform_t *) * capacity);
+	if (locals == NULL) {
+		return 1;
+	}
+	hierarchy->locals = locals;
+	void ** datas = realloc(hierarchy->datas, sizeof(void *) * capacity);
+	if (datas == NULL) {
+		return 1;
+	}
+	hierarchy->datas = datas;
+	mat4x4 * worlds = realloc(hierarchy->worlds, sizeof(mat4x4) * capacity);
+	if (worlds == NULL) {
+		return 1;
+	}
+	hierarchy->worlds = worlds;
+	kgfw_transform_node_t * parents = realloc(hierarchy->parents, sizeof(kgfw_transform_node_t) * capacity);
+	if (parents == NULL) {
+		return 1;
+	}
+	hierarchy->parents = parents;
+	kgfw_transform_node_t * nodes = realloc(hierarchy->nodes, sizeof(kgfw_transform_node_t) * capacity);
+	if (nodes == NULL) {
+		return 1;
+	}
+	hierarchy->nodes = nodes;
+	unsigned int * sizes = realloc(hierarchy->sizes, sizeof(unsigned int) * capacity);
+	if (sizes == NULL) {
+		return 1;
+	}
+	hierarchy->sizes = sizes;
+	unsigned char * flags = realloc(hierarchy->flags, sizeof(unsigned char) * capacity);
+	if (flags == NULL) {
+		return 1;
+	}
+	hierarchy->flags = flags;
+
+	hierarchy->capacity = capacity;
+	return 0;
+}
+
+static kgfw_transform_node_t hierarchy_node_alloc(kgfw_transform_hierarchy_t * hierarchy) {
+	if (hierarchy->free_node != KGFW_TRANSFORM_NODE_NONE) {
+		kgfw_transform_node_t node = hierarchy->free_node;
+		hierarchy->free_node = hierarchy->indices[node];
+		return node;
+	}
+
+	if (hierarchy->nodes_count >= KGFW_TRANSFORM_NODE_NONE) {
+		return KGFW_TRANSFORM_NODE_NONE;
+	}
+	if (hierarchy->nodes_count == hierarchy->nodes_capacity) {
+		unsigned long long int capacity = (hierarchy->nodes_capacity == 0) ? HIERARCHY_MIN_CAPACITY : hierarchy->nodes_capacity * 2;
+		unsigned int * indices = realloc(hierarchy->indices, sizeof(unsigned int) * capacity);
+		if (indices == NULL) {
+			return KGFW_TRANSFORM_NODE_NONE;
+		}
+		hierarchy->indices = indices;
+		hierarchy->nodes_capacity = capacity;
+	}
+
+	return (kgfw_transform_node_t) hierarchy->nodes_count++;
+}
+
+/* returns count if node does not exist */
+static unsigned long long int hierarchy_index(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node) {
+	if (node >= hierarchy->nodes_count) {
+		return hierarchy->count;
+	}
+
+	unsigned long long int index = hierarchy->indices[node];
+	if (index >= hierarchy->count || hierarchy->nodes[index] != node) {
+		return hierarchy->count;
+	}
+
+	return index;
+}
+
+/* moves count nodes, ranges may overlap */
+static void hierarchy_copy(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int to, unsigned long long int from, unsigned long long int count) {
+	if (count == 0 || to == from) {
+		return;
+	}
+
+	memmove(&hierarchy->locals[to], &hierarchy->locals[from], sizeof(kgfw_transform_t *) * count);
+	memmove(&hierarchy->datas[to], &hierarchy->datas[from], sizeof(void *) * count);
+	memmove(&hierarchy->worlds[to], &hierarchy->worlds[from], sizeof(mat4x4) * count);
+	memmove(&hierarchy->parents[to], &hierarchy->parents[from], sizeof(kgfw_transform_node_t) * count);
+	memmove(&hierarchy->nodes[to], &hierarchy->nodes[from], sizeof(kgfw_transform_node_t) * count);
+	memmove(&hierarchy->sizes[to], &hierarchy->sizes[from], sizeof(unsigned int) * count);
+	memmove(&hierarchy->flags[to], &hierarchy->flags[from], sizeof(unsigned char) * count);
+}
+
+static void hierarchy_reindex(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int begin, unsigned long long int end) {
+	for (unsigned long long int i = begin; i < end; ++i) {
+		hierarchy->indices[hierarchy->nodes[i]] = (unsigned int) i;
+	}
+}
+
+static void hierarchy_resize_ancestors(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node, long long int amount) {
+	while (node != KGFW_TRANSFORM_NODE_NONE) {
+		unsigned long long int index = hierarchy->indices[node];
+		hierarchy->sizes[index] = (unsigned int) ((long long int) hierarchy->sizes[index] + amount);
+		node = hierarchy->parents[index];
+	}
+}
+
+static void hierarchy_dirty(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int index) {
+	kgfw_mutex_lock(&hierarchy->mutex);
+	if (hierarchy->flags[index] & HIERARCHY_DIRTY) {
+		kgfw_mutex_unlock(&hierarchy->mutex);
+		return;
+	}
+	hierarchy->flags[index] |= HIERARCHY_DIRTY;
+
+	if (hierarchy->dirty_count == hierarchy->dirty_capacity) {
+		unsigned long long int capacity = (hierarchy->dirty_capacity == 0) ? HIERARCHY_MIN_CAPACITY : hierarchy->dirty_capacity * 2;
+		kgfw_transform_node_t * dirty = realloc(hierarchy->dirty, sizeof(kgfw_transform_node_t) * capacity);
+		if (dirty == NULL) {
+			/* the next update redoes every node instead */
+			hierarchy->rebuild = 1;
+			kgfw_mutex_unlock(&hierarchy->mutex);
+			return;
+		}
+		hierarchy->dirty = dirty;
+		hierarchy->dirty_capacity = capacity;
+	}
+	hierarchy->dirty[hierarchy->dirty_count++] = hierarchy->nodes[index];
+	kgfw_mutex_unlock(&hierarchy->mutex);
+}
+
+static void hierarchy_subtree_update(kgfw_transform_hierarchy_t * hierarchy, unsigned long long int index) {
+	unsigned long long int end = index + hierarchy->sizes[index];
+	for (unsigned long long int i = index; i < end; ++i) {
+		kgfw_transform_node_t parent = hierarchy->parents[i];
+		if (parent == KGFW_TRANSFORM_NODE_NONE || (hierarchy->flags[i] & HIERARCHY_ABSOLUTE)) {
+			kgfw_transform_matrix(hierarchy->locals[i], hierarchy->worlds[i]);
+		} else {
+			mat4x4 local;
+			kgfw_transform_matrix(hierarchy->locals[i], local);
+			mat4x4_mul(hierarchy->worlds[i], hierarchy->worlds[hierarchy->indices[parent]], local);
+		}
+		hierarchy->flags[i] &= ~HIERARCHY_DIRTY;
+	}
+}
+
+static int hierarchy_index_compare(const void * a, const void * b) {
+	unsigned int x = *(const unsigned int *) a;
+	unsigned int y = *(const unsigned int *) b;
+	return (x > y) - (x < y);
+}
@@ -2,6 +2,8 @@
 #define KRISVERS_KGFW_TRANSFORM_H
 
 #include "kgfw_defines.h"
+#include "kgfw_thread.h"
+#include "../lib/include/linmath.h"
 
 typedef struct kgfw_transform {
 	float pos[3];
@@ -9,6 +11,75 @@ typedef struct kgfw_transform {
 	float scale[3];
 } kgfw_transform_t;
 
+typedef unsigned int kgfw_transform_node_t;
+
+#define KGFW_TRANSFORM_NODE_NONE 0xFFFFFFFFu
+
+/*
+	transform hierarchy kept in depth-first order, so a node's subtree is the node followed by its
+	sizes[i] - 1 descendants. world matrices are stored flat in the same order and only recomputed for
+	subtrees marked dirty, a hierarchy nothing was marked dirty in costs nothing to update.
+	nodes are referred to by handles that stay the same when nodes are reordered
+*/
+typedef struct kgfw_transform_hierarchy {
+	/* [count] in depth-first order, locals are owned by whoever added the node */
+	const kgfw_transform_t ** locals;
+	void ** datas;
+	mat4x4 * worlds;
+	kgfw_transform_node_t * parents;
+	kgfw_transform_node_t * nodes;
+	unsigned int * sizes;
+	unsigned char * flags;
+	unsigned long long int count;
+	unsigned long long int capacity;
+
+	/* [nodes_count] handle to depth-first index, free handles are chained through it */
+	unsigned int * indices;
+	unsigned long long int nodes_count;
+	unsigned long long int nodes_capacity;
+	kgfw_transform_node_t free_node;
+
+	/* marked since the last update, guarded by mutex. rebuild is set if the list could not grow */
+	kgfw_transform_node_t * dirty;
+	unsigned long long int dirty_count;
+	unsigned long long int dirty_capacity;
+	unsigned char rebuild;
+	kgfw_mutex_t mutex;
+
+	/*
+		set by update to the index of every subtree it recomputed, in depth-first order. updated_all is set
+		instead if it recomputed every node. valid until nodes are added, removed or moved
+	*/
+	unsigned int * updated;
+	unsigned long long int updated_count;
+	unsigned long long int updated_capacity;
+	unsigned char updated_all;
+} kgfw_transform_hierarchy_t;
+
 KGFW_PUBLIC void kgfw_transform_identity(kgfw_transform_t * transform);
+/* translation * rotation (x, y then z, in degrees) * scale */
+KGFW_PUBLIC void kgfw_transform_matrix(const kgfw_transform_t * transform, mat4x4 out_m);
+
+KGFW_PUBLIC int kgfw_transform_hierarchy_init(kgfw_transform_hierarchy_t * hierarchy);
+KGFW_PUBLIC void kgfw_transform_hierarchy_deinit(kgfw_transform_hierarchy_t * hierarchy);
+/*
+	adds a node as the last child of parent (KGFW_TRANSFORM_NODE_NONE for a root), local must stay valid until it is removed.
+	roots are appended, children shift the nodes after their parent's subtree. returns KGFW_TRANSFORM_NODE_NONE on error
+*/
+KGFW_PUBLIC kgfw_transform_node_t kgfw_transform_hierarchy_add(kgfw_transform_hierarchy_t * hierarchy, const kgfw_transform_t * local, void * data, kgfw_transform_node_t parent);
+/* the node's children are handed to its parent */
+KGFW_PUBLIC void kgfw_transform_hierarchy_remove(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node);
+/* moves node and its subtree under parent. returns non-zero on error or if parent is in node's subtree */
+KGFW_PUBLIC int kgfw_transform_hierarchy_set_parent(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node, kgfw_transform_node_t parent);
+KGFW_PUBLIC kgfw_transform_node_t kgfw_transform_hierarchy_parent(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node);
+KGFW_PUBLIC void * kgfw_transform_hierarchy_data(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node);
+/* absolute nodes ignore their parent's transform, their children still follow them */
+KGFW_PUBLIC void kgfw_transform_hierarchy_set_absolute(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node, unsigned char absolute);
+/* call after changing a node's local transform. safe to call from any thread as long as no nodes are added, removed or moved */
+KGFW_PUBLIC void kgfw_transform_hierarchy_mark_dirty(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node);
+/* recomputes the world matrices of every dirty subtree */
+KGFW_PUBLIC void kgfw_transform_hierarchy_update(kgfw_transform_hierarchy_t * hierarchy);
+/* world matrix as of the last update, NULL if node does not exist. invalidated by adding or moving nodes */
+KGFW_PUBLIC vec4 * kgfw_transform_hierarchy_world(kgfw_transform_hierarchy_t * hierarchy, kgfw_transform_node_t node);
 
 #endif
@@ -0,0 +1,155 @@
+#include "../kgfw/kgfw_ecs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	headless ECS regression tests, run with make test.
+	exits non-zero if any check failed
+*/
+
+#define TEST_CHECK(condition) test_check((condition), #condition, __FILE__, __LINE__)
+
+typedef struct test_value {
+	kgfw_component_t base;
+	int value;
+} test_value_t;
+
+/* instance ids collected by restore_instance_id */
+typedef struct test_ids {
+	kgfw_uuid_t ids[3];
+	unsigned long long int count;
+} test_ids_t;
+
+static struct {
+	kgfw_uuid_t value;
+	unsigned long long int checks;
+	unsigned long long int failures;
+} state = {
+	0,
+	0, 0
+};
+
+static void test_check(int condition, const char * expression, const char * file, int line);
+static void test_defer_detach_attach(void);
+static void test_defer_attach_detach(void);
+static void test_restore_twice(void);
+static void restore_instance_id(kgfw_component_span_t * span, void * data);
+static void component_start(kgfw_component_t * self);
+static void component_update(kgfw_component_t * self);
+static void component_destroy(kgfw_component_t * self);
+
+int main(int argc, char ** argv) {
+	if (kgfw_ecs_init() != 0) {
+		fprintf(stderr, "ecs init failed\n");
+		return 1;
+	}
+
+	test_value_t value = {
+		{ component_update, component_start, component_destroy, 0, 0, NULL },
+		0,
+	};
+	state.value = kgfw_component_construct("value", sizeof(test_value_t), &value, 0);
+	if (state.value == KGFW_ECS_INVALID_ID) {
+		fprintf(stderr, "ecs component construction failed\n");
+		return 1;
+	}
+
+	test_defer_detach_attach();
+	test_defer_attach_detach();
+	test_restore_twice();
+
+	kgfw_ecs_deinit();
+	printf("test_ecs: %llu checks, %llu failed\n", state.checks, state.failures);
+	return (state.failures == 0) ? 0 : 1;
+}
+
+static void test_check(int condition, const char * expression, const char * file, int line) {
+	++state.checks;
+	if (!condition) {
+		++state.failures;
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+	}
+}
+
+/* replacing a component: the detach has to play back before the attach recorded after it */
+static void test_defer_detach_attach(void) {
+	kgfw_entity_t * e = kgfw_entity_new("detach attach");
+	test_value_t * c = (test_value_t *) kgfw_entity_attach_component(e, state.value);
+	TEST_CHECK(c != NULL);
+	c->value = 1;
+
+	test_value_t replacement;
+	memcpy(&replacement, c, sizeof(test_value_t));
+	replacement.value = 2;
+	kgfw_entity_handle_t handle = e->handle;
+	TEST_CHECK(kgfw_ecs_defer_detach(handle, state.value) == 0);
+	TEST_CHECK(kgfw_ecs_defer_attach(handle, state.value, &replacement) == 0);
+	kgfw_ecs_commands_flush();
+
+	e = kgfw_entity_resolve(handle);
+	TEST_CHECK(e != NULL);
+	c = (test_value_t *) kgfw_entity_get_component(e, state.value);
+	TEST_CHECK(c != NULL);
+	TEST_CHECK(c != NULL && c->value == 2);
+	kgfw_entity_destroy(e);
+}
+
+static void test_defer_attach_detach(void) {
+	kgfw_entity_t * e = kgfw_entity_new("attach detach");
+	kgfw_entity_handle_t handle = e->handle;
+	TEST_CHECK(kgfw_ecs_defer_attach(handle, state.value, NULL) == 0);
+	TEST_CHECK(kgfw_ecs_defer_detach(handle, state.value) == 0);
+	kgfw_ecs_commands_flush();
+
+	e = kgfw_entity_resolve(handle);
+	TEST_CHECK(e != NULL);
+	TEST_CHECK(kgfw_entity_get_component(e, state.value) == NULL);
+	kgfw_entity_destroy(e);
+}
+
+/* restoring the same snapshot twice without replacing, as when streaming a level back in */
+static void test_restore_twice(void) {
+	kgfw_entity_t * e = kgfw_entity_new("restored");
+	TEST_CHECK(kgfw_entity_attach_component(e, state.value) != NULL);
+
+	unsigned long long int size = kgfw_ecs_snapshot(NULL, 0);
+	void * snapshot = malloc(size);
+	TEST_CHECK(snapshot != NULL);
+	if (snapshot == NULL) {
+		return;
+	}
+	TEST_CHECK(kgfw_ecs_snapshot(snapshot, size) == size);
+
+	TEST_CHECK(kgfw_ecs_restore(snapshot, size, 0) == 0);
+	TEST_CHECK(kgfw_ecs_restore(snapshot, size, 0) == 0);
+	free(snapshot);
+
+	/* the original and both restored copies */
+	test_ids_t ids = { { 0, 0, 0 }, 0 };
+	kgfw_ecs_each(state.value, restore_instance_id, &ids);
+	TEST_CHECK(ids.count == 3);
+	TEST_CHECK(ids.ids[0] != ids.ids[1] && ids.ids[0] != ids.ids[2] && ids.ids[1] != ids.ids[2]);
+}
+
+static void restore_instance_id(kgfw_component_span_t * span, void * data) {
+	test_ids_t * ids = data;
+	for (unsigned long long int i = 0; i < span->count; ++i) {
+		if (ids->count < 3) {
+			ids->ids[ids->count] = KGFW_COMPONENT_SPAN_AT(span, i)->instance_id;
+		}
+		++ids->count;
+	}
+}
+
+static void component_start(kgfw_component_t * self) {
+	return;
+}
+
+static void component_update(kgfw_component_t * self) {
+	return;
+}
+
+static void component_destroy(kgfw_component_t * self) {
+	return;
+}
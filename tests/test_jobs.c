@@ -0,0 +1,143 @@
+#include "../kgfw/kgfw_jobs.h"
+#include "../kgfw/kgfw_thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+	headless job system regression tests, run with make test.
+	exits non-zero if any check failed
+*/
+
+#define TEST_CHECK(condition) test_check((condition), #condition, __FILE__, __LINE__)
+#define TEST_WORKERS 3
+#define TEST_BATCH 64
+#define TEST_REUSE_ROUNDS 20000
+
+static struct {
+	volatile long long int done;
+	/* held-back jobs that ran before their dependency finished */
+	volatile long long int early;
+	/* of the counter reuse test, advanced by the dependency job and checked by the held-back one */
+	volatile long long int stage;
+	unsigned long long int checks;
+	unsigned long long int failures;
+} state = {
+	0, 0, 0,
+	0, 0
+};
+
+static void test_check(int condition, const char * expression, const char * file, int line);
+static void test_run_after(void);
+static void test_run_after_reuse(void);
+static void job_spin(void);
+static void job_dependency(void * data);
+static void job_after(void * data);
+static void job_reuse_dependency(void * data);
+static void job_reuse_after(void * data);
+
+int main(int argc, char ** argv) {
+	if (kgfw_jobs_init(TEST_WORKERS) != 0) {
+		fprintf(stderr, "jobs init failed\n");
+		return 1;
+	}
+
+	test_run_after();
+	test_run_after_reuse();
+
+	kgfw_jobs_deinit();
+	printf("test_jobs: %llu checks, %llu failed\n", state.checks, state.failures);
+	return (state.failures == 0) ? 0 : 1;
+}
+
+static void test_check(int condition, const char * expression, const char * file, int line) {
+	++state.checks;
+	if (!condition) {
+		++state.failures;
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+	}
+}
+
+static void test_run_after(void) {
+	kgfw_job_t dependencies[TEST_BATCH];
+	kgfw_job_t afters[TEST_BATCH];
+	for (unsigned long long int i = 0; i < TEST_BATCH; ++i) {
+		dependencies[i].func = job_dependency;
+		dependencies[i].data = NULL;
+		afters[i].func = job_after;
+		afters[i].data = NULL;
+	}
+
+	kgfw_job_counter_t dependency = { 0 };
+	kgfw_job_counter_t counter = { 0 };
+	kgfw_atomic_store(&state.done, 0);
+	kgfw_atomic_store(&state.early, 0);
+	kgfw_jobs_run(dependencies, TEST_BATCH, &dependency);
+	kgfw_jobs_run_after(afters, TEST_BATCH, &counter, &dependency);
+	kgfw_jobs_wait(&counter);
+
+	TEST_CHECK(kgfw_atomic_load(&dependency.value) == 0);
+	TEST_CHECK(kgfw_atomic_load(&state.done) == TEST_BATCH);
+	TEST_CHECK(kgfw_atomic_load(&state.early) == 0);
+
+	/* a dependency that already finished releases the batch right away */
+	kgfw_jobs_run_after(afters, TEST_BATCH, &counter, &dependency);
+	kgfw_jobs_wait(&counter);
+	TEST_CHECK(kgfw_atomic_load(&state.early) == 0);
+}
+
+/*
+	the same dependency counter is reused as soon as the held-back job finished, while the worker
+	that finished the previous dependency job may still be on its way to releasing held-back jobs.
+	every other dependency job returns right away to make that more likely
+*/
+static void test_run_after_reuse(void) {
+	kgfw_job_counter_t dependency = { 0 };
+	kgfw_job_counter_t counter = { 0 };
+	kgfw_atomic_store(&state.stage, 0);
+	kgfw_atomic_store(&state.early, 0);
+
+	for (long long int round = 0; round < TEST_REUSE_ROUNDS; ++round) {
+		kgfw_job_t first = { job_reuse_dependency, &round, NULL };
+		kgfw_job_t second = { job_reuse_after, &round, NULL };
+		kgfw_jobs_run(&first, 1, &dependency);
+		kgfw_jobs_run_after(&second, 1, &counter, &dependency);
+		kgfw_jobs_wait(&counter);
+		kgfw_jobs_wait(&dependency);
+	}
+
+	TEST_CHECK(kgfw_atomic_load(&state.stage) == TEST_REUSE_ROUNDS * 2);
+	TEST_CHECK(kgfw_atomic_load(&state.early) == 0);
+}
+
+/* long enough for other threads to get in between */
+static void job_spin(void) {
+	for (int i = 0; i < 64; ++i) {
+		kgfw_thread_yield();
+	}
+}
+
+static void job_dependency(void * data) {
+	job_spin();
+	kgfw_atomic_add(&state.done, 1);
+}
+
+static void job_after(void * data) {
+	if (kgfw_atomic_load(&state.done) != TEST_BATCH) {
+		kgfw_atomic_add(&state.early, 1);
+	}
+}
+
+static void job_reuse_dependency(void * data) {
+	long long int round = *(long long int *) data;
+	if (round & 1) {
+		job_spin();
+	}
+	kgfw_atomic_cas(&state.stage, round * 2, round * 2 + 1);
+}
+
+static void job_reuse_after(void * data) {
+	long long int round = *(long long int *) data;
+	if (!kgfw_atomic_cas(&state.stage, round * 2 + 1, round * 2 + 2)) {
+		kgfw_atomic_add(&state.early, 1);
+	}
+}